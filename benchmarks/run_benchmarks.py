@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# Scaling benchmarks of the terrain generation and the boids simulation.
+#
+# Each case runs the program in headless mode with command line overrides,
+# collects its JSON report, checks the mesh hash against the golden values
+# and writes all the results in a single JSON file. When a baseline results
+# file is given, the run fails if a case got slower or uses more memory than
+# the baseline beyond the tolerance.
+#
+# usage: run_benchmarks.py path/to/Boids [--suite terrain]
+#                          [--baseline old.json] [--update-golden]
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+GOLDEN_FILE = os.path.join(HERE, "golden.json")
+
+# settings shared by all the cases so that runs are reproducible
+COMMON = {
+    "randomizeOnGeneration": "false",
+    "offsetSeed": "22991",
+    "randomSeed": "1",
+    "headlessTimeStep": "0.016666",
+}
+
+
+def cube_case(n):
+    return {"numCubesX": n, "numCubesY": n, "numCubesZ": n}
+
+
+# name -> list of (case name, overrides)
+SUITES = {
+    "terrain": [
+        ("cubes%d" % n, dict(cube_case(n), numBoids=100, headlessFrames=10, headlessGenerations=5))
+        for n in (32, 64, 128, 256, 512)
+    ],
+    "octaves": [
+        ("octaves%d" % o, dict(cube_case(128), octaves=o, numBoids=100, headlessFrames=10, headlessGenerations=5))
+        for o in (1, 2, 4, 8, 12)
+    ],
+    "boids": [
+        ("boids%d" % b, dict(cube_case(64), numBoids=b, headlessFrames=300))
+        for b in (100, 1000, 10000, 100000, 1000000)
+    ],
+    # CPU stages (region removal, CPU boids) from 1 to 64 threads
+    "threads": [
+        ("threads%d" % t, dict(cube_case(256), numThreads=t, cpuSimulation="true", numBoids=4000,
+                               headlessFrames=120, headlessGenerations=3, profileTasks="true"))
+        for t in (1, 2, 4, 8, 16, 32, 64)
+    ],
+    # marching cubes against surface nets on the same density fields
+    "mesher": [
+        ("%s%d" % (mesher, n), dict(cube_case(n), surfaceNets=str(mesher == "surfaceNets").lower(),
+                                    numBoids=100, headlessFrames=10, headlessGenerations=5))
+        for mesher in ("marchingCubes", "surfaceNets") for n in (64, 128, 256)
+    ],
+    "rays": [
+        ("rays%d" % r, dict(cube_case(64), numBoids=10000, numRayDirs=r, headlessFrames=300))
+        for r in (25, 50, 100, 200, 400)
+    ],
+}
+
+# metrics compared against the baseline, lower is better
+GATED_SERIES = ["frame", "boidsUpdate", "generation"]
+GATED_VALUES = ["gpuBufferBytes", "peakResidentBytes"]
+
+# heap allocations that must stay at zero once the arenas and rings are warm
+ZERO_VALUES = ["steadyFrameAllocations", "steadyGenerationAllocations"]
+
+
+def run_case(program, name, overrides, workdir):
+    report = os.path.join(workdir, name + ".json")
+    settings = dict(COMMON)
+    settings.update({k: str(v) for k, v in overrides.items()})
+    settings["reportFile"] = '"%s"' % report
+
+    program = os.path.abspath(program)
+    args = [program, "--headless"] + ["%s=%s" % (k, v) for k, v in settings.items()]
+
+    # the program reads its shaders and config.txt from its own directory
+    process = subprocess.Popen(args, cwd=os.path.dirname(program),
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = process.stdout.read()
+    _, status, usage = os.wait4(process.pid, 0)
+    process.returncode = os.waitstatus_to_exitcode(status)
+
+    if process.returncode != 0 or not os.path.exists(report):
+        sys.stdout.write(output.decode(errors="replace"))
+        return {"name": name, "settings": settings, "failed": True}
+
+    with open(report) as f:
+        result = json.load(f)
+
+    result["name"] = name
+    result["settings"] = settings
+    result["peakResidentBytes"] = usage.ru_maxrss * 1024  # kilobytes on Linux
+    return result
+
+
+def check_golden(results, golden, update):
+    errors = []
+    for result in results:
+        if result.get("failed") or "meshHash" not in result:
+            continue
+        name = result["name"]
+        if update:
+            golden[name] = result["meshHash"]
+        elif name not in golden:
+            errors.append("%s: no golden mesh hash, record it with --update-golden" % name)
+        elif golden[name] != result["meshHash"]:
+            errors.append("%s: mesh hash %s, expected %s" % (name, result["meshHash"], golden[name]))
+    return errors
+
+
+def check_allocations(results):
+    errors = []
+    for result in results:
+        # the task profiling records a sample per task
+        if result.get("failed") or result["settings"].get("profileTasks") == "true":
+            continue
+        for value in ZERO_VALUES:
+            if result.get(value, 0) > 0:
+                errors.append("%s: %s %d, expected 0" % (result["name"], value, result[value]))
+    return errors
+
+
+def check_baseline(results, baseline, tolerance):
+    errors = []
+    previous = {r["name"]: r for r in baseline.get("results", [])}
+
+    for result in results:
+        old = previous.get(result["name"])
+        if old is None or old.get("failed") or result.get("failed"):
+            continue
+
+        for series in GATED_SERIES:
+            new_value = result.get("series", {}).get(series, {}).get("p50")
+            old_value = old.get("series", {}).get(series, {}).get("p50")
+            if new_value and old_value and new_value > old_value * (1 + tolerance):
+                errors.append("%s: %s p50 %.3fms, baseline %.3fms" % (result["name"], series, new_value, old_value))
+
+        for value in GATED_VALUES:
+            new_value = result.get(value)
+            old_value = old.get(value)
+            if new_value and old_value and new_value > old_value * (1 + tolerance):
+                errors.append("%s: %s %d, baseline %d" % (result["name"], value, new_value, old_value))
+
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Terrain and boids scaling benchmarks")
+    parser.add_argument("program", help="path to the compiled program")
+    parser.add_argument("--suite", action="append", choices=sorted(SUITES), help="suites to run (default all)")
+    parser.add_argument("--case", action="append", help="only run the cases with this name")
+    parser.add_argument("--output", default="benchmark_results.json", help="results file")
+    parser.add_argument("--baseline", help="results file to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.1, help="allowed relative regression")
+    parser.add_argument("--update-golden", action="store_true", help="store the mesh hashes as the golden values")
+    args = parser.parse_args()
+
+    golden = {}
+    if os.path.exists(GOLDEN_FILE):
+        with open(GOLDEN_FILE) as f:
+            golden = json.load(f)
+
+    results = []
+    with tempfile.TemporaryDirectory() as workdir:
+        for suite in args.suite or sorted(SUITES):
+            for name, overrides in SUITES[suite]:
+                if args.case and name not in args.case:
+                    continue
+                print("%s/%s..." % (suite, name), flush=True)
+                result = run_case(args.program, name, overrides, workdir)
+                result["suite"] = suite
+                results.append(result)
+
+    errors = ["%s: run failed" % r["name"] for r in results if r.get("failed")]
+    errors += check_golden(results, golden, args.update_golden)
+    errors += check_allocations(results)
+
+    if args.update_golden:
+        with open(GOLDEN_FILE, "w") as f:
+            json.dump(golden, f, indent=4, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            errors += check_baseline(results, json.load(f), args.tolerance)
+
+    with open(args.output, "w") as f:
+        json.dump({"results": results, "errors": errors}, f, indent=4)
+
+    for error in errors:
+        print("FAIL " + error)
+
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
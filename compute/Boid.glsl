@@ -41,23 +41,28 @@ layout (std430, binding = 2) readonly buffer cubesBuffer
 
 
 uniform float deltaTime;
-uniform vec3 boundingBox;
-uniform float predictionLength;
-uniform float minSpeed;
-uniform float maxSpeed;
-uniform float maxForce;
-uniform float viewRadius;
-uniform float viewAngle;
-uniform bool avoidMesh;
-uniform float cubeSize;
-uniform ivec3 cubeGridDims;
-uniform float avoidRadius;
-uniform float cohesionCoef;
-uniform float alignmentCoef;
-uniform float separationCoef;
-uniform float obstacleCoef;
-uniform vec3 boidModelTriangles[6*4];
-uniform int numBoids;
+
+// parameters only updated on configuration changes
+layout (std140, binding = 0) uniform parametersBlock
+{
+    vec3 boundingBox;
+    float predictionLength;
+    ivec3 cubeGridDims;
+    int numBoids;
+    float minSpeed;
+    float maxSpeed;
+    float maxForce;
+    float viewRadius;
+    float viewAngle;
+    float avoidRadius;
+    float cubeSize;
+    float cohesionCoef;
+    float alignmentCoef;
+    float separationCoef;
+    float obstacleCoef;
+    bool avoidMesh;
+    vec4 boidModelTriangles[6*4];
+};
 
 float rayMarchStepSize;
 int maxRayMarchSteps;
@@ -273,9 +278,9 @@ void main() {
     Vector triangles[6*4];
 
     for(int i = 0; i < 6*4; i += 4){
-        vec3 v1 = boidModelTriangles[i] * transform + pos;
-        vec3 v2 = boidModelTriangles[i+1] * transform + pos;
-        vec3 v3 = boidModelTriangles[i+2] * transform + pos;
+        vec3 v1 = boidModelTriangles[i].xyz * transform + pos;
+        vec3 v2 = boidModelTriangles[i+1].xyz * transform + pos;
+        vec3 v3 = boidModelTriangles[i+2].xyz * transform + pos;
         vec3 nor = normalize(cross(v2-v1, v3-v1));
 
         triangles[i]   = getVector(v1);
@@ -0,0 +1,135 @@
+#version 460
+
+#extension GL_ARB_compute_variable_group_size : enable
+
+precision highp float;
+precision highp int;
+
+layout (local_size_variable) in;
+
+// Counts the vertices and triangles the marching cubes stages will generate,
+// so that the output buffers can be sized exactly before generating them
+
+layout (std430, binding = 0) buffer pointBuffer
+{
+    vec4 points[];
+};
+
+// compact tables, see Tables.h : edges mask and number of triangles of each configuration
+layout (std430, binding = 3) buffer tablesBuffer
+{
+    uint cases[256];
+};
+
+layout (std430, binding = 7) buffer countsBuffer
+{
+    uint numVertices;
+    uint numTriangles;
+};
+
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
+
+
+// same bordering table as in the marching cubes stage : the edges whose vertex
+// is created by a cube according to its position along the grid borders
+const int bordTable[8][12] = {
+    {0, 3, 8, -1, -1,  -1, -1, -1, -1, -1, -1, -1},
+    {0, 3, 8, 2, 11, -1, -1, -1, -1, -1, -1, -1},
+    {0, 3, 8, 9, 1,  -1, -1, -1, -1, -1, -1, -1},
+    {0, 3, 8, 2, 11, 9, 1, 10, -1, -1, -1, -1},
+    {0, 3, 8, 4, 7,  -1, -1, -1,  -1, -1, -1, -1},
+    {0, 3, 8, 2, 11, 4, 7, 6, -1, -1, -1, -1},
+    {0, 3, 8, 4, 7,  1, 9, 5, -1, -1, -1, -1},
+    {0, 3, 8, 2, 11, 4, 7, 6, 5, 10, 9, 1}
+};
+
+const int numVerticesPerBordering[8] = {3, 5, 5, 8, 5, 8, 8, 12};
+
+shared uint groupVertices;
+shared uint groupTriangles;
+shared uint groupCases[256];
+
+
+int indexPoint(int x, int y, int z){
+    return z + densityGridDims.z * y + densityGridDims.z * densityGridDims.y * x;
+}
+
+void main(){
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    int x = id.x;
+    int y = id.y;
+    int z = id.z;
+
+    if(gl_LocalInvocationIndex == 0){
+        groupVertices = 0;
+        groupTriangles = 0;
+    }
+
+    // every cube reads the table, it is staged once per workgroup
+    uint groupSize = gl_LocalGroupSizeARB.x * gl_LocalGroupSizeARB.y * gl_LocalGroupSizeARB.z;
+    for(uint i = gl_LocalInvocationIndex; i < 256u; i += groupSize)
+        groupCases[i] = cases[i];
+    barrier();
+
+    // same cube corners order as in the marching cubes stage
+    float values[8];
+    values[0] = points[indexPoint(x, y, z)].w;
+    values[1] = points[indexPoint(x, y+1, z)].w;
+    values[2] = points[indexPoint(x+1, y+1, z)].w;
+    values[3] = points[indexPoint(x+1, y, z)].w;
+    values[4] = points[indexPoint(x, y, z+1)].w;
+    values[5] = points[indexPoint(x, y+1, z+1)].w;
+    values[6] = points[indexPoint(x+1, y+1, z+1)].w;
+    values[7] = points[indexPoint(x+1, y, z+1)].w;
+
+    int configuration = 0;
+    for(int i = 0; i < 8; ++i){
+        if(values[i] > surfaceLevel)
+            configuration |= 1 << i;
+    }
+
+    if(configuration != 0 && configuration != 255){
+        int bordering = 0;
+        if(x == cubeGridDims.x-1) bordering |= 1;
+        if(y == cubeGridDims.y-1) bordering |= 2;
+        if(z == cubeGridDims.z-1) bordering |= 4;
+
+        uint cubeCase = groupCases[configuration];
+        uint cubeVertices = 0;
+        for(int i = 0; i < numVerticesPerBordering[bordering]; ++i){
+            if((cubeCase & (1u << bordTable[bordering][i])) != 0u)
+                cubeVertices++;
+        }
+
+        uint cubeTriangles = cubeCase >> 12;
+
+        atomicAdd(groupVertices, cubeVertices);
+        atomicAdd(groupTriangles, cubeTriangles);
+    }
+
+    // a single global atomic operation per workgroup
+    barrier();
+    if(gl_LocalInvocationIndex == 0){
+        atomicAdd(numVertices, groupVertices);
+        atomicAdd(numTriangles, groupTriangles);
+    }
+}
@@ -14,33 +14,45 @@ layout (std430, binding = 0) buffer densityBuffer
 
 // Density shader inspired from : https://github.com/SebLague/Marching-Cubes/blob/master/Assets/Scripts/Compute/NoiseDensity.compute
 
-uniform ivec3 dims;
-uniform float cubeSize;
-uniform vec3 offset;
-uniform int octaves;
-uniform float lacunarity;
-uniform float persistence;
-uniform float noiseScale;
-uniform float noiseWeight;
-uniform float floorOffset;
-uniform bool closeEdges;
-uniform float hardFloor;
-uniform float floorWeight;
-uniform float stepSize;
-uniform float stepWeight;
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+    int seed;
+};
 
 // Simplex Noise implementation from : https://www.shadertoy.com/view/XsX3zB
 
+/* pcg3d hash from "Hash Functions for GPU Rendering", Jarzynski and Olano, 2020 */
+uvec3 pcg3d(uvec3 v) {
+	v = v*1664525u + 1013904223u;
+	v.x += v.y*v.z; v.y += v.z*v.x; v.z += v.x*v.y;
+	v ^= v >> 16u;
+	v.x += v.y*v.z; v.y += v.z*v.x; v.z += v.x*v.y;
+	return v;
+}
+
 /* discontinuous pseudorandom uniformly distributed in [-0.5, +0.5]^3 */
-vec3 random3(vec3 c) {
-	float j = 4096.0*sin(dot(c,vec3(17.0, 59.4, 15.0)));
-	vec3 r;
-	r.z = fract(512.0*j);
-	j *= .125;
-	r.x = fract(512.0*j);
-	j *= .125;
-	r.y = fract(512.0*j);
-	return r-0.5;
+/* integer hash of the lattice point and of the key of the octave, the same bits on every device */
+/* (the same as DensitySampler::random3) */
+vec3 random3(ivec3 c, uint key) {
+	uvec3 h = pcg3d(uvec3(c) + key*uvec3(1u, 0x9E3779B9u, 0x85EBCA6Bu));
+	return vec3(h >> 8u)*(1.0/16777216.0) - 0.5;
 }
 
 /* skew constants for 3d simplex functions */
@@ -48,7 +60,7 @@ const float F3 =  0.3333333;
 const float G3 =  0.1666667;
 
 /* 3d simplex noise */
-float simplex3d(vec3 p) {
+float simplex3d(vec3 p, uint key) {
 	 /* 1. find current tetrahedron T and it's four vertices */
 	 /* s, s+i1, s+i2, s+1.0 - absolute skewed (integer) coordinates of T vertices */
 	 /* x, x1, x2, x3 - unskewed coordinates of p relative to each of T vertices*/
@@ -79,11 +91,12 @@ float simplex3d(vec3 p) {
 	 /* w fades from 0.6 at the center of the surflet to 0.0 at the margin */
 	 w = max(0.6 - w, 0.0);
 
-	 /* calculate surflet components */
-	 d.x = dot(random3(s), x);
-	 d.y = dot(random3(s + i1), x1);
-	 d.z = dot(random3(s + i2), x2);
-	 d.w = dot(random3(s + 1.0), x3);
+	 /* calculate surflet components, s is exactly an integer */
+	 ivec3 si = ivec3(s);
+	 d.x = dot(random3(si, key), x);
+	 d.y = dot(random3(si + ivec3(i1), key), x1);
+	 d.z = dot(random3(si + ivec3(i2), key), x2);
+	 d.w = dot(random3(si + 1, key), x3);
 
 	 /* multiply d by w^4 */
 	 w *= w;
@@ -96,7 +109,7 @@ float simplex3d(vec3 p) {
 
 
 int index(ivec3 coords){
-    return coords.z + dims.z * coords.y + dims.z * dims.y * coords.x;
+    return coords.z + densityGridDims.z * coords.y + densityGridDims.z * densityGridDims.y * coords.x;
 }
 
 
@@ -112,7 +125,9 @@ void main() {
     float frequency = noiseScale/100.f;
     float weight = 1.f;
     for(int i = 0; i < octaves; ++i){
-        noise += simplex3d(pos * frequency) * weight;
+        // the seed picks the gradients instead of moving the field away from the origin
+        uint key = uint(seed)*0x27D4EB2Du + uint(i);
+        noise += simplex3d(pos * frequency, key) * weight;
         frequency *= lacunarity;
         weight *= persistence;
     }
@@ -128,14 +143,14 @@ void main() {
     // Add closed edges
 
     if(closeEdges){
-        vec3 edgeOffset = abs(vec3(coords) * 2.f - dims + 1.f) - dims + 2.f;
+        vec3 edgeOffset = abs(vec3(coords) * 2.f - densityGridDims + 1.f) - densityGridDims + 2.f;
         float edgeWeight = clamp(max(edgeOffset.x, max(edgeOffset.y, edgeOffset.z)), 0.f, 1.f);
 
         finalVal = finalVal * (1.f - edgeWeight) - 1000.f * edgeWeight;
     }
 
     // calculate the coordinates of the point
-    vec3 point = vec3(coords)*cubeSize + cubeSize/2.f - dims*cubeSize/2.f;
+    vec3 point = vec3(coords)*cubeSize + cubeSize/2.f - densityGridDims*cubeSize/2.f;
 
     // store the final noise value at the correct index in the buffer
     points[index(coords)] = vec4(point, finalVal);
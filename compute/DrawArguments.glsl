@@ -0,0 +1,44 @@
+#version 460
+
+precision highp float;
+precision highp int;
+
+// single invocation run after the triangles stage : writes the number of indices
+// of the indirect draw from the final triangles counter, so that the triangles
+// themselves do not contend on the arguments
+layout (local_size_x = 1) in;
+
+// two uints per vertex, see PackedVertex.h
+layout (std430, binding = 1) buffer vertexBuffer
+{
+    int vertCount;
+    uint vertices[];
+};
+
+struct Triangle
+{
+    int a, b, c;
+};
+
+layout (std430, binding = 5) buffer trianglesBuffer
+{
+    int triCount;
+    Triangle triangles[];
+};
+
+layout (std430, binding = 6) buffer indirectBuffer
+{
+    // draw elements indirect command
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+
+void main(){
+    // a mesh that did not fit in the buffers is not drawn until it is emitted again
+    bool fits = vertCount <= vertices.length() / 2 && triCount <= triangles.length();
+    indexCount = fits ? uint(triCount) * 3u : 0u;
+}
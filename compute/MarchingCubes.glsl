@@ -17,10 +17,11 @@ struct Vector
     float x, y, z;
 };
 
+// two uints per vertex, see PackedVertex.h
 layout (std430, binding = 1) buffer vertexBuffer
 {
     int vertCount;
-    Vector vertices[];
+    uint vertices[];
 };
 
 layout (std430, binding = 4) buffer normalsBuffer
@@ -33,16 +34,35 @@ layout (std430, binding = 2) buffer cubesBuffer
     int cubes[];
 };
 
+// compact tables, see Tables.h : edges mask and number of triangles of each configuration
 layout (std430, binding = 3) buffer tablesBuffer
 {
-    int edgeTable[256];
+    uint cases[256];
 };
 
+shared uint groupCases[256];
 
-uniform ivec3 densityGridDims;
-uniform ivec3 cubeGridDims;
-uniform float surfaceLevel;
-uniform int normalsOffset;
+
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
 
 
 // currently processed cube data
@@ -92,6 +112,27 @@ ControlNode getControlNode(int x, int y, int z){
     return ControlNode(points[i].xyz, vec3(normals[i].x, normals[i].y, normals[i].z), points[i].w);
 }
 
+// octahedral encoding of a normal in [0;1]^2
+vec2 encodeOctahedral(vec3 n){
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if(n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+// 16 bits positions relative to the box of the grid, and 8 bits octahedral normal
+uvec2 packVertex(vec3 p, vec3 n){
+    vec3 boxSize = vec3(cubeGridDims) * cubeSize;
+    uvec3 q = uvec3(clamp((p + boxSize / 2.0) / boxSize, 0.0, 1.0) * 65535.0 + 0.5);
+
+    if(dot(n, n) < 1e-12)
+        n = vec3(0.0, 1.0, 0.0);
+    uvec2 o = uvec2(clamp(encodeOctahedral(n), 0.0, 1.0) * 255.0 + 0.5);
+
+    return uvec2(q.x | (q.y << 16), q.z | (o.x << 16) | (o.y << 24));
+}
+
 // returns the vqlue used for vertex and normal interpolation
 float tvalue(float v1, float v2){
     return (surfaceLevel - v1) / (v2 - v1);
@@ -110,9 +151,13 @@ void createEdgeVertex(int edgeLocalID){
     vec3 p = mix(nodeA.pos, nodeB.pos, t);
     vec3 n = mix(nodeA.normal, nodeB.normal, t);
 
-    // Append the new vertex into the vertices buffer
-    vertices[vertexID] = Vector(p.x, p.y, p.z);
-    vertices[normalsOffset+vertexID] = Vector(n.x, n.y, n.z);
+    // Append the new vertex into the vertices buffer, the vertices beyond its size are
+    // dropped and the mesh is emitted again into a larger one
+    if(vertexID < vertices.length() / 2){
+        uvec2 packedVertex = packVertex(p, n);
+        vertices[vertexID * 2] = packedVertex.x;
+        vertices[vertexID * 2 + 1] = packedVertex.y;
+    }
 
     // Store the vertex id in the cube's edge location
     edgeNodes[edgeLocalID] = vertexID;
@@ -126,6 +171,12 @@ void main(){
 
     int currentCubeID = indexCube(x, y, z);
 
+    // every cube reads the table, it is staged once per workgroup
+    uint groupSize = gl_LocalGroupSizeARB.x * gl_LocalGroupSizeARB.y * gl_LocalGroupSizeARB.z;
+    for(uint i = gl_LocalInvocationIndex; i < 256u; i += groupSize)
+        groupCases[i] = cases[i];
+    barrier();
+
     // determine the cube control nodes, i.e. the cube's vertices
     // front face vertices
     controlNodes[0] = getControlNode(x, y, z);
@@ -157,8 +208,9 @@ void main(){
 
         // Create the necessary additional edges for cubes along borders of the grid, based
         // on its bordering value
+        uint edgeMask = groupCases[configuration] & 0xfffu;
         for(int i = 0; i < numVerticesPerBordering[bordering]; ++i){
-            if((edgeTable[configuration] & (1 << bordTable[bordering][i])) != 0)
+            if((edgeMask & (1u << bordTable[bordering][i])) != 0u)
                 createEdgeVertex(bordTable[bordering][i]);
         }
 
@@ -22,10 +22,29 @@ layout (std430, binding = 4) buffer normalsBuffer
     Vector normals[];
 };
 
-uniform ivec3 dims;
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
 
 int index(int x, int y, int z){
-    return z + dims.z * y + dims.z * dims.y * x;
+    return z + densityGridDims.z * y + densityGridDims.z * densityGridDims.y * x;
 }
 
 void main() {
@@ -44,9 +63,9 @@ void main() {
     float dy = v;
     float dz = v;
 
-    if(x > 0 && x < dims.x-1) dx = points[index(x-1, y, z)].w - points[index(x+1, y, z)].w;
-    if(y > 0 && y < dims.y-1) dy = points[index(x, y-1, z)].w - points[index(x, y+1, z)].w;
-    if(z > 0 && z < dims.z-1) dz = points[index(x, y, z-1)].w - points[index(x, y, z+1)].w;
+    if(x > 0 && x < densityGridDims.x-1) dx = points[index(x-1, y, z)].w - points[index(x+1, y, z)].w;
+    if(y > 0 && y < densityGridDims.y-1) dy = points[index(x, y-1, z)].w - points[index(x, y+1, z)].w;
+    if(z > 0 && z < densityGridDims.z-1) dz = points[index(x, y, z-1)].w - points[index(x, y, z+1)].w;
 
     vec3 n = normalize(vec3(dx, dy, dz));
 
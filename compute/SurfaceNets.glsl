@@ -0,0 +1,169 @@
+#version 460
+
+#extension GL_ARB_compute_variable_group_size : enable
+
+precision highp float;
+precision highp int;
+
+layout (local_size_variable) in;
+
+// Naive surface nets, vertices stage : each cube crossed by the surface gets a single
+// vertex at the average of the points where the surface crosses its edges, shared by
+// the quads of the next stage. Its index is stored in the first edge slot of the cube.
+
+layout (std430, binding = 0) buffer pointBuffer
+{
+    vec4 points[];
+};
+
+struct Vector
+{
+    float x, y, z;
+};
+
+// two uints per vertex, see PackedVertex.h
+layout (std430, binding = 1) buffer vertexBuffer
+{
+    int vertCount;
+    uint vertices[];
+};
+
+layout (std430, binding = 4) buffer normalsBuffer
+{
+    Vector normals[];
+};
+
+layout (std430, binding = 2) buffer cubesBuffer
+{
+    int cubes[];
+};
+
+
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
+
+
+struct ControlNode
+{
+    vec3 pos;
+    vec3 normal;
+    float value;
+};
+
+ControlNode controlNodes[8];
+
+// same corners and edges as in the marching cubes stage
+// edges:                0  1  2  3  4  5  6  7  8  9  10 11
+const int edgeNodeA[] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3};
+const int edgeNodeB[] = {1, 2, 3, 0, 5, 6, 7, 4, 4, 5, 6, 7};
+
+
+int indexPoint(int x, int y, int z){
+    return z + densityGridDims.z * y + densityGridDims.z * densityGridDims.y * x;
+}
+
+int indexCube(int x, int y, int z){
+    return (z + cubeGridDims.z * y + cubeGridDims.z * cubeGridDims.y * x) * 13;
+}
+
+ControlNode getControlNode(int x, int y, int z){
+    int i = indexPoint(x, y, z);
+    return ControlNode(points[i].xyz, vec3(normals[i].x, normals[i].y, normals[i].z), points[i].w);
+}
+
+// same packing as in the marching cubes stage
+vec2 encodeOctahedral(vec3 n){
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if(n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+uvec2 packVertex(vec3 p, vec3 n){
+    vec3 boxSize = vec3(cubeGridDims) * cubeSize;
+    uvec3 q = uvec3(clamp((p + boxSize / 2.0) / boxSize, 0.0, 1.0) * 65535.0 + 0.5);
+
+    if(dot(n, n) < 1e-12)
+        n = vec3(0.0, 1.0, 0.0);
+    uvec2 o = uvec2(clamp(encodeOctahedral(n), 0.0, 1.0) * 255.0 + 0.5);
+
+    return uvec2(q.x | (q.y << 16), q.z | (o.x << 16) | (o.y << 24));
+}
+
+float tvalue(float v1, float v2){
+    return (surfaceLevel - v1) / (v2 - v1);
+}
+
+void main(){
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    int x = id.x;
+    int y = id.y;
+    int z = id.z;
+
+    int currentCubeID = indexCube(x, y, z);
+
+    controlNodes[0] = getControlNode(x, y, z);
+    controlNodes[1] = getControlNode(x, y+1, z);
+    controlNodes[2] = getControlNode(x+1, y+1, z);
+    controlNodes[3] = getControlNode(x+1, y, z);
+    controlNodes[4] = getControlNode(x, y, z+1);
+    controlNodes[5] = getControlNode(x, y+1, z+1);
+    controlNodes[6] = getControlNode(x+1, y+1, z+1);
+    controlNodes[7] = getControlNode(x+1, y, z+1);
+
+    int configuration = 0;
+    for(int i = 0; i < 8; ++i){
+        if(controlNodes[i].value > surfaceLevel)
+            configuration |= 1 << i;
+    }
+
+    int vertexID = -1;
+
+    if(configuration != 0 && configuration != 255){
+        // average of the crossings of the edges, and of their interpolated normals
+        vec3 p = vec3(0.0);
+        vec3 n = vec3(0.0);
+        float numCrossings = 0.0;
+        for(int i = 0; i < 12; ++i){
+            int a = edgeNodeA[i];
+            int b = edgeNodeB[i];
+            if(((configuration >> a) & 1) != ((configuration >> b) & 1)){
+                float t = tvalue(controlNodes[a].value, controlNodes[b].value);
+                p += mix(controlNodes[a].pos, controlNodes[b].pos, t);
+                n += mix(controlNodes[a].normal, controlNodes[b].normal, t);
+                numCrossings += 1.0;
+            }
+        }
+        p /= numCrossings;
+
+        // the vertices beyond the buffer size are dropped, the mesh is emitted again
+        vertexID = atomicAdd(vertCount, 1);
+        if(vertexID < vertices.length() / 2){
+            uvec2 packedVertex = packVertex(p, n);
+            vertices[vertexID * 2] = packedVertex.x;
+            vertices[vertexID * 2 + 1] = packedVertex.y;
+        }
+    }
+
+    cubes[currentCubeID] = vertexID;
+    cubes[currentCubeID+12] = configuration;
+}
@@ -0,0 +1,105 @@
+#version 460
+
+#extension GL_ARB_compute_variable_group_size : enable
+
+precision highp float;
+precision highp int;
+
+layout (local_size_variable) in;
+
+// Counts the vertices and triangles the surface nets stages will generate : one
+// vertex per cube crossed by the surface, and one quad per crossed grid edge
+
+layout (std430, binding = 0) buffer pointBuffer
+{
+    vec4 points[];
+};
+
+layout (std430, binding = 7) buffer countsBuffer
+{
+    uint numVertices;
+    uint numTriangles;
+};
+
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
+
+
+shared uint groupVertices;
+shared uint groupTriangles;
+
+
+int indexPoint(int x, int y, int z){
+    return z + densityGridDims.z * y + densityGridDims.z * densityGridDims.y * x;
+}
+
+void main(){
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    int x = id.x;
+    int y = id.y;
+    int z = id.z;
+
+    if(gl_LocalInvocationIndex == 0){
+        groupVertices = 0;
+        groupTriangles = 0;
+    }
+    barrier();
+
+    // same cube corners order as in the marching cubes stage
+    float values[8];
+    values[0] = points[indexPoint(x, y, z)].w;
+    values[1] = points[indexPoint(x, y+1, z)].w;
+    values[2] = points[indexPoint(x+1, y+1, z)].w;
+    values[3] = points[indexPoint(x+1, y, z)].w;
+    values[4] = points[indexPoint(x, y, z+1)].w;
+    values[5] = points[indexPoint(x, y+1, z+1)].w;
+    values[6] = points[indexPoint(x+1, y+1, z+1)].w;
+    values[7] = points[indexPoint(x+1, y, z+1)].w;
+
+    int configuration = 0;
+    for(int i = 0; i < 8; ++i){
+        if(values[i] > surfaceLevel)
+            configuration |= 1 << i;
+    }
+
+    if(configuration != 0 && configuration != 255){
+        atomicAdd(groupVertices, 1u);
+
+        // same edges as in the quads stage : the edges leaving the first corner along x
+        // (corner 3), y (corner 1) and z (corner 4), when the four cubes around them are in the grid
+        bool first = (configuration & 1) != 0;
+        uint cubeTriangles = 0;
+        if(y > 0 && z > 0 && first != ((configuration & 8) != 0))
+            cubeTriangles += 2;
+        if(x > 0 && z > 0 && first != ((configuration & 2) != 0))
+            cubeTriangles += 2;
+        if(x > 0 && y > 0 && first != ((configuration & 16) != 0))
+            cubeTriangles += 2;
+        atomicAdd(groupTriangles, cubeTriangles);
+    }
+
+    // a single global atomic operation per workgroup
+    barrier();
+    if(gl_LocalInvocationIndex == 0){
+        atomicAdd(numVertices, groupVertices);
+        atomicAdd(numTriangles, groupTriangles);
+    }
+}
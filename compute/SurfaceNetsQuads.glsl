@@ -0,0 +1,102 @@
+#version 460
+
+#extension GL_ARB_compute_variable_group_size : enable
+
+precision highp float;
+precision highp int;
+
+layout (local_size_variable) in;
+
+// Naive surface nets, quads stage : each grid edge crossed by the surface joins the
+// vertices of the four cubes around it with two triangles. Each cube handles the edges
+// leaving its first corner, the quads facing the side of the edge outside the surface.
+
+layout (std430, binding = 0) buffer pointBuffer
+{
+    vec4 points[];
+};
+
+layout (std430, binding = 2) buffer cubesBuffer
+{
+    int cubes[];
+};
+
+struct Triangle
+{
+    int a, b, c;
+};
+
+layout (std430, binding = 5) coherent buffer trianglesBuffer
+{
+    int triCount;
+    Triangle triangles[];
+};
+
+// parameters shared by all the mesh generation stages
+layout (std140, binding = 0) uniform parametersBlock
+{
+    ivec3 densityGridDims;
+    float cubeSize;
+    ivec3 cubeGridDims;
+    float surfaceLevel;
+    vec3 offset;
+    int octaves;
+    float lacunarity;
+    float persistence;
+    float noiseScale;
+    float noiseWeight;
+    float floorOffset;
+    bool closeEdges;
+    float hardFloor;
+    float floorWeight;
+    float stepSize;
+    float stepWeight;
+};
+
+
+int indexPoint(int x, int y, int z){
+    return z + densityGridDims.z * y + densityGridDims.z * densityGridDims.y * x;
+}
+
+bool isInside(int x, int y, int z){
+    return points[indexPoint(x, y, z)].w > surfaceLevel;
+}
+
+// vertex of the cube written by the vertices stage
+int cubeVertex(int x, int y, int z){
+    return cubes[(z + cubeGridDims.z * y + cubeGridDims.z * cubeGridDims.y * x) * 13];
+}
+
+// a, b, c, d turn counterclockwise around the edge direction
+void appendQuad(int a, int b, int c, int d, bool reversed){
+    int triIndex = atomicAdd(triCount, 2);
+    if(triIndex + 1 >= triangles.length())
+        return;
+
+    if(reversed){
+        triangles[triIndex] = Triangle(a, d, c);
+        triangles[triIndex+1] = Triangle(a, c, b);
+    } else {
+        triangles[triIndex] = Triangle(a, b, c);
+        triangles[triIndex+1] = Triangle(a, c, d);
+    }
+}
+
+void main(){
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    int x = id.x;
+    int y = id.y;
+    int z = id.z;
+
+    bool inside = isInside(x, y, z);
+
+    // the quads face the positive direction of the edge when its first point is inside
+    if(y > 0 && z > 0 && inside != isInside(x+1, y, z))
+        appendQuad(cubeVertex(x, y-1, z-1), cubeVertex(x, y, z-1), cubeVertex(x, y, z), cubeVertex(x, y-1, z), !inside);
+
+    if(x > 0 && z > 0 && inside != isInside(x, y+1, z))
+        appendQuad(cubeVertex(x-1, y, z-1), cubeVertex(x-1, y, z), cubeVertex(x, y, z), cubeVertex(x, y, z-1), !inside);
+
+    if(x > 0 && y > 0 && inside != isInside(x, y, z+1))
+        appendQuad(cubeVertex(x-1, y-1, z), cubeVertex(x, y-1, z), cubeVertex(x, y, z), cubeVertex(x-1, y, z), !inside);
+}
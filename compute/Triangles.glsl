@@ -12,21 +12,16 @@ layout (std430, binding = 2) buffer cubesBuffer
     int cubes[];
 };
 
+// compact tables, see Tables.h : edges mask and number of triangles of each configuration,
+// and the edges of its triangles packed on 4 bits each
 layout (std430, binding = 3) buffer tablesBuffer
 {
-    int edgeTable[256];
-    int triTable[256][16];
+    uint cases[256];
+    uvec2 packedEdges[256];
 };
 
-struct Vector
-{
-    float x, y, z;
-};
-
-layout (std430, binding = 1) buffer verticesBuffer
-{
-    Vector vertices[];
-};
+shared uint groupCases[256];
+shared uvec2 groupEdges[256];
 
 struct Triangle
 {
@@ -40,27 +35,37 @@ layout (std430, binding = 5) coherent buffer trianglesBuffer
 };
 
 
-vec3 getVertex(int vertex){
-    Vector v = vertices[vertex];
-    return vec3(v.x, v.y, v.z);
+int triangleEdge(uvec2 edges, uint i){
+    uint word = i < 8u ? edges.x : edges.y;
+    return int((word >> (4u * (i % 8u))) & 0xfu);
 }
 
 void main(){
     int id = int(gl_GlobalInvocationID.x);
     int cubeIndex = id * 13;
 
+    // every cube reads the tables, they are staged once per workgroup
+    uint groupSize = gl_LocalGroupSizeARB.x * gl_LocalGroupSizeARB.y * gl_LocalGroupSizeARB.z;
+    for(uint i = gl_LocalInvocationIndex; i < 256u; i += groupSize){
+        groupCases[i] = cases[i];
+        groupEdges[i] = packedEdges[i];
+    }
+    barrier();
+
     // Calculate the triangles of the cube
 
     int configuration = cubes[cubeIndex+12];
-    int triConfigIndex = configuration;
+    uint numTriangles = groupCases[configuration] >> 12;
+    uvec2 edges = groupEdges[configuration];
 
-    for(int i = 0; triTable[triConfigIndex][i] != -1; i += 3){
-        int vertA = cubes[cubeIndex + triTable[triConfigIndex][i]];
-        int vertB = cubes[cubeIndex + triTable[triConfigIndex][i+1]];
-        int vertC = cubes[cubeIndex + triTable[triConfigIndex][i+2]];
+    for(uint t = 0u; t < numTriangles; t++){
+        int vertA = cubes[cubeIndex + triangleEdge(edges, t * 3u)];
+        int vertB = cubes[cubeIndex + triangleEdge(edges, t * 3u + 1u)];
+        int vertC = cubes[cubeIndex + triangleEdge(edges, t * 3u + 2u)];
 
-        // Append the triangle in the triangles buffer
+        // Append the triangle in the triangles buffer, unless it is full
         int triIndex = atomicAdd(triCount, 1);
-        triangles[triIndex] = Triangle(vertA, vertB, vertC);
+        if(triIndex < triangles.length())
+            triangles[triIndex] = Triangle(vertA, vertB, vertC);
     }
 }
@@ -0,0 +1,19 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <stddef.h>
+
+// Counts the heap allocations made through operator new by all the threads,
+// the global operators are replaced in AllocationCounter.cpp. The arenas record
+// the blocks they allocate with malloc.
+
+class AllocationCounter
+{
+    public:
+        static size_t count();
+        static size_t bytes();
+
+        static void record(size_t size);
+};
+
+#endif // ALLOCATIONCOUNTER_H
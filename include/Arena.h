@@ -0,0 +1,64 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <vector>
+#include <new>
+
+// Bump allocator for temporary memory with a known lifetime : everything allocated
+// is released at once by reset(). The memory blocks are kept between resets, and
+// merged into one when the arena is reset, so that once the arena has grown to the
+// size a frame or a generation needs, it never allocates again.
+
+class Arena
+{
+    public:
+        Arena();
+
+        void* allocate(size_t size, size_t alignment);
+
+        // uninitialized array of n elements of a trivially destructible type
+        template<typename T>
+        T* allocateArray(size_t n)
+        {
+            return (T*)allocate(n * sizeof(T), alignof(T));
+        }
+
+        // array of n default constructed elements of a trivially destructible type
+        template<typename T>
+        T* constructArray(size_t n)
+        {
+            T* array = allocateArray<T>(n);
+            for(size_t i = 0; i < n; i++)
+                new (&array[i]) T();
+            return array;
+        }
+
+        void reset();
+        void release();
+
+        size_t getUsedBytes();
+        size_t getCapacity();
+
+        // scratch memory released at the start of each frame and of each generation
+        static Arena& frame();
+        static Arena& generation();
+
+        virtual ~Arena();
+
+    protected:
+
+    private:
+        struct Block
+        {
+            char* data;
+            size_t capacity;
+            size_t used;
+        };
+
+        std::vector<Block> blocks;
+
+        void createBlock(size_t capacity);
+};
+
+#endif // ARENA_H
@@ -0,0 +1,79 @@
+#ifndef BATCHGENERATOR_H
+#define BATCHGENERATOR_H
+
+#include <NoiseSettings.h>
+#include <StreamingMesher.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+// Generates the terrains of a list of noise settings back to back on the CPU, for datasets
+// of many seeds. Each slot meshes one terrain after the other on its own thread, with its
+// own streamed mesher whose slab and edges are reused from one terrain to the next, while
+// the density of all the slots is evaluated on the thread pool. Nothing waits on another
+// slot : the calling thread harvests the terrains as they are finished, in any order.
+
+class BatchGenerator
+{
+    public:
+        int numSlots = 2;
+        int slabSlices = 8;
+        std::vector<float> surfaceLevels = {0.f};
+
+        struct Result
+        {
+            int index = 0;          // in the list of settings
+            int seed = 0;
+            std::string path;
+            long long numVertices = 0;
+            long long numTriangles = 0;
+            float duration = 0.f;   // in ms
+            bool success = false;
+        };
+
+        // measured once all the terrains are harvested
+        float duration = 0.f;   // in ms
+        float terrainsPerMinute = 0.f;
+
+        BatchGenerator();
+
+        // starts generating the terrains into directory/terrain<index>_<seed>.mesh
+        bool start(const std::vector<NoiseSettings>& _terrains, const std::string& _directory,
+                   int width, int height, int depth, float _cubeSize);
+
+        // waits for the next finished terrain, returns false once they were all harvested
+        bool next(Result& result);
+
+        virtual ~BatchGenerator();
+
+    protected:
+
+    private:
+        std::vector<NoiseSettings> terrains;
+        std::string directory;
+        int grid[3] = {0, 0, 0};
+        float cubeSize = 0.1f;
+
+        std::vector<std::thread> threads;
+        std::deque<StreamingMesher> meshers;
+        std::atomic<int> nextTerrain;
+
+        // terrains finished and not harvested yet
+        std::mutex finishedMutex;
+        std::condition_variable finishedCondition;
+        std::deque<Result> finished;
+        int numHarvested = 0;
+
+        std::chrono::steady_clock::time_point startTime;
+
+        void runSlot(int slot);
+        void join();
+};
+
+#endif // BATCHGENERATOR_H
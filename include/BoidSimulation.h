@@ -0,0 +1,88 @@
+#ifndef BOIDSIMULATION_H
+#define BOIDSIMULATION_H
+
+#include <vec3d.h>
+#include <SparseVolume.h>
+#include <vector>
+#include <stdint.h>
+
+// CPU implementation of the boids simulation of the Boid.glsl compute shader,
+// it has no OpenGL dependency so that it can run on its own thread
+
+class BoidSimulation
+{
+    public:
+        struct Boid
+        {
+            vec3d pos, vel;
+        };
+
+        std::vector<Boid> boids;
+        // state before the last step
+        std::vector<Boid> previousBoids;
+
+        struct {
+            float x = 1.f, y = 1.f, z = 1.f;
+        } box;
+
+        float predictionLength = 0.1f;
+        float minSpeed = 0.01f;
+        float maxSpeed = 1.f;
+        float maxForce = 0.1f;
+        float viewRadius = 1.f;
+        float viewAngle = 3.141592f;
+        float avoidRadius = 0.1f;
+        float cohesionCoef = 1.f;
+        float alignmentCoef = 1.f;
+        float separationCoef = 1.f;
+        float obstacleCoef = 1.f;
+
+        bool avoidMesh = false;
+
+        BoidSimulation();
+
+        void setup(int _numBoids, int _numRays);
+        // density of the terrain, the cubes with a solid corner are obstacles
+        void setObstacles(SparseVolume& volume, float _cubeSize);
+
+        void generateBoids(unsigned int seed);
+        void step(float deltaTime);
+
+        int getNumBoids();
+
+        // rotation of the model pointing upwards (0, 1, 0) to the given direction
+        static void orientation(vec3d dir, float matrix[3][3]);
+        static vec3d transform(float matrix[3][3], vec3d v);
+
+        // random number in [0;1[ depending only on the seed and the index, so that
+        // random values can be generated in parallel
+        static float hashRandom(uint32_t seed, uint32_t index);
+
+        virtual ~BoidSimulation();
+
+    protected:
+
+    private:
+        int numBoids = 0;
+        int numRays = 0;
+
+        std::vector<vec3d> rayDirs;
+
+        SparseVolume obstacles;
+        int gridDims[3] = {0, 0, 0};
+        float cubeSize = 0.1f;
+
+        void calculateRayDirs();
+
+        bool insideBox(vec3d p);
+        bool isSolid(vec3d p);
+        bool intersectMesh(vec3d pos, vec3d dir);
+        vec3d findUnobstructedDir(vec3d pos, vec3d forward, bool& isHeadingCollision);
+        vec3d steeringForce(vec3d vel, vec3d desired);
+        void stepBoid(int id, float deltaTime);
+
+        static void transformDirection(vec3d dir, vec3d ref, float matrix[3][3]);
+        static void rotation(vec3d axis, float angle, float matrix[3][3]);
+};
+
+#endif // BOIDSIMULATION_H
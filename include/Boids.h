@@ -4,6 +4,8 @@
 #include <ComputeProcess.h>
 #include <MarchingCubes.h>
 #include <vec3d.h>
+#include <BoidSimulation.h>
+#include <ThreadPool.h>
 
 
 class Boids : private ComputeProcess
@@ -51,11 +53,25 @@ class Boids : private ComputeProcess
         void deleteBuffers();
 
         bool setup(int _numBoids, float width, float height, int _numRays);
-        void update(float deltaTime);
-        void draw();
+        void uploadParameters();
+        // runs numSubsteps fixed steps of deltaTime back to back on the GPU
+        void update(float deltaTime, int numSubsteps);
+
+        // GPU time of the last measured update and of one of its substeps in ms,
+        // returns true when they were updated
+        float updateDuration = 0.f;
+        float substepDuration = 0.f;
+        bool pollStatistics();
+
+        // draws the boids interpolated between the two last states (alpha in [0;1])
+        void draw(float alpha);
 
         void generateBoids();
 
+        // CPU simulation path : copies the settings to the simulation, and draws its state
+        void configureSimulation(BoidSimulation& simulation);
+        void drawSimulation(std::vector<BoidSimulation::Boid>& previous, std::vector<BoidSimulation::Boid>& state, float alpha);
+
         virtual ~Boids();
 
     protected:
@@ -83,17 +99,54 @@ class Boids : private ComputeProcess
 
         Vector boidModelTriangles[6*4];
 
+        // std140 layout of the parameters uniform block of the boid compute shader
+        struct Parameters
+        {
+            GLfloat boundingBox[3];
+            GLfloat predictionLength;
+            GLint cubeGridDims[3];
+            GLint numBoids;
+            GLfloat minSpeed, maxSpeed, maxForce, viewRadius;
+            GLfloat viewAngle, avoidRadius, cubeSize, cohesionCoef;
+            GLfloat alignmentCoef, separationCoef, obstacleCoef;
+            GLint avoidMesh;
+            GLfloat boidModelTriangles[6*4][4];
+        };
+
         ComputeProgram boidProgram;
+        GLint deltaTimeLocation = -1;
+
         Buffer boidsData;
         Buffer rayDirs;
+        Buffer parameters;
+
+        // the previous and the updated states are drawn from a non blocking
+        // readback of the last update
+        StreamBuffer boidsReadback;
+        StreamBuffer::Range lastReadback, pendingReadback;
+        bool hasReadback = false, hasPendingReadback = false;
+
+        int measuredSubsteps = 1;
+
+        std::vector<std::pair<const char*, float>> stageDurations;
 
         int numRays = 0;
 
         bool hasBuffers = false, hasProgram = false;
         bool numBoidsChanged = true, numRayDirsChanged = true;
 
-        Color *colors;
-        bool colorsArrayExist = false;
+        Color *colors = nullptr;
+        int numColors = 0;
+
+        // the boids and their colors are generated by two tasks from one seed,
+        // the initial states are staged in the generation arena
+        TaskGraph generationGraph{ThreadPool::global()};
+        bool hasGenerationGraph = false;
+        uint32_t generationSeed = 0;
+        Boid *generatedBoids = nullptr;
+
+        void generateBoidStates();
+        void generateBoidColors();
 
         void setup();
 
@@ -103,6 +156,7 @@ class Boids : private ComputeProcess
 
         void updateDispatchParams();
         void resizeBoidBuffer();
+        void createReadbackStream();
 };
 
 #endif // BOIDS_H
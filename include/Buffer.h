@@ -5,13 +5,64 @@
 #include <GL/glew.h>
 #include <GL/glfw3.h>
 
+#include <vector>
+
+
+// Persistently mapped buffer used as a ring for non blocking transfers between the CPU
+// and the GPU. Each transfer is guarded by a fence and its memory is only reused once
+// the GPU is done with it.
+
+class StreamBuffer
+{
+    public:
+        GLuint id;
+        size_t size = 0;
+
+        struct Range
+        {
+            size_t offset = 0;
+            size_t size = 0;
+            GLsync fence = 0;
+        };
+
+        // number of times the CPU had to wait for the GPU to release a range
+        static int fenceWaits;
+
+        StreamBuffer();
+        StreamBuffer(size_t _size, GLbitfield access);
+
+        Range allocate(size_t _size);
+        void fence(Range& range);
+        bool isReady(Range& range);
+        void wait(Range& range);
+        void* pointer(Range& range);
+
+        void deleteBuffer();
+
+        virtual ~StreamBuffer();
+
+    protected:
+
+    private:
+        char* mapped = NULL;
+        size_t head = 0;
+
+        std::vector<Range> inFlight;
+
+        void release(size_t start, size_t end);
+        static void waitSync(GLsync sync);
+};
+
+
 // simple buffer class for an easier handle of buffer operations
 
 class Buffer
 {
     public:
         GLuint id;
-        size_t size;
+        size_t size = 0;
+        size_t capacity = 0; // allocated bytes, the buffer only reallocates when its size goes beyond
+        size_t offset = 0; // start of the buffer's range when it is sub-allocated from an arena
 
         Buffer();
         Buffer(GLenum _target, GLenum _usage);
@@ -19,23 +70,34 @@ class Buffer
         Buffer(GLenum _target, GLenum _usage, size_t _size, void* data);
 
         void setData(const void* data);
-        void setSubData(int offset, size_t _size, const void* data);
+        void setSubData(int _offset, size_t _size, const void* data);
         void getData(void* container);
-        void getSubData(int offset, size_t _size, void* container);
+        void getSubData(int _offset, size_t _size, void* container);
 
         void setBindingPoint(int binding);
 
         void resize(size_t _size);
         void resize(size_t _size, void* data);
+        void reserve(size_t _capacity);
 
         void* map(GLenum access);
-        void* map(int offset, size_t _size, GLenum access);
+        void* map(int _offset, size_t _size, GLenum access);
         void unmap();
 
         void copy(Buffer& source);
+        void copySubData(Buffer& destination, int readOffset, int writeOffset, size_t _size);
+
+        // non blocking transfers through persistently mapped rings
+        void streamSubData(int _offset, size_t _size, const void* data);
+        StreamBuffer::Range requestSubData(StreamBuffer& stream, int _offset, size_t _size);
 
         void deleteBuffer();
 
+        // total amount of GPU memory allocated by buffers and arenas
+        static size_t getAllocatedBytes();
+
+        static void deleteStreams();
+
         virtual ~Buffer();
 
     protected:
@@ -43,6 +105,55 @@ class Buffer
     private:
         GLenum target;
         GLenum usage;
+        bool isSubAllocated = false;
+
+        static size_t allocatedBytes;
+
+        static StreamBuffer uploadStream;
+
+        friend class BufferArena;
+        friend class StreamBuffer;
+};
+
+
+// Allocates buffer ranges from large blocks of GPU memory. Ranges are released all at
+// once with reset(), the blocks are kept and reused for the next allocations.
+
+class BufferArena
+{
+    public:
+        BufferArena();
+        BufferArena(GLenum _target, GLenum _usage);
+
+        Buffer allocate(size_t _size);
+        void reserve(size_t _capacity);
+        void reset();
+
+        size_t getUsedBytes();
+        size_t getCapacity();
+        size_t align(size_t value);
+
+        void deleteArena();
+
+        virtual ~BufferArena();
+
+    protected:
+
+    private:
+        GLenum target;
+        GLenum usage;
+        size_t alignment = 256;
+
+        struct Block
+        {
+            GLuint id;
+            size_t capacity;
+            size_t used;
+        };
+
+        std::vector<Block> blocks;
+
+        void createBlock(size_t _capacity);
 };
 
 
@@ -4,6 +4,15 @@
 #include <vec3d.h>
 
 
+// planes of a view frustum, with their normals pointing inside
+struct Frustum
+{
+    vec3d normals[6];
+    float distances[6];
+
+    bool intersectsSphere(vec3d center, float radius) const;
+};
+
 class Camera
 {
     public:
@@ -36,6 +45,9 @@ class Camera
 
         void resetCenter();
 
+        // frustum of a perspective projection looking from pos to center, fovy in degrees
+        Frustum frustum(float fovy, float aspect, float zNear, float zFar);
+
         virtual ~Camera();
 
     protected:
@@ -7,12 +7,16 @@
 
 #include <Buffer.h>
 #include <string>
+#include <map>
+#include <vector>
 
 
 class ComputeProcess
 {
     public:
         static int workGroupsCapabilities[7];
+        // shaders which failed to compile and programs which failed to link
+        static int numProgramErrors;
 
         static void getWorkGroupsCapabilities();
         static void printWorkGroupsCapabilities();
@@ -41,11 +45,22 @@ class ComputeProcess
             GLuint id;
             DispatchParams dispatchParams;
 
+            // uniform locations are resolved once when the program is created
+            std::map<std::string, GLint> uniformLocations;
+
             ComputeProgram();
             ComputeProgram(std::string sourcefile, DispatchParams params);
-        } currentProgram;
+
+            GLint uniformLocation(std::string name);
+            void resolveUniformLocations();
+        };
+
+        // not copied, the uniform locations of a program are only read when it is created
+        ComputeProgram *currentProgram = nullptr;
 
         static GLuint createComputeProgram(std::string sourcefile);
+        // vertex and fragment shaders program used to draw the generated data
+        static GLuint createRenderProgram(std::string vertexFile, std::string fragmentFile);
 
         void useProgram(ComputeProgram& cprogram);
 
@@ -55,14 +70,30 @@ class ComputeProcess
         void runComputeShader();
 
         void startDurationRecording();
+        void stopDurationRecording();
         float endDurationRecording();
+        bool pollDurationRecording(float& duration);
+        void discardDurationRecording();
+
+        // GPU timestamps between the stages of a process, stages are closed by markStage
+        bool beginStageTimings();
+        void markStage(const char* name);
+        void endStageTimings();
+        void discardStageTimings();
+        bool pollStageTimings(std::vector<std::pair<const char*, float>>& durations);
 
         static DispatchParams calculateOptimalDisptachSpace(int numInstancesX, int numInstancesY, int numInstancesZ);
 
     private:
         GLuint durationQuery;
 
+        std::vector<GLuint> stageQueries;
+        std::vector<const char*> stageNames;
+        bool stageTimingsPending = false;
+        bool stageRecording = false;
+
         static char* loadShaderSource(std::string filename);
+        static GLuint compileShader(GLenum type, std::string sourcefile);
 
         static bool gotCapabilities;
 };
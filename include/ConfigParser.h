@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 // Parser for the custom configuration file format
 
@@ -14,6 +15,9 @@ class ConfigParser
 
         void parse();
 
+        // "name = value" setting that takes precedence over the file, kept between parses
+        void override(std::string line);
+
         int getInt(std::string name);
         float getFloat(std::string name);
         bool getBool(std::string name);
@@ -46,6 +50,8 @@ class ConfigParser
 
         std::string sourceFile;
 
+        std::vector<std::string> overrides;
+
         static const std::string WHITESPACE;
         static const std::string FLOATCHARS;
         static const std::string INTCHARS;
@@ -0,0 +1,63 @@
+#ifndef CPUMARCHINGCUBES_H
+#define CPUMARCHINGCUBES_H
+
+#include <vector>
+#include <stdint.h>
+
+// Marching cubes on the CPU, fed one slice of density points at a time along the x
+// axis. Only the vertex ids of the edges of the two last slices are kept, so that a
+// vertex shared by several cubes is only created once. The corners, edges and winding
+// of the triangles are the same as in MarchingCubes.glsl. Several surfaces can be
+// extracted in the same pass, each corner being loaded once for all the levels.
+
+class CpuMarchingCubes
+{
+    public:
+        // one surface per level, set before begin()
+        std::vector<float> surfaceLevels = {0.f};
+
+        // positions are in the coordinates of the points given to begin() and addSlice(),
+        // the first position is the one of the vertex firstVertex. The vertices of all the
+        // surfaces share the positions, the triangles of the level l are in indices[l]
+        std::vector<float> positions;
+        std::vector<std::vector<uint32_t>> indices;
+        int firstVertex = 0;
+
+        CpuMarchingCubes();
+
+        // ys and zs are the coordinates of the points of a slice, which has ny * nz points
+        void begin(const float* ys, int ny, const float* zs, int nz);
+        // values of the points of the slice at x, indexed by z + nz * y
+        void addSlice(float x, const float* values);
+
+        // total number of vertices created since begin()
+        int getNumVertices();
+
+        // drops the positions and indices already used, for meshes streamed out while
+        // they are generated, the following vertices keep their ids
+        void clearOutput();
+
+        virtual ~CpuMarchingCubes();
+
+    protected:
+
+    private:
+        int ny = 0, nz = 0;
+        int numLevels = 0;
+        int numSlices = 0;
+        float previousX = 0.f;
+
+        std::vector<float> ys, zs;
+        std::vector<float> previous;
+
+        // vertex ids of the edges along y and z on the previous and on the new slice,
+        // and of the edges along x between them, -1 when not created yet, for each level
+        std::vector<int> previousEdgesY, previousEdgesZ;
+        std::vector<int> nextEdgesY, nextEdgesZ;
+        std::vector<int> edgesX;
+
+        void meshCube(int j, int k, float x, const float* values);
+        int edgeVertex(int edge, int level, int j, int k, float x, const float corners[8]);
+};
+
+#endif // CPUMARCHINGCUBES_H
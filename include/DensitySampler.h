@@ -0,0 +1,36 @@
+#ifndef DENSITYSAMPLER_H
+#define DENSITYSAMPLER_H
+
+#include <NoiseSettings.h>
+
+#include <stdint.h>
+
+// CPU version of the density field of Density.glsl, evaluated anywhere in the grid
+// and not only on its points. The coordinates are in density grid units, the point
+// (0, 0, 0) being the first point of the grid.
+
+class DensitySampler
+{
+    public:
+        DensitySampler();
+
+        // the density grid has one more point than cubes on each axis
+        void configure(const NoiseSettings& _noise, int numCubesX, int numCubesY, int numCubesZ);
+
+        float sample(float x, float y, float z) const;
+        // opposite of the gradient of the field, normalized
+        void normal(float x, float y, float z, float n[3]) const;
+
+        virtual ~DensitySampler();
+
+    protected:
+
+    private:
+        NoiseSettings noise;
+        float dims[3] = {1.f, 1.f, 1.f};
+
+        static float simplex3d(float px, float py, float pz, uint32_t key);
+        static void random3(int cx, int cy, int cz, uint32_t key, float r[3]);
+};
+
+#endif // DENSITYSAMPLER_H
@@ -0,0 +1,60 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded lock-free queue for a single producer thread and a single consumer
+// thread. The capacity must be a power of two, pushing to a full queue fails.
+
+template<typename T, size_t Capacity>
+class EventQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+    public:
+        EventQueue() : head(0), tail(0)
+        {
+
+        }
+
+        // producer side
+        bool push(const T& value)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if(t - head.load(std::memory_order_acquire) == Capacity)
+                return false;
+
+            items[t & (Capacity - 1)] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side
+        bool pop(T& value)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire))
+                return false;
+
+            value = items[h & (Capacity - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // only when neither thread is using the queue
+        void clear()
+        {
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        T items[Capacity];
+
+        // separate cache lines so that the two threads don't invalidate each other
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+};
+
+#endif // EVENTQUEUE_H
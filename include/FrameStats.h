@@ -0,0 +1,40 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+// Collects timing samples and values of a run and writes them as a JSON report,
+// sample series are summarized with their mean and percentiles
+
+class FrameStats
+{
+    public:
+        FrameStats();
+
+        void reserve(const char* series, int numSamples);
+        void addSample(const char* series, float value);
+        void setValue(std::string name, double value);
+        void setString(std::string name, std::string value);
+
+        float percentile(std::string series, float p);
+        float mean(std::string series);
+        float total(std::string series);
+
+        bool writeReport(std::string filename);
+
+        virtual ~FrameStats();
+
+    protected:
+
+    private:
+        // transparent comparator, adding a sample to an existing series does not build a string
+        std::map<std::string, std::vector<float>, std::less<>> samples;
+        std::map<std::string, double> values;
+        std::map<std::string, std::string> strings;
+
+        std::vector<float>& findSeries(const char* series);
+};
+
+#endif // FRAMESTATS_H
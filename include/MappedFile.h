@@ -0,0 +1,57 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <string>
+
+// File mapped in memory. A file created for writing grows by remapping it larger, its
+// pages are written back by the system, so that writing a file larger than the memory
+// only keeps the recently written pages resident.
+
+class MappedFile
+{
+    public:
+        MappedFile();
+
+        // empty file opened for reading and writing
+        bool create(const std::string& path);
+        // existing file opened read only
+        bool open(const std::string& path);
+
+        // appends at the end of the written data, growing the file if needed
+        bool write(const void* data, size_t _size);
+        bool reserve(size_t _capacity);
+
+        // asks the system to write back the pages written so far
+        void flush();
+
+        // unmaps the file, a written file is truncated to its size
+        void close();
+
+        char* data();
+        size_t size();
+        bool isOpen();
+
+        virtual ~MappedFile();
+
+    protected:
+
+    private:
+        char* mapped = nullptr;
+        size_t mappedSize = 0;
+        size_t capacity = 0;
+        size_t written = 0;
+        bool writable = false;
+
+#ifdef _WIN32
+        void* file = nullptr;
+        void* mapping = nullptr;
+#else
+        int file = -1;
+#endif
+
+        bool map(size_t _size);
+        void unmap();
+};
+
+#endif // MAPPEDFILE_H
@@ -8,8 +8,14 @@
 #include <ComputeProcess.h>
 
 #include <NoiseSettings.h>
-#include <queue>
+#include <Meshlets.h>
+#include <Camera.h>
+#include <PackedVertex.h>
+#include <MeshCache.h>
+#include <MeshExporter.h>
+#include <SparseVolume.h>
 #include <vector>
+#include <stdint.h>
 
 
 class MarchingCubes : private ComputeProcess
@@ -18,9 +24,55 @@ class MarchingCubes : private ComputeProcess
         int numVertices = 0;
         int numTriangles = 0;
         float generationDuration = 0;
+        std::vector<std::pair<const char*, float>> stageDurations; // GPU time of each generation stage in ms
         float surfaceLevel = 0.f;
         int minRegionSize = 1000;
 
+        // the flood fill and the CPU boids work on a narrow band copy of the density, see
+        // SparseVolume.h, its bricks and memory are measured when it is built
+        int numVolumeBricks = 0;
+        int numStoredBricks = 0;
+        size_t volumeBytes = 0;
+        size_t denseVolumeBytes = 0;
+
+        // meshes the density field with naive surface nets instead of marching cubes : one
+        // vertex per cube crossed by the surface and one quad per crossed edge of the grid
+        bool surfaceNets = false;
+
+        // collapses the edges of the generated triangles until simplifyRatio of them are left,
+        // or until the surface would move more than simplifyError cubes, see MeshSimplifier.h.
+        // The triangles before, the largest error in cubes and the duration in ms are measured
+        bool simplifyMesh = false;
+        float simplifyRatio = 0.2f;
+        float simplifyError = 0.5f;
+        int trianglesBeforeSimplification = 0;
+        float simplificationError = 0.f;
+        float simplificationDuration = 0.f;
+
+        // reorders the generated triangles and vertices for the vertex cache, the
+        // cache miss ratios (ACMR) of the last generation are measured before and after
+        bool optimizeMesh = false;
+        int vertexCacheSize = 16;
+        float cacheMissRatioBefore = 0.f;
+        float cacheMissRatioAfter = 0.f;
+
+        // splits the generated mesh into meshlets of meshletSize cubes wide cells,
+        // culled on each draw against the view frustum
+        bool useMeshlets = false;
+        int meshletSize = 8;
+        int numMeshlets = 0;
+        int numVisibleMeshlets = 0;
+
+        // generations that could not rely on the counts of the previous one to size their output
+        // buffers : the first one, the ones after a grid change, and the ones that did not fit
+        int countFallbacks = 0;
+
+        // the generated meshes are stored in the cache, and loaded from it instead of
+        // being generated when the same parameters come again
+        bool useCache = false;
+        bool cacheHit = false;
+        MeshCache cache;
+
         NoiseSettings noise;
 
         struct {
@@ -37,7 +89,21 @@ class MarchingCubes : private ComputeProcess
         bool resize(int width, int height, int depth, float _cubeSize);
 
         void generate();
-        void draw();
+        void draw(vec3d eye, const Frustum& frustum);
+
+        // reads the vertices and triangles counts and the generation duration once
+        // they are available, returns true when they were updated
+        bool pollStatistics();
+        bool hasPendingStatistics();
+
+        // blocking readback of the generated mesh
+        void readMesh(std::vector<float>& positions, std::vector<float>& meshNormals, std::vector<GLuint>& indices);
+        // copy of the narrow band density of the last generation, for the CPU boids
+        void readVolume(SparseVolume& copy);
+        // hash of the mesh triangles independent of the order they were written in
+        uint64_t meshHash();
+        // starts exporting the last generated mesh, once its statistics are known
+        bool exportMesh(MeshExporter& exporter, const std::string& path);
 
         void createPrograms();
         void createBuffers();
@@ -54,15 +120,35 @@ class MarchingCubes : private ComputeProcess
 
     private:
         float cubeSize = 0.1f;
-        int maxNumVertices;
-        int maxNumTriangles;
+
+        // the output buffers are sized from the vertices and triangles counted by the previous
+        // generation with some headroom, the counts of the current one are read back without
+        // waiting and checked once ready, or before the mesh is read
+        GLuint lastCounts[2] = {0, 0};
+        bool hasLastCounts = false;
+        StreamBuffer::Range countsRange;
+        bool countsChecked = true;
+
+        // draws the packed vertices, see PackedVertex.h
+        GLuint renderProgram = 0;
+        GLint boxMinLocation = -1, boxSizeLocation = -1;
 
         bool hasPrograms = false, hasBuffers = false;
 
         ComputeProgram densityCompute;
         ComputeProgram normalsCompute;
+        ComputeProgram countCompute;
         ComputeProgram marchingCubesCompute;
         ComputeProgram trianglesCompute;
+        ComputeProgram surfaceNetsCountCompute;
+        ComputeProgram surfaceNetsCompute;
+        ComputeProgram surfaceNetsQuadsCompute;
+        ComputeProgram drawArgumentsCompute;
+
+        // the grid sized buffers are sub-allocated from a single arena so that
+        // resizing the grid reuses the same GPU memory when it is big enough
+        BufferArena gridArena;
+        bool hasArena = false;
 
         Buffer density;
         Buffer normals;
@@ -70,12 +156,57 @@ class MarchingCubes : private ComputeProcess
         Buffer vertices;
         Buffer triangles;
         Buffer tables;
+        Buffer parameters;
+        Buffer counts;
 
-        Volume densityGrid, cubeGrid;
+        // draw and dispatch arguments written by the triangulation stage
+        Buffer indirect;
+
+        struct IndirectArguments
+        {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
 
-        int* flattenTriTable();
+        StreamBuffer statisticsStream;
+        StreamBuffer::Range verticesCountRange, trianglesCountRange;
+        bool statisticsPending = false;
+        bool stagesRecorded = false;
+
+        // std140 layout of the parameters uniform block shared by the mesh compute shaders
+        struct Parameters
+        {
+            GLint densityGridDims[3];
+            GLfloat cubeSize;
+            GLint cubeGridDims[3];
+            GLfloat surfaceLevel;
+            GLfloat offset[3];
+            GLint octaves;
+            GLfloat lacunarity, persistence, noiseScale, noiseWeight;
+            GLfloat floorOffset;
+            GLint closeEdges;
+            GLfloat hardFloor, floorWeight;
+            GLfloat stepSize, stepWeight;
+            GLint seed;
+            GLint padding;
+        };
+
+        void uploadParameters();
+
+        Volume densityGrid, cubeGrid;
 
         void resize();
+        void releaseBuffers();
+        void resizeOutputBuffers();
+        void reserveOutputBuffers(GLuint vertexCount, GLuint triangleCount);
+        // emits the vertices and triangles of the counted cubes
+        void emitMesh(bool recordStages);
+        // checks the counts of the last generation, and emits the mesh again into larger
+        // buffers if it did not fit, returns true in that case
+        bool fitOutputBuffers();
         void updateDispatchParams();
 
         struct Coord
@@ -89,10 +220,36 @@ class MarchingCubes : private ComputeProcess
             float x, y, z, val;
         };
 
+        SparseVolume volume;
+        bool hasVolume = false;
+
         void removeSmallRegions();
-        void getRegionPoints(Coord start, Point* points, std::vector<bool>& visited, std::vector<int>& region);
-        void appendRegionPoint(Coord c, Point* points, std::vector<bool>& visited, std::vector<int>& region, std::queue<Coord>& q);
+        void buildVolume(const Point* points);
         int pointIndex(Coord c);
+
+        // simplifies the mesh, reorders it for the vertex cache and builds the meshlets
+        void processMesh();
+        void simplify(const PackedVertex* packed, GLuint vertexCount, uint32_t* indices, GLuint& indexCount);
+        void buildMeshlets(const PackedVertex* packed, GLuint vertexCount, uint32_t* indices, GLuint indexCount);
+        // positions of the packed vertices, in the generation arena
+        float* decodePositions(const PackedVertex* packed, GLuint vertexCount);
+
+        // hash of all the parameters the mesh depends on
+        uint64_t generationKey();
+        bool loadCachedMesh();
+        void storeCachedMesh();
+        bool cachedStatistics = false;
+        // blocking readback of the packed vertices and of the indices into the generation arena
+        bool readPackedMesh(PackedVertex*& packed, GLuint& vertexCount, uint32_t*& indices, GLuint& indexCount);
+
+        vec3d getBoxMin();
+        vec3d getBoxSize();
+
+        Meshlets meshlets;
+        bool hasMeshlets = false;
+
+        // draw commands of the visible meshlets, written on each frame
+        StreamBuffer drawCommands;
 };
 
 #endif // MARCHINGCUBES_H
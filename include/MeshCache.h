@@ -0,0 +1,51 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <MappedFile.h>
+#include <MeshFile.h>
+#include <PackedVertex.h>
+
+// Generated meshes stored on disk, one mesh file (see MeshFile.h) per key. The key is
+// a hash of everything the generation depends on, so a stored mesh never needs to be
+// invalidated. A loaded file stays mapped and its arrays are used in place.
+
+class MeshCache
+{
+    public:
+        std::string directory = "cache";
+
+        int hits = 0;
+        int misses = 0;
+
+        MeshCache();
+
+        // FNV-1a, chained by passing the previous hash
+        static uint64_t hash(const void* data, size_t size, uint64_t previous = 14695981039346656037ULL);
+
+        // maps the mesh of the key, until the next load or release()
+        bool load(uint64_t key);
+        void release();
+
+        const MeshFileHeader& header();
+        const PackedVertex* vertices();
+        const uint32_t* indices();
+        const uint8_t* cubes();
+
+        bool store(uint64_t key, const PackedVertex* _vertices, uint32_t numVertices, const uint32_t* _indices, uint32_t numIndices,
+                   const uint8_t* _cubes, uint32_t numCubes, vec3d boxMin, vec3d boxSize);
+
+        virtual ~MeshCache();
+
+    protected:
+
+    private:
+        MappedFile file;
+        MeshFileHeader loaded;
+
+        std::string path(uint64_t key);
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,94 @@
+#ifndef MESHEXPORTER_H
+#define MESHEXPORTER_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GL/glfw3.h>
+
+#include <Buffer.h>
+#include <PackedVertex.h>
+#include <vec3d.h>
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+
+// Exports the generated mesh to a binary PLY or glTF (.glb) file. The GPU copies the
+// mesh into a persistently mapped buffer, and once the copy is done a writer thread
+// decodes the vertices and writes the file by chunks, so that the rendering never
+// waits for the GPU nor for the disk.
+
+class MeshExporter
+{
+    public:
+        enum Format { PLY, GLB };
+
+        struct Result
+        {
+            std::string path;
+            size_t bytes = 0;
+            float duration = 0.f;   // writing time in ms
+            float throughput = 0.f; // in MB/s
+            bool success = false;
+        };
+
+        size_t chunkSize = 4 * 1024 * 1024; // bytes written at once
+
+        MeshExporter();
+
+        // starts copying the arrays, that begin at the given offsets of their buffers,
+        // returns false while the previous export is not done
+        bool request(const std::string& _path, Buffer& vertices, size_t verticesOffset, GLuint _vertexCount,
+                     Buffer& indices, size_t indicesOffset, GLuint _indexCount, vec3d _boxMin, vec3d _boxSize);
+
+        // called on each frame, starts the writer once the copy is done
+        // and returns true when an export is finished
+        bool poll(Result& _result);
+        bool isBusy();
+
+        // the format is chosen from the extension of the file
+        static Format formatOf(const std::string& _path);
+
+        void deleteBuffer();
+
+        virtual ~MeshExporter();
+
+    protected:
+
+    private:
+        enum State { IDLE, COPYING, WRITING, DONE };
+        std::atomic<int> state;
+
+        StreamBuffer staging;
+        StreamBuffer::Range range;
+        size_t indicesStart = 0;
+
+        std::thread writer;
+        Result result;
+
+        std::string path;
+        Format format = GLB;
+        GLuint vertexCount = 0, indexCount = 0;
+        vec3d boxMin, boxSize;
+
+        // chunk being filled by the writer thread
+        std::vector<char> chunk;
+        size_t chunkUsed = 0;
+        FILE* file = nullptr;
+        size_t written = 0;
+        bool failed = false;
+
+        void write();
+        void writePly();
+        void writeGlb();
+
+        void append(const void* data, size_t size);
+        void flushChunk();
+
+        const PackedVertex* packedVertices();
+        const uint32_t* packedIndices();
+};
+
+#endif // MESHEXPORTER_H
@@ -0,0 +1,45 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Header of the binary mesh files : it is followed by the packed vertices (see
+// PackedVertex.h), by the 32 bits indices of the triangles, optionally by the
+// configuration of each cube and by the table of the surfaces of several levels,
+// all starting on a multiple of 16 bytes so that a mapped file can be used in place.
+
+// range of the indices of the surface at one level, when a file holds several
+struct MeshFileLevel
+{
+    float surfaceLevel;
+    uint32_t firstIndex;
+    uint32_t numIndices;
+};
+
+struct MeshFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numVertices;
+    uint32_t numIndices;
+    float boxMin[3];
+    float boxSize[3];
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint64_t cubesOffset;
+    uint32_t numCubes;
+    uint32_t numLevels;         // 0 for a single surface without table
+    uint64_t levelsOffset;
+
+    static const uint32_t currentVersion = 3;
+
+    // the number of levels is 0, it is set before writing the table when there is one
+    void init(uint32_t _numVertices, uint32_t _numIndices, uint32_t _numCubes, const float _boxMin[3], const float _boxSize[3]);
+    // checks the magic, the version and that the arrays fit in the file
+    bool isValid(size_t fileSize) const;
+
+    static uint64_t align(uint64_t offset);
+};
+
+#endif // MESHFILE_H
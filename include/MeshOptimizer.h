@@ -0,0 +1,25 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <stdint.h>
+
+// Reordering of an indexed triangle mesh for the post-transform vertex cache
+// and for the vertex fetch, the scratch memory comes from the generation arena
+
+class MeshOptimizer
+{
+    public:
+        // average number of vertices transformed per triangle (ACMR) with a FIFO cache of cacheSize vertices
+        static float cacheMissRatio(const uint32_t* indices, int numIndices, int numVertices, int cacheSize);
+
+        // reorders the triangles so that consecutive triangles share their vertices
+        // (Tipsify, Sander et al. 2007), in place
+        static void optimizeVertexCache(uint32_t* indices, int numIndices, int numVertices, int cacheSize);
+
+        // renumbers the vertices in the order the triangles first use them and moves
+        // the vertices of vertexSize bytes accordingly, returns the number of vertices
+        // used by the triangles
+        static int optimizeVertexFetch(uint32_t* indices, int numIndices, void* vertices, int vertexSize, int numVertices);
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,59 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <stdint.h>
+#include <vec3d.h>
+
+// Decimation of an indexed triangle mesh by edge collapses ordered by their
+// quadric error (Garland and Heckbert 1997). Each vertex is collapsed onto one
+// of its neighbours, so the remaining vertices keep their position and normal.
+// The quadrics and the cheapest collapse of each vertex are computed on the thread
+// pool, then each pass applies the cheapest collapses which don't share vertices.
+// The scratch memory comes from the generation arena.
+
+class MeshSimplifier
+{
+    public:
+        // collapses edges in place until at most targetIndices indices are left, or until the
+        // next collapse would move the surface more than maxError away from the original one,
+        // returns the new number of indices and the largest error of the collapses in error.
+        // The vertices on the open borders of the mesh don't move, and the vertices on the faces
+        // of the box only move along them, so the edges of the mesh on the box are preserved
+        static int simplify(uint32_t* indices, int numIndices, const float* positions, int numVertices,
+                            vec3d boxMin, vec3d boxSize, int targetIndices, float maxError, float& error);
+
+    private:
+        // symmetric 4x4 matrix of the sum of the squared distances to a set of planes, which
+        // bounds the squared distance to each of them
+        struct Quadric
+        {
+            double a00, a01, a02, a03;
+            double a11, a12, a13;
+            double a22, a23;
+            double a33;
+
+            void clear();
+            void addPlane(const double plane[4]);
+            void add(const Quadric& q);
+            // sum of the squared distances of the point to the planes
+            double error(const float p[3]) const;
+        };
+
+        // vertices which can't be collapsed, or only onto vertices on the same faces of the box
+        enum
+        {
+            BOX_FACES = 0x3f,
+            LOCKED = 0x40
+        };
+
+        struct Collapse
+        {
+            uint32_t from, to;
+            float cost;
+        };
+
+        static void computeNormal(const float* a, const float* b, const float* c, float normal[3]);
+        static bool contains(const uint32_t* triangle, uint32_t v);
+};
+
+#endif // MESHSIMPLIFIER_H
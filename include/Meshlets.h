@@ -0,0 +1,49 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <stdint.h>
+#include <vector>
+#include <Camera.h>
+
+// Partition of a mesh into clusters of the triangles that fall in the same cell of
+// a grid, each with a bounding sphere and a cone containing its triangle normals
+// so that the clusters can be culled against the view frustum and when all their
+// triangles are facing away from the eye
+
+class Meshlets
+{
+    public:
+        struct Meshlet
+        {
+            float center[3];
+            float radius;
+            float coneAxis[3];
+            float coneCutoff; // sine of the cone angle, 1 when the cone can't cull
+            uint32_t firstIndex;
+            uint32_t count;
+        };
+
+        // layout of the glMultiDrawElementsIndirect commands
+        struct DrawCommand
+        {
+            uint32_t count;
+            uint32_t instanceCount;
+            uint32_t firstIndex;
+            int32_t baseVertex;
+            uint32_t baseInstance;
+        };
+
+        std::vector<Meshlet> meshlets;
+
+        // sorts the triangles by cell in place, keeping their order inside a cell,
+        // and computes the bounds of each non empty cell
+        void build(uint32_t* indices, int numIndices, const float* positions, vec3d gridMin, float cellSize, int cellsX, int cellsY, int cellsZ);
+
+        // writes a draw command for each meshlet that may be visible from the eye,
+        // firstIndex is the position of the indices in the element buffer, returns the number of commands
+        int cull(const Frustum& frustum, vec3d eye, uint32_t firstIndex, DrawCommand* commands);
+
+        void clear();
+};
+
+#endif // MESHLETS_H
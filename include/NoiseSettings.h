@@ -23,6 +23,7 @@ struct NoiseSettings
         float x = 0.f, y = 0.f, z = 0.f;
     } offset;
 
+    // picks the gradients of the noise, see Density.glsl
     int offsetSeed = 0;
 
     void seed(int newOffsetSeed);
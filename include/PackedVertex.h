@@ -0,0 +1,20 @@
+#ifndef PACKEDVERTEX_H
+#define PACKEDVERTEX_H
+
+#include <stdint.h>
+#include <vec3d.h>
+
+// 8 bytes terrain vertex written by MarchingCubes.glsl or encode() and decoded by Terrain.vert :
+// the position is quantized on 16 bits per axis inside the box of the grid, and the
+// normal is octahedral encoded on 8 bits per component
+
+struct PackedVertex
+{
+    uint32_t xy;        // x | y << 16
+    uint32_t zNormal;   // z | u << 16 | v << 24
+
+    void encode(vec3d boxMin, vec3d boxSize, const float position[3], const float normal[3]);
+    void decode(vec3d boxMin, vec3d boxSize, float position[3], float normal[3]) const;
+};
+
+#endif // PACKEDVERTEX_H
@@ -7,8 +7,18 @@
 
 #include <ConfigParser.h>
 #include <MarchingCubes.h>
+#include <TerrainLod.h>
 #include <Boids.h>
 #include <Camera.h>
+#include <FrameStats.h>
+#include <SimulationThread.h>
+#include <ThreadPool.h>
+#include <Arena.h>
+#include <AllocationCounter.h>
+
+#include <chrono>
+#include <thread>
+#include <mutex>
 
 
 class Program
@@ -21,6 +31,14 @@ class Program
         void setup();
         void update();
 
+        // runs a fixed number of frames and generations without window nor input,
+        // and writes a JSON report of the frame and generation statistics, returns
+        // false when a shader failed or the report could not be written
+        bool runHeadless();
+
+        // noise settings of the configuration, also used without any program
+        static void configureNoise(ConfigParser& config, NoiseSettings& noise);
+
         // GLFW event callbacks
         void onKeyPressed(int key, int scancode, int action, int mods);
         void onCursorPosition(double x, double y);
@@ -36,6 +54,7 @@ class Program
 
         ConfigParser config;
         MarchingCubes mesh;
+        TerrainLod lod;
         Boids boids;
         Camera cam;
 
@@ -46,11 +65,49 @@ class Program
         bool meshHasGeneration = false;
         bool randomizeOnGeneration = true;
 
+        // the terrain is meshed on the CPU in chunks whose resolution decreases with their
+        // distance to the camera, instead of by the compute shaders at full resolution
+        bool lodTerrain = false;
+
         bool pauseBoids = false;
         bool numBoidsChanged = false;
 
+        // boids simulated on the CPU by their own thread instead of the compute shader
+        bool cpuSimulation = false;
+        SimulationThread simulationThread;
+
+        // perspective projection, also used to cull the meshlets
+        const float fieldOfView = 65.f;
+        const float nearPlane = 0.1f;
+        const float farPlane = 100.f;
+
         float frameTime = 0.f;
 
+        // the boids are updated with a fixed time step, the remaining
+        // time is used to interpolate between the two last states
+        float boidsTimeStep = 1.f/60.f;
+        int maxSubsteps = 8;
+        float boidsAccumulator = 0.f;
+        long long numSubstepsRun = 0;
+        std::chrono::steady_clock::time_point frameStart;
+
+        // the mesh is written to exportFile on a background thread
+        MeshExporter exporter;
+        void exportMesh();
+        void printExportStatistics(MeshExporter::Result& result);
+
+        bool headless = false;
+        float headlessTimeStep = 1.f/60.f;
+        int headlessGenerations = 1;
+        FrameStats stats;
+
+        // durations of the thread pool tasks and time spent in tasks by each thread,
+        // the threads outside the pool first, recorded from the workers
+        std::mutex taskSamplesMutex;
+        std::vector<std::pair<const char*, float>> taskSamples;
+        std::vector<double> taskBusy;
+        static void recordTask(const char* name, int worker, double start, double end, void* user);
+
         struct Feature
         {
             float x, y, z;
@@ -87,6 +144,7 @@ class Program
         void configureProgram();
         void configureMesh();
         void configureBoids();
+        void updateBoids();
 
         void setupCamera();
         void configureCamera();
@@ -96,6 +154,14 @@ class Program
         void resetProjectionSettings();
 
         void generateMesh();
+        void printMeshStatistics();
+        void printLodStatistics();
+
+        // the simulation thread is stopped during any change of the mesh or of the boids
+        void startSimulation(bool regenerateBoids);
+        void stopSimulation();
+
+        float elapsedTime();
 };
 
 #endif // PROGRAM_H
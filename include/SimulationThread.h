@@ -0,0 +1,82 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <BoidSimulation.h>
+#include <Camera.h>
+#include <TripleBuffer.h>
+#include <EventQueue.h>
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Runs the CPU boids simulation and the camera at a fixed tick on its own thread.
+// Input events are received through a lock-free queue, and the state is published
+// after each tick through a triple buffer that the render thread reads without waiting.
+
+class SimulationThread
+{
+    public:
+        struct InputEvent
+        {
+            enum Type { KEY, CURSOR, MOUSE_BUTTON, SCROLL };
+
+            Type type;
+            int code = 0;   // key or mouse button
+            int action = 0;
+            float x = 0.f, y = 0.f;
+        };
+
+        struct Snapshot
+        {
+            // states before and after the tick, drawn interpolated
+            std::vector<BoidSimulation::Boid> previousBoids, boids;
+            std::chrono::steady_clock::time_point time;
+            vec3d cameraPos, cameraCenter;
+            uint64_t tick = 0;
+            float stepDuration = 0.f; // CPU time of the simulation step in ms
+        };
+
+        // only accessed by the simulation thread while it is running
+        BoidSimulation simulation;
+        Camera camera;
+        bool paused = false;
+
+        float tickRate = 60.f;
+
+        SimulationThread();
+
+        void start();
+        void stop();
+        bool isRunning();
+
+        // called from the render thread, returns false if the queue is full
+        bool pushEvent(const InputEvent& event);
+
+        // latest published state, returns true if it changed since the last call
+        bool acquireSnapshot();
+        Snapshot& snapshot();
+        // interpolation factor between the two states of the snapshot at the current time
+        float interpolation();
+
+        virtual ~SimulationThread();
+
+    protected:
+
+    private:
+        std::thread thread;
+        std::atomic<bool> running;
+
+        TripleBuffer<Snapshot> snapshots;
+        EventQueue<InputEvent, 256> events;
+
+        uint64_t tick = 0;
+        float stepDuration = 0.f;
+
+        void run();
+        void processEvents(float deltaTime);
+        void publish();
+};
+
+#endif // SIMULATIONTHREAD_H
@@ -0,0 +1,72 @@
+#ifndef SPARSEVOLUME_H
+#define SPARSEVOLUME_H
+
+#include <stddef.h>
+#include <vector>
+
+// Narrow band copy of a grid of density points, split into bricks of 8x8x8 points.
+// Only the bricks near the surface keep their values, the others only keep whether
+// they are solid (above the surface level) or empty. A brick is stored as soon as the
+// points of the brick and the points around it are not all on the same side of the
+// surface, so every point of a cube crossed by the surface has its value stored, and
+// the corners of a cube starting in a uniform brick are all on the side of the brick.
+
+class SparseVolume
+{
+    public:
+        static const int BRICK_SIZE = 8;
+
+        SparseVolume();
+
+        // copies the grid of x * y * z points, whose values are read every stride floats
+        // and indexed by k + z * j + z * y * i like the density buffer
+        void build(const float* values, int stride, int x, int y, int z, float _surfaceLevel);
+
+        // the points of the uniform bricks read just above or just below the surface level
+        float value(int i, int j, int k) const;
+        bool isSolid(int i, int j, int k) const;
+        // the cube whose first corner is the point (i, j, k) has a solid corner
+        bool isSolidCube(int i, int j, int k) const;
+
+        // sets the points of the connected solid regions smaller than minRegionSize points
+        // under the surface level, the indices of the bricks which changed are written to
+        // changedBricks (of getNumBricks() elements) and their number is returned
+        int removeSmallRegions(int minRegionSize, int* changedBricks);
+
+        // first and last points (excluded) of a brick
+        void getBrickBounds(int brick, int begin[3], int end[3]) const;
+
+        void getDims(int _dims[3]) const;
+        bool empty() const;
+        void swap(SparseVolume& other);
+
+        int getNumBricks() const;
+        int getNumStoredBricks() const;
+        // memory used by the bricks, and by the same grid of values stored densely
+        size_t getBytes() const;
+        size_t getDenseBytes() const;
+
+        virtual ~SparseVolume();
+
+    protected:
+
+    private:
+        // states of the uniform bricks, the stored bricks have the index of their values
+        enum
+        {
+            EMPTY = -1,
+            SOLID = -2
+        };
+
+        int dims[3] = {0, 0, 0};
+        int brickDims[3] = {0, 0, 0};
+        float surfaceLevel = 0.f;
+
+        std::vector<int> bricks;
+        std::vector<float> values;
+
+        int brickIndex(int bi, int bj, int bk) const;
+        static int localIndex(int i, int j, int k);
+};
+
+#endif // SPARSEVOLUME_H
@@ -0,0 +1,53 @@
+#ifndef STREAMINGMESHER_H
+#define STREAMINGMESHER_H
+
+#include <NoiseSettings.h>
+#include <DensitySampler.h>
+#include <CpuMarchingCubes.h>
+#include <PackedVertex.h>
+#include <MappedFile.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+// Generates the terrain of a grid too large to be held in memory. The density is
+// evaluated by slabs of slabSlices slices along x, each slab being meshed then written
+// to a mesh file (see MeshFile.h), so that the memory used only depends on the size
+// of a slice. The surfaces at several levels can be extracted from the same density,
+// their indices are written one level after the other, see MeshFileLevel.
+
+class StreamingMesher
+{
+    public:
+        int slabSlices = 8;
+        std::vector<float> surfaceLevels = {0.f};
+
+        long long numVertices = 0;
+        long long numTriangles = 0;
+        std::vector<long long> levelTriangles;
+        float duration = 0.f;       // in ms
+        size_t workingBytes = 0;    // memory used by the slabs and the edges of the mesher
+
+        StreamingMesher();
+
+        bool generate(const std::string& path, const NoiseSettings& noise, int width, int height, int depth, float cubeSize);
+
+        virtual ~StreamingMesher();
+
+    protected:
+
+    private:
+        DensitySampler sampler;
+        CpuMarchingCubes mesher;
+
+        std::vector<float> slab;
+        std::vector<PackedVertex> packed;
+
+        MappedFile output;
+        // the indices of each level until they are appended after the vertices
+        std::deque<MappedFile> indicesFiles;
+
+        bool writeVertices(vec3d boxMin, vec3d boxSize, const int grid[3], float cubeSize);
+};
+
+#endif // STREAMINGMESHER_H
@@ -1,9 +1,11 @@
 #ifndef TABLES_H_INCLUDED
 #define TABLES_H_INCLUDED
 
+#include <stdint.h>
+
 // Edge and triangulation table from : http://paulbourke.net/geometry/polygonise/
 
-static const int edgeTable[256]={
+constexpr int edgeTable[256]={
 0x0  , 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
 0x190, 0x99 , 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
@@ -37,7 +39,7 @@ static const int edgeTable[256]={
 0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
 0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0   };
 
-static const int triTable[256][16] =
+constexpr int triTable[256][16] =
 {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
 {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
 {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
@@ -295,4 +297,56 @@ static const int triTable[256][16] =
 {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
 {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
 
+// Compact tables derived from the ones above at compile time. The CPU mesher reads the
+// edges of the triangles as bytes, the compute shaders read the edges mask and the number
+// of triangles packed in one integer, and the 15 edges of the triangles packed as 4 bits
+// each in two integers, which are 3KB instead of 17KB and fit in shared memory.
+struct CompactTables
+{
+    uint8_t numTriangles[256];
+    uint8_t triangleEdges[256][15];
+
+    // edges mask on the 12 first bits, number of triangles on the next ones
+    uint32_t cases[256];
+    // edge i of the triangles in the bits 4*(i%8) of the integer i/8
+    uint32_t packedEdges[256][2];
+};
+
+constexpr CompactTables buildCompactTables()
+{
+    CompactTables tables = {};
+    for(int c = 0; c < 256; c++){
+        int count = 0;
+        while(count < 5 && triTable[c][count * 3] != -1)
+            count++;
+
+        tables.numTriangles[c] = (uint8_t)count;
+        tables.cases[c] = (uint32_t)edgeTable[c] | ((uint32_t)count << 12);
+
+        for(int i = 0; i < 15; i++){
+            int edge = i < count * 3 ? triTable[c][i] : 0;
+            tables.triangleEdges[c][i] = (uint8_t)edge;
+            tables.packedEdges[c][i / 8] |= (uint32_t)edge << (4 * (i % 8));
+        }
+    }
+    return tables;
+}
+
+// every edge of the triangles of a configuration has a vertex in its edges mask
+constexpr bool validTables(const CompactTables& tables)
+{
+    for(int c = 0; c < 256; c++){
+        for(int i = 0; i < tables.numTriangles[c] * 3; i++){
+            if((edgeTable[c] & (1 << tables.triangleEdges[c][i])) == 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+constexpr CompactTables compactTables = buildCompactTables();
+
+static_assert(validTables(compactTables), "triangle edges outside of the edges mask");
+static_assert(sizeof(compactTables.cases) + sizeof(compactTables.packedEdges) == 3 * 1024, "compute shaders tables layout");
+
 #endif // TABLES_H_INCLUDED
@@ -0,0 +1,107 @@
+#ifndef TERRAINLOD_H
+#define TERRAINLOD_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GL/glfw3.h>
+
+#include <ComputeProcess.h>
+
+#include <NoiseSettings.h>
+#include <DensitySampler.h>
+#include <CpuMarchingCubes.h>
+#include <PackedVertex.h>
+#include <Camera.h>
+#include <vector>
+
+
+// Terrain split into chunks meshed on the CPU, each at a level of detail chosen from
+// its distance to the camera : the cubes of level l are 2^l cubes of the grid wide.
+// The cracks between chunks of different levels are hidden by skirts, strips of
+// triangles hanging from the border of each chunk under the surface.
+
+class TerrainLod : private ComputeProcess
+{
+    public:
+        int chunkSize = 32;         // cubes of the grid on each side of a chunk
+        int numLevels = 4;
+        float lodDistance = 2.f;    // distance below which the chunks use the full resolution, doubled for each level
+        int chunksPerFrame = 4;     // chunks remeshed at most by each update
+
+        float surfaceLevel = 0.f;
+
+        struct {
+            float r = 1.f, g = 1.f, b = 1.f;
+        } color;
+
+        int numChunks = 0;
+        int numVertices = 0;
+        int numTriangles = 0;
+        int numPendingChunks = 0;   // chunks whose level changed and are still waiting to be remeshed
+        float meshingDuration = 0.f; // CPU time of the last generation or update in ms
+
+        TerrainLod();
+
+        void resize(int width, int height, int depth, float _cubeSize);
+
+        // meshes every chunk at the level of its distance to the eye
+        void generate(const NoiseSettings& noise, vec3d eye);
+        // remeshes the chunks whose level changed, the nearest ones first
+        void update(vec3d eye);
+        void draw(const Frustum& frustum);
+
+        void createPrograms();
+        void deletePrograms();
+        void deleteBuffers();
+
+        virtual ~TerrainLod();
+
+    protected:
+
+    private:
+        float cubeSize = 0.1f;
+        int cubeGrid[3] = {0, 0, 0};
+        int chunkGrid[3] = {0, 0, 0};
+
+        GLuint renderProgram = 0;
+        GLint boxMinLocation = -1, boxSizeLocation = -1;
+        bool hasPrograms = false;
+
+        DensitySampler sampler;
+        bool hasGeneration = false;
+
+        struct Chunk
+        {
+            int origin[3];  // first cube of the chunk
+            int cubes[3];   // number of cubes, smaller on the last chunks of the grid
+            int level = -1;
+            int wantedLevel = 0;
+            float distance = 0.f;
+
+            // CPU mesh, kept to reuse its memory
+            CpuMarchingCubes mesher;
+            std::vector<float> axes[3];
+            std::vector<float> values;
+            std::vector<int> skirtVertices;
+            std::vector<PackedVertex> packed;
+
+            Buffer vertices;
+            Buffer indices;
+            bool hasBuffers = false;
+            int numIndices = 0;
+        };
+
+        std::vector<Chunk> chunks;
+        std::vector<int> selected;
+
+        void updateLevels(vec3d eye);
+        void meshChunks();
+        void meshChunk(Chunk& chunk);
+        void addSkirts(Chunk& chunk, int step);
+        void uploadChunk(Chunk& chunk);
+
+        vec3d getBoxMin();
+        vec3d getBoxSize();
+};
+
+#endif // TERRAINLOD_H
@@ -0,0 +1,222 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+// Work stealing scheduler shared by all the CPU stages. Each worker has its
+// own task queue : it takes its tasks from the back, and steals from the
+// front of the other queues when its own is empty. A thread waiting for
+// tasks to complete executes queued tasks meanwhile, so parallel loops and
+// task graphs can be nested.
+
+class ThreadPool
+{
+    public:
+        typedef void (*TaskFunction)(void* data);
+
+        // called after each task with its name, the worker index (-1 for a thread outside
+        // the pool) and its start and end times in ms since the pool started
+        typedef void (*ProfileHook)(const char* name, int worker, double start, double end, void* user);
+
+        // 3D range of indices [begin; end[
+        struct Range3
+        {
+            int begin[3] = {0, 0, 0};
+            int end[3] = {0, 0, 0};
+
+            Range3();
+            Range3(int x, int y, int z);
+            Range3(int x0, int y0, int z0, int x1, int y1, int z1);
+        };
+
+        ThreadPool();
+
+        // numThreads counts the calling thread, 0 uses all the hardware threads
+        void start(int numThreads, bool pinThreads);
+        void stop();
+        int getNumThreads();
+
+        void setProfileHook(ProfileHook hook, void* user);
+
+        // queues a task, the data must stay valid until the task has run
+        void submit(TaskFunction function, void* data, const char* name);
+        // executes queued tasks until the counter reaches 0
+        void wait(std::atomic<int>& counter);
+
+        // calls body(const Range3&) on blocks of at most grain indices covering the range,
+        // returns when all the blocks were processed
+        template<typename F>
+        void parallelFor(const char* name, Range3 range, Range3 grain, F&& body);
+
+        // 1D version, body(int begin, int end)
+        template<typename F>
+        void parallelFor(const char* name, int begin, int end, int grain, F&& body);
+
+        // pool used by the whole program
+        static ThreadPool& global();
+
+        virtual ~ThreadPool();
+
+    protected:
+
+    private:
+        struct Task
+        {
+            TaskFunction function;
+            void* data;
+            const char* name;
+        };
+
+        // double ended queue in a ring buffer, which only allocates when it grows
+        struct TaskQueue
+        {
+            std::vector<Task> tasks;
+            size_t head = 0, tail = 0;
+
+            TaskQueue();
+            bool empty();
+            void pushBack(const Task& task);
+            Task popBack();
+            Task popFront();
+        };
+
+        struct Worker
+        {
+            std::mutex mutex;
+            TaskQueue tasks;
+            std::thread thread;
+        };
+
+        // a parallel loop lives on the stack of its caller, the helper tasks
+        // only hold a pointer to it so that no allocation is needed
+        struct Loop
+        {
+            Range3 range;
+            Range3 grain;
+            int numBlocks[3];
+            int count;
+            std::atomic<int> next;
+            std::atomic<int> pending;
+
+            void* body;
+            void (*invoke)(void* body, const Range3& block);
+        };
+
+        std::vector<Worker*> workers;
+        std::atomic<bool> running;
+        std::atomic<int> queuedTasks;
+        std::atomic<unsigned int> nextQueue;
+
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+
+        ProfileHook profileHook = nullptr;
+        void* profileUser = nullptr;
+        std::chrono::steady_clock::time_point startTime;
+
+        void runWorker(int index);
+        // index of the worker of this pool running on the calling thread, -1 for other threads
+        int workerIndex();
+        bool takeTask(Task& task);
+        void execute(Task& task);
+
+        static void runLoopTask(void* data);
+
+        template<typename F>
+        static void invokeBody(void* body, const Range3& block);
+};
+
+// Graph of tasks run on a pool, each task starts when all its predecessors are done
+
+class TaskGraph
+{
+    public:
+        TaskGraph(ThreadPool& _pool);
+
+        int add(const char* name, std::function<void()> work);
+        // task "before" must complete before task "after" starts
+        void precede(int before, int after);
+
+        // runs all the tasks and returns when they are done, can be run again
+        void run();
+
+        virtual ~TaskGraph();
+
+    protected:
+
+    private:
+        struct Node
+        {
+            TaskGraph* graph;
+            const char* name;
+            std::function<void()> work;
+            std::vector<int> successors;
+            int numPredecessors = 0;
+            std::atomic<int> remaining;
+        };
+
+        ThreadPool& pool;
+        std::deque<Node> nodes;
+        std::atomic<int> pendingNodes;
+
+        static void runNode(void* data);
+};
+
+
+template<typename F>
+void ThreadPool::invokeBody(void* body, const Range3& block)
+{
+    (*(typename std::remove_reference<F>::type*)body)(block);
+}
+
+template<typename F>
+void ThreadPool::parallelFor(const char* name, Range3 range, Range3 grain, F&& body)
+{
+    Loop loop;
+    loop.range = range;
+    loop.grain = grain;
+    loop.count = 1;
+    for(int i = 0; i < 3; i++){
+        int extent = std::max(range.end[i] - range.begin[i], 0);
+        int size = std::max(grain.end[i] - grain.begin[i], 1);
+        loop.numBlocks[i] = (extent + size - 1) / size;
+        loop.count *= loop.numBlocks[i];
+    }
+
+    if(loop.count == 0)
+        return;
+
+    loop.next.store(0, std::memory_order_relaxed);
+    loop.body = (void*)&body;
+    loop.invoke = &invokeBody<F>;
+
+    // one helper per worker at most, the calling thread takes part too
+    int numHelpers = std::min((int)workers.size(), loop.count - 1);
+    loop.pending.store(numHelpers + 1, std::memory_order_relaxed);
+
+    for(int i = 0; i < numHelpers; i++)
+        submit(runLoopTask, &loop, name);
+
+    Task own = {runLoopTask, &loop, name};
+    execute(own);
+
+    // the helpers still reference the loop until they return
+    wait(loop.pending);
+}
+
+template<typename F>
+void ThreadPool::parallelFor(const char* name, int begin, int end, int grain, F&& body)
+{
+    auto block = [&body](const Range3& r){ body(r.begin[0], r.end[0]); };
+    parallelFor(name, Range3(begin, 0, 0, end, 1, 1), Range3(grain, 1, 1), block);
+}
+
+#endif // THREADPOOL_H
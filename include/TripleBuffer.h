@@ -0,0 +1,69 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free handoff of values from one writer thread to one reader thread.
+// The writer fills the back slot and publishes it by swapping it with the
+// middle slot, the reader swaps the middle slot with its front slot when a
+// new value was published. Neither side ever waits for the other, and the
+// reader always sees the latest complete value.
+
+template<typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer() : middle(1)
+        {
+
+        }
+
+        // writer side
+        T& back()
+        {
+            return slots[backIndex];
+        }
+
+        void publish()
+        {
+            backIndex = middle.exchange(backIndex | DIRTY, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // reader side, returns true if a new value was published since the last call
+        bool update()
+        {
+            if((middle.load(std::memory_order_relaxed) & DIRTY) == 0)
+                return false;
+
+            frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        T& front()
+        {
+            return slots[frontIndex];
+        }
+
+        // only when neither thread is using the buffer
+        void reset()
+        {
+            backIndex = 0;
+            middle.store(1, std::memory_order_relaxed);
+            frontIndex = 2;
+        }
+
+    private:
+        static const int INDEX = 3;
+        static const int DIRTY = 4;
+
+        T slots[3];
+
+        // slot index in the low bits, dirty flag set when the middle slot was published
+        std::atomic<int> middle;
+
+        // only accessed by their own thread
+        int backIndex = 0;
+        int frontIndex = 2;
+};
+
+#endif // TRIPLEBUFFER_H
@@ -5,8 +5,15 @@
 #include <stdlib.h>
 #include <iostream>
 #include <time.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#endif
 
 #include <Program.h>
+#include <StreamingMesher.h>
+#include <BatchGenerator.h>
 
 
 // GLFW event callbacks
@@ -16,6 +23,14 @@ static void onMouseButton(GLFWwindow *window, int button, int action, int mods);
 static void onScrollRoll(GLFWwindow *window, double xoff, double yoff);
 static void GLAPIENTRY MessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 
+static int runHeadless(ConfigParser& config);
+static int runStreaming(ConfigParser& config);
+static int runBatch(ConfigParser& config);
+static void readStreamLevels(ConfigParser& config, std::vector<float>& levels);
+static void readOffsets(ConfigParser& config, NoiseSettings& noise);
+static bool createHeadlessContext(int width, int height);
+static bool hasRequiredExtensions();
+
 /* Program entry point */
 
 int main(int argc, char *argv[])
@@ -23,8 +38,40 @@ int main(int argc, char *argv[])
     srand(time(0));
 
     ConfigParser config("config.txt");
+
+    // command line arguments : --headless, --stream, --batch, and "name=value" settings overriding the configuration file
+    bool headless = false;
+    bool streaming = false;
+    bool batch = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if(strcmp(argv[i], "--stream") == 0)
+            streaming = true;
+        else if(strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if(strchr(argv[i], '=') != NULL)
+            config.override(argv[i]);
+    }
+
+    // fixed seed for reproducible runs (boids and terrain when randomizeOnGeneration is false)
+    if(config.exist("randomSeed"))
+        srand(config.getInt("randomSeed"));
+
+    if(config.exist("headless") && config.getBool("headless"))
+        headless = true;
+
     //config.printData();
 
+    // the streamed and batched generations run on the CPU only
+    if(streaming)
+        return runStreaming(config);
+    if(batch)
+        return runBatch(config);
+
+    if(headless)
+        return runHeadless(config);
+
     if(!glfwInit()){
         glfwTerminate();
         return 0;
@@ -50,6 +97,11 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if(!hasRequiredExtensions()){
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
     // enable/disable debug output
     if(0){
         glEnable(GL_DEBUG_OUTPUT);
@@ -72,6 +124,226 @@ int main(int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
+static int runHeadless(ConfigParser& config)
+{
+    int width = config.exist("headlessWidth") ? config.getInt("headlessWidth") : 600;
+    int height = config.exist("headlessHeight") ? config.getInt("headlessHeight") : 400;
+
+    if(!createHeadlessContext(width, height)){
+        printf("Could not create an offscreen OpenGL context\n");
+        return EXIT_FAILURE;
+    }
+
+    glewExperimental = GL_TRUE;
+    if(glewInit() != GLEW_OK)
+        return EXIT_FAILURE;
+
+    printf("Headless run on %s\n", (const char*)glGetString(GL_RENDERER));
+
+    if(!hasRequiredExtensions())
+        return EXIT_FAILURE;
+
+    bool success;
+    {
+        Program current(NULL, config);
+        current.setup();
+        success = current.runHeadless();
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runStreaming(ConfigParser& config)
+{
+    NoiseSettings noise;
+    Program::configureNoise(config, noise);
+    readOffsets(config, noise);
+
+    int numThreads = config.exist("numThreads") ? config.getInt("numThreads") : 0;
+    ThreadPool::global().start(numThreads, false);
+
+    StreamingMesher mesher;
+    readStreamLevels(config, mesher.surfaceLevels);
+    if(config.exist("slabSlices"))
+        mesher.slabSlices = std::max(config.getInt("slabSlices"), 1);
+
+    std::string output = config.exist("streamOutput") ? config.getString("streamOutput") : "terrain.mesh";
+
+    int numCubesX = config.getInt("numCubesX");
+    int numCubesY = config.getInt("numCubesY");
+    int numCubesZ = config.getInt("numCubesZ");
+    printf("Streaming a %dx%dx%d terrain to %s...\n", numCubesX, numCubesY, numCubesZ, output.c_str());
+
+    bool success = mesher.generate(output, noise, numCubesX, numCubesY, numCubesZ, config.getFloat("cubeSize"));
+    ThreadPool::global().stop();
+
+    if(!success)
+        return EXIT_FAILURE;
+
+    printf("Generated streamed mesh: seed: %d - vertices: %lld, triangles: %lld - %fms - working memory: %.1fMB\n",
+    noise.offsetSeed,
+    mesher.numVertices, mesher.numTriangles,
+    mesher.duration,
+    (float)mesher.workingBytes/(float)(1024*1024));
+
+    if(mesher.surfaceLevels.size() > 1){
+        for(size_t l = 0; l < mesher.surfaceLevels.size(); l++)
+            printf("Level %g: triangles: %lld\n", mesher.surfaceLevels[l], mesher.levelTriangles[l]);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int runBatch(ConfigParser& config)
+{
+    NoiseSettings noise;
+    Program::configureNoise(config, noise);
+
+    // consecutive seeds from the first one, seeding resets the offsets to those of the configuration
+    int count = config.exist("batchCount") ? config.getInt("batchCount") : 16;
+    int firstSeed = config.exist("batchFirstSeed") ? config.getInt("batchFirstSeed") : noise.offsetSeed;
+    std::vector<NoiseSettings> terrains(std::max(count, 0), noise);
+    for(int i = 0; i < (int)terrains.size(); i++){
+        terrains[i].seed(firstSeed + i);
+        readOffsets(config, terrains[i]);
+    }
+
+    int numThreads = config.exist("numThreads") ? config.getInt("numThreads") : 0;
+    ThreadPool::global().start(numThreads, false);
+
+    BatchGenerator generator;
+    readStreamLevels(config, generator.surfaceLevels);
+    if(config.exist("slabSlices"))
+        generator.slabSlices = std::max(config.getInt("slabSlices"), 1);
+    if(config.exist("batchSlots"))
+        generator.numSlots = std::max(config.getInt("batchSlots"), 1);
+
+    std::string directory = config.exist("batchDirectory") ? config.getString("batchDirectory") : "terrains";
+
+    int numCubesX = config.getInt("numCubesX");
+    int numCubesY = config.getInt("numCubesY");
+    int numCubesZ = config.getInt("numCubesZ");
+    printf("Generating %d %dx%dx%d terrains to %s with %d slots...\n", count, numCubesX, numCubesY, numCubesZ, directory.c_str(), generator.numSlots);
+
+    if(!generator.start(terrains, directory, numCubesX, numCubesY, numCubesZ, config.getFloat("cubeSize"))){
+        ThreadPool::global().stop();
+        return EXIT_FAILURE;
+    }
+
+    int numFailed = 0;
+    BatchGenerator::Result result;
+    while(generator.next(result)){
+        if(!result.success)
+            numFailed++;
+        printf("Terrain %d: seed: %d - vertices: %lld, triangles: %lld - %fms%s\n",
+        result.index, result.seed, result.numVertices, result.numTriangles, result.duration,
+        result.success ? "" : " - failed");
+    }
+
+    ThreadPool::global().stop();
+
+    printf("Generated %d terrains in %.1fs - %.1f terrains per minute\n",
+    count - numFailed, generator.duration / 1000.f, generator.terrainsPerMinute);
+
+    return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void readStreamLevels(ConfigParser& config, std::vector<float>& levels)
+{
+    levels.assign(1, config.getFloat("surfaceLevel"));
+
+    // several surfaces extracted in the same pass, as a list of levels separated by commas
+    if(config.exist("streamLevels")){
+        std::string list = config.getString("streamLevels");
+        levels.clear();
+        for(size_t start = 0; start < list.size();){
+            size_t end = std::min(list.find(',', start), list.size());
+            levels.push_back(std::stof(list.substr(start, end - start)));
+            start = end + 1;
+        }
+    }
+}
+
+static void readOffsets(ConfigParser& config, NoiseSettings& noise)
+{
+    // the offsets are 0 unless given, see NoiseSettings::seed
+    if(config.exist("offsetX"))
+        noise.offset.x = config.getFloat("offsetX");
+    if(config.exist("offsetY"))
+        noise.offset.y = config.getFloat("offsetY");
+    if(config.exist("offsetZ"))
+        noise.offset.z = config.getFloat("offsetZ");
+}
+
+static bool createHeadlessContext(int width, int height)
+{
+#ifdef __linux__
+    // EGL pbuffer context, for GPU drivers on machines without display
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        return false;
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig eglConfig;
+    EGLint numConfigs = 0;
+    if(!eglChooseConfig(display, configAttribs, &eglConfig, 1, &numConfigs) || numConfigs == 0)
+        return false;
+
+    const EGLint pbufferAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, eglConfig, pbufferAttribs);
+    if(surface == EGL_NO_SURFACE)
+        return false;
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    // compatibility profile for the fixed function rendering
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, eglConfig, EGL_NO_CONTEXT, contextAttribs);
+    if(context == EGL_NO_CONTEXT)
+        return false;
+
+    return eglMakeCurrent(display, surface, surface, context);
+#else
+    // fall back on a hidden window where EGL is not available
+    if(!glfwInit())
+        return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(width, height, "Boids & Marching Cubes", NULL, NULL);
+    if(window == NULL)
+        return false;
+
+    glfwMakeContextCurrent(window);
+    return true;
+#endif
+}
+
+static bool hasRequiredExtensions()
+{
+    // the compute shaders get their local size at dispatch time, which
+    // Mesa's software rasterizer (llvmpipe) does not support
+    if(!GLEW_ARB_compute_variable_group_size){
+        printf("The OpenGL driver (%s) does not support GL_ARB_compute_variable_group_size, needed by the compute shaders\n",
+               (const char*)glGetString(GL_RENDERER));
+        return false;
+    }
+
+    return true;
+}
+
 static Program& getCurrent(GLFWwindow *window)
 {
     return *(Program*)glfwGetWindowUserPointer(window);
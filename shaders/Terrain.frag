@@ -0,0 +1,27 @@
+#version 460 compatibility
+
+// same lighting as the fixed function pipeline with GL_COLOR_MATERIAL :
+// the color is the ambient and diffuse material, with the directional light 0
+
+in vec3 viewPosition;
+in vec3 viewNormal;
+in vec4 color;
+
+out vec4 fragColor;
+
+
+void main(){
+    vec3 n = normalize(viewNormal);
+    vec3 l = normalize(gl_LightSource[0].position.xyz);
+    vec3 h = normalize(l - normalize(viewPosition));
+
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = diffuse > 0.0 ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;
+
+    vec4 lit = gl_LightModel.ambient * color
+             + gl_LightSource[0].ambient * color
+             + gl_LightSource[0].diffuse * color * diffuse
+             + gl_LightSource[0].specular * gl_FrontMaterial.specular * specular;
+
+    fragColor = vec4(lit.rgb, color.a);
+}
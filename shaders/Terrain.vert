@@ -0,0 +1,34 @@
+#version 460 compatibility
+
+// decodes the packed terrain vertices, see PackedVertex.h
+
+layout (location = 0) in uvec2 packedVertex;
+
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+
+out vec3 viewPosition;
+out vec3 viewNormal;
+out vec4 color;
+
+
+vec3 decodeOctahedral(vec2 e){
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main(){
+    vec3 quantized = vec3(packedVertex.x & 0xFFFFu, packedVertex.x >> 16, packedVertex.y & 0xFFFFu);
+    vec3 position = boxMin + quantized / 65535.0 * boxSize;
+
+    vec2 octahedral = vec2((packedVertex.y >> 16) & 0xFFu, packedVertex.y >> 24) / 255.0;
+    vec3 normal = decodeOctahedral(octahedral);
+
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 1.0);
+    viewPosition = (gl_ModelViewMatrix * vec4(position, 1.0)).xyz;
+    viewNormal = gl_NormalMatrix * normal;
+    color = gl_Color;
+}
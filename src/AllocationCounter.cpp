@@ -0,0 +1,122 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+
+size_t AllocationCounter::count()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::bytes()
+{
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::record(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void* countedAllocation(size_t size)
+{
+    AllocationCounter::record(size);
+    return malloc(size == 0 ? 1 : size);
+}
+
+static void* countedAlignedAllocation(size_t size, size_t alignment)
+{
+    AllocationCounter::record(size);
+    // aligned_alloc needs a size multiple of the alignment
+    size = (size + alignment - 1) / alignment * alignment;
+    return aligned_alloc(alignment, size == 0 ? alignment : size);
+}
+
+
+void* operator new(size_t size)
+{
+    void* p = countedAllocation(size);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void* p = countedAllocation(size);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocation(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocation(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* p = countedAlignedAllocation(size, (size_t)alignment);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    void* p = countedAlignedAllocation(size, (size_t)alignment);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
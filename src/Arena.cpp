@@ -0,0 +1,97 @@
+#include "Arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <AllocationCounter.h>
+
+#define ARENA_MIN_BLOCK_SIZE (64 * 1024)
+
+
+Arena::Arena()
+{
+    // a few blocks can be created before the first reset merges them
+    blocks.reserve(32);
+}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+    if(!blocks.empty()){
+        Block& block = blocks.back();
+        uintptr_t address = (uintptr_t)(block.data + block.used);
+        size_t padding = (alignment - address % alignment) % alignment;
+
+        if(block.used + padding + size <= block.capacity){
+            block.used += padding + size;
+            return (void*)(address + padding);
+        }
+    }
+
+    // blocks grow geometrically
+    size_t lastCapacity = blocks.empty() ? 0 : blocks.back().capacity;
+    createBlock(std::max(std::max(size + alignment, lastCapacity * 2), (size_t)ARENA_MIN_BLOCK_SIZE));
+
+    return allocate(size, alignment);
+}
+
+void Arena::createBlock(size_t capacity)
+{
+    Block block;
+    block.data = (char*)malloc(capacity);
+    AllocationCounter::record(capacity);
+    block.capacity = capacity;
+    block.used = 0;
+    blocks.push_back(block);
+}
+
+void Arena::reset()
+{
+    if(blocks.size() > 1){
+        // the next frame or generation fits in a single block
+        size_t total = getCapacity();
+        release();
+        createBlock(total);
+    } else if(!blocks.empty()) {
+        blocks[0].used = 0;
+    }
+}
+
+void Arena::release()
+{
+    for(Block& block : blocks)
+        free(block.data);
+    blocks.clear();
+}
+
+size_t Arena::getUsedBytes()
+{
+    size_t used = 0;
+    for(Block& block : blocks)
+        used += block.used;
+    return used;
+}
+
+size_t Arena::getCapacity()
+{
+    size_t capacity = 0;
+    for(Block& block : blocks)
+        capacity += block.capacity;
+    return capacity;
+}
+
+Arena& Arena::frame()
+{
+    static Arena arena;
+    return arena;
+}
+
+Arena& Arena::generation()
+{
+    static Arena arena;
+    return arena;
+}
+
+Arena::~Arena()
+{
+    release();
+}
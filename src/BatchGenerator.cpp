@@ -0,0 +1,112 @@
+#include "BatchGenerator.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <filesystem>
+
+
+BatchGenerator::BatchGenerator() : nextTerrain(0)
+{
+
+}
+
+bool BatchGenerator::start(const std::vector<NoiseSettings>& _terrains, const std::string& _directory,
+                           int width, int height, int depth, float _cubeSize)
+{
+    join();
+
+    std::error_code error;
+    std::filesystem::create_directories(_directory, error);
+    if(error){
+        printf("Could not create the directory %s\n", _directory.c_str());
+        return false;
+    }
+
+    terrains = _terrains;
+    directory = _directory;
+    grid[0] = width;
+    grid[1] = height;
+    grid[2] = depth;
+    cubeSize = _cubeSize;
+
+    nextTerrain.store(0);
+    finished.clear();
+    numHarvested = 0;
+    duration = 0.f;
+    terrainsPerMinute = 0.f;
+
+    // no more slots than terrains, the meshers of the previous batches are kept
+    int slots = std::max(std::min(numSlots, (int)terrains.size()), 1);
+    if((int)meshers.size() < slots)
+        meshers.resize(slots);
+
+    startTime = std::chrono::steady_clock::now();
+    for(int i = 0; i < slots; i++)
+        threads.push_back(std::thread(&BatchGenerator::runSlot, this, i));
+
+    return true;
+}
+
+void BatchGenerator::runSlot(int slot)
+{
+    StreamingMesher& mesher = meshers[slot];
+    mesher.slabSlices = slabSlices;
+    mesher.surfaceLevels = surfaceLevels;
+
+    while(true){
+        int index = nextTerrain.fetch_add(1);
+        if(index >= (int)terrains.size())
+            break;
+
+        Result result;
+        result.index = index;
+        result.seed = terrains[index].offsetSeed;
+        result.path = directory + "/terrain" + std::to_string(index) + "_" + std::to_string(result.seed) + ".mesh";
+        result.success = mesher.generate(result.path, terrains[index], grid[0], grid[1], grid[2], cubeSize);
+        result.numVertices = mesher.numVertices;
+        result.numTriangles = mesher.numTriangles;
+        result.duration = mesher.duration;
+
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push_back(result);
+        }
+        finishedCondition.notify_one();
+    }
+}
+
+bool BatchGenerator::next(Result& result)
+{
+    {
+        std::unique_lock<std::mutex> lock(finishedMutex);
+        if(numHarvested < (int)terrains.size()){
+            finishedCondition.wait(lock, [this]{ return !finished.empty(); });
+            result = finished.front();
+            finished.pop_front();
+            numHarvested++;
+            return true;
+        }
+    }
+
+    if(!threads.empty()){
+        join();
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        duration = elapsed.count();
+        terrainsPerMinute = duration > 0.f ? (float)terrains.size() * 60000.f / duration : 0.f;
+    }
+
+    return false;
+}
+
+void BatchGenerator::join()
+{
+    for(std::thread& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+BatchGenerator::~BatchGenerator()
+{
+    join();
+}
@@ -0,0 +1,287 @@
+#include "BoidSimulation.h"
+
+#include <math.h>
+#include <algorithm>
+#include <ThreadPool.h>
+
+#define PI  3.14159215
+#define PHI 1.61803398
+
+
+BoidSimulation::BoidSimulation()
+{
+
+}
+
+void BoidSimulation::setup(int _numBoids, int _numRays)
+{
+    if(_numBoids != numBoids){
+        numBoids = _numBoids;
+        boids.resize(numBoids);
+        previousBoids.resize(numBoids);
+    }
+
+    if(_numRays != numRays){
+        numRays = _numRays;
+        calculateRayDirs();
+    }
+}
+
+void BoidSimulation::setObstacles(SparseVolume& volume, float _cubeSize)
+{
+    obstacles.swap(volume);
+    // the grid of cubes has one point less than the density on each axis
+    obstacles.getDims(gridDims);
+    for(int i = 0; i < 3; i++)
+        gridDims[i]--;
+    cubeSize = _cubeSize;
+}
+
+int BoidSimulation::getNumBoids()
+{
+    return numBoids;
+}
+
+void BoidSimulation::generateBoids(unsigned int seed)
+{
+    // same start as the GPU boids : at the center with a random velocity
+    ThreadPool::global().parallelFor("boids.generate", 0, numBoids, 4096, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            float phi = hashRandom(seed, 2*i) * PI * 2.f;
+            float theta = acos(hashRandom(seed, 2*i+1) * 2.f - 1.f);
+            vec3d dir(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+
+            boids[i].pos = vec3d();
+            boids[i].vel = dir * maxSpeed;
+        }
+    });
+
+    previousBoids = boids;
+}
+
+void BoidSimulation::calculateRayDirs()
+{
+    // evenly distributed points on a sphere, the first one is (0, 0, 1)
+    rayDirs.resize(numRays);
+    float count = (float)std::max(numRays - 1, 1);
+    ThreadPool::global().parallelFor("rayDirs", 0, numRays, 1024, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            float t = (float)i / count;
+            float inclination = acos(1.f - 2.f * t);
+            float azimuth = 2.f * PI * PHI * (float)i;
+
+            rayDirs[i] = vec3d(sin(inclination) * cos(azimuth), sin(inclination) * sin(azimuth), cos(inclination));
+        }
+    });
+}
+
+bool BoidSimulation::insideBox(vec3d p)
+{
+    return p.x >= -box.x/2.f && p.x < box.x/2.f
+        && p.y >= -box.y/2.f && p.y < box.y/2.f
+        && p.z >= -box.z/2.f && p.z < box.z/2.f;
+}
+
+bool BoidSimulation::isSolid(vec3d p)
+{
+    int x = (int)floorf((p.x + box.x/2.f) / cubeSize);
+    int y = (int)floorf((p.y + box.y/2.f) / cubeSize);
+    int z = (int)floorf((p.z + box.z/2.f) / cubeSize);
+
+    if(x < 0 || y < 0 || z < 0 || x >= gridDims[0] || y >= gridDims[1] || z >= gridDims[2])
+        return false;
+
+    return obstacles.isSolidCube(x, y, z);
+}
+
+bool BoidSimulation::intersectMesh(vec3d pos, vec3d dir)
+{
+    float stepSize = cubeSize / 2.f;
+    int maxSteps = (int)(predictionLength / stepSize);
+
+    vec3d p = pos;
+    for(int i = 0; i < maxSteps; i++){
+        p += dir * stepSize;
+
+        if(!insideBox(p))
+            break;
+
+        if(isSolid(p))
+            return true;
+    }
+
+    return false;
+}
+
+vec3d BoidSimulation::findUnobstructedDir(vec3d pos, vec3d forward, bool& isHeadingCollision)
+{
+    bool meshCheck = avoidMesh && !obstacles.empty();
+
+    isHeadingCollision = !insideBox(pos + forward * predictionLength);
+    if(meshCheck)
+        isHeadingCollision = isHeadingCollision || intersectMesh(pos, forward);
+
+    if(!isHeadingCollision)
+        return vec3d();
+
+    // directions close to the boid's orientation are checked first
+    float matrix[3][3];
+    transformDirection(forward, vec3d(0, 0, 1), matrix);
+
+    for(int i = 0; i < numRays; i++){
+        vec3d dir = transform(matrix, rayDirs[i]);
+        bool hit = !insideBox(pos + dir * predictionLength);
+        if(!hit && meshCheck)
+            hit = intersectMesh(pos, dir);
+
+        if(!hit)
+            return dir;
+    }
+
+    return forward;
+}
+
+vec3d BoidSimulation::steeringForce(vec3d vel, vec3d desired)
+{
+    float len = desired.length();
+    if(len == 0.f || !std::isfinite(len))
+        return vec3d();
+
+    vec3d force = desired * (maxSpeed / len) - vel;
+    float mag = force.length();
+    if(mag == 0.f || !std::isfinite(mag))
+        return vec3d();
+
+    return force * (std::min(mag, maxForce) / mag);
+}
+
+void BoidSimulation::step(float deltaTime)
+{
+    // the new state is written over the older one
+    boids.swap(previousBoids);
+
+    ThreadPool::global().parallelFor("boids.step", 0, numBoids, 64, [&](int begin, int end){
+        for(int id = begin; id < end; id++)
+            stepBoid(id, deltaTime);
+    });
+}
+
+void BoidSimulation::stepBoid(int id, float deltaTime)
+{
+    vec3d pos = previousBoids[id].pos;
+    vec3d vel = previousBoids[id].vel;
+    vec3d dir = vel / vel.length();
+
+    bool isHeadingCollision;
+    vec3d unobstructedDir = findUnobstructedDir(pos, dir, isHeadingCollision);
+
+    // reset the boids that got out of the box
+    if(!insideBox(pos))
+        pos = vec3d();
+
+    float numFlockMates = 0.f;
+    vec3d flockHeading;
+    vec3d flockCenter;
+    vec3d separationHeading;
+
+    for(int i = 0; i < numBoids; i++){
+        if(i == id)
+            continue;
+
+        vec3d offset = previousBoids[i].pos - pos;
+        float dst = offset.length();
+
+        if(dst < viewRadius && dst > 0.f){
+            if(vec3d::angleBetween(vel, offset) < viewAngle){
+                numFlockMates += 1.f;
+                flockHeading += previousBoids[i].vel;
+                flockCenter += previousBoids[i].pos;
+            }
+
+            if(dst < avoidRadius)
+                separationHeading -= offset / dst;
+        }
+    }
+
+    vec3d acc;
+
+    if(numFlockMates > 0.f){
+        flockCenter /= numFlockMates;
+        vec3d offsetToFlockCenter = flockCenter - pos;
+
+        acc += steeringForce(vel, flockHeading) * alignmentCoef;
+        acc += steeringForce(vel, offsetToFlockCenter) * cohesionCoef;
+        acc += steeringForce(vel, separationHeading) * separationCoef;
+    }
+
+    if(isHeadingCollision)
+        acc += steeringForce(vel, unobstructedDir) * obstacleCoef;
+
+    vel += acc * deltaTime;
+    float speed = vel.length();
+    dir = vel / speed;
+    speed = std::min(std::max(speed, minSpeed), maxSpeed);
+    vel = dir * speed;
+    pos += vel * deltaTime;
+
+    boids[id].pos = pos;
+    boids[id].vel = vel;
+}
+
+void BoidSimulation::orientation(vec3d dir, float matrix[3][3])
+{
+    transformDirection(dir, vec3d(0, 1, 0), matrix);
+}
+
+void BoidSimulation::transformDirection(vec3d dir, vec3d ref, float matrix[3][3])
+{
+    // rotation of ref onto dir (dir and ref are normalized)
+    vec3d axis = vec3d::cross(ref, dir);
+    float len = axis.length();
+    float cosAngle = std::min(std::max(vec3d::dot(dir, ref), -1.f), 1.f);
+
+    if(len < 1e-6f){
+        // parallel directions : identity, or half turn around an axis orthogonal to ref
+        vec3d ortho = fabs(ref.x) < 0.9f ? vec3d(1, 0, 0) : vec3d(0, 1, 0);
+        axis = vec3d::cross(ref, ortho);
+        axis.normalize();
+        rotation(axis, cosAngle > 0.f ? 0.f : PI, matrix);
+        return;
+    }
+
+    rotation(axis / len, acos(cosAngle), matrix);
+}
+
+void BoidSimulation::rotation(vec3d u, float a, float matrix[3][3])
+{
+    float c = cos(a);
+    float s = sin(a);
+    float t = 1.f - c;
+
+    matrix[0][0] = c+u.x*u.x*t;     matrix[0][1] = u.x*u.y*t-u.z*s; matrix[0][2] = u.x*u.z*t+u.y*s;
+    matrix[1][0] = u.y*u.x*t+u.z*s; matrix[1][1] = c+u.y*u.y*t;     matrix[1][2] = u.y*u.z*t-u.x*s;
+    matrix[2][0] = u.z*u.x*t-u.y*s; matrix[2][1] = u.z*u.y*t+u.x*s; matrix[2][2] = c+u.z*u.z*t;
+}
+
+float BoidSimulation::hashRandom(uint32_t seed, uint32_t index)
+{
+    uint32_t h = seed ^ (index * 0x9E3779B9u);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return (float)(h >> 8) / 16777216.f;
+}
+
+vec3d BoidSimulation::transform(float matrix[3][3], vec3d v)
+{
+    return vec3d(matrix[0][0]*v.x + matrix[0][1]*v.y + matrix[0][2]*v.z,
+                 matrix[1][0]*v.x + matrix[1][1]*v.y + matrix[1][2]*v.z,
+                 matrix[2][0]*v.x + matrix[2][1]*v.y + matrix[2][2]*v.z);
+}
+
+BoidSimulation::~BoidSimulation()
+{
+
+}
@@ -1,11 +1,15 @@
 #include "Boids.h"
 
 #include <math.h>
+#include <ThreadPool.h>
+#include <Arena.h>
 
 #define BOIDS_SSB_BP    0
 #define RAYS_SSB_BP     1
 #define CUBES_SSB_BP    2
 
+#define PARAMETERS_UB_BP    0
+
 #define PI  3.14159215
 #define PHI 1.61803398
 
@@ -54,68 +58,163 @@ void Boids::setup()
 
     numBoidsChanged = false;
     numRayDirsChanged = false;
+
+    uploadParameters();
 }
 
-void Boids::generateBoids()
+void Boids::uploadParameters()
 {
-    // generates a numBoids boids center at 0 with a random velocity
-    Boid *boids = new Boid[numBoids * 2];
-    for(int i = 0; i < numBoids; i++){
-        boids[i] = Boid(vec3d(), vec3d::unitRandom() * maxSpeed);
-        boids[numBoids + i] = boids[i];
+    // the simulation parameters only change on configuration, so they are
+    // written once into the uniform buffer instead of being set on each update
+
+    Parameters params;
+
+    params.boundingBox[0] = box.x;
+    params.boundingBox[1] = box.y;
+    params.boundingBox[2] = box.z;
+    params.predictionLength = predictionLength;
+    params.cubeGridDims[0] = cubeGrid.x;
+    params.cubeGridDims[1] = cubeGrid.y;
+    params.cubeGridDims[2] = cubeGrid.z;
+    params.numBoids = numBoids;
+    params.minSpeed = minSpeed;
+    params.maxSpeed = maxSpeed;
+    params.maxForce = maxForce;
+    params.viewRadius = viewRadius;
+    params.viewAngle = viewAngle;
+    params.avoidRadius = avoidRadius;
+    params.cubeSize = cubeSize;
+    params.cohesionCoef = cohesionCoef;
+    params.alignmentCoef = alignmentCoef;
+    params.separationCoef = separationCoef;
+    params.obstacleCoef = obstacleCoef;
+    params.avoidMesh = avoidMesh;
+
+    for(int i = 0; i < 6*4; i++){
+        params.boidModelTriangles[i][0] = boidModelTriangles[i].x;
+        params.boidModelTriangles[i][1] = boidModelTriangles[i].y;
+        params.boidModelTriangles[i][2] = boidModelTriangles[i].z;
+        params.boidModelTriangles[i][3] = 0.f;
     }
-    boidsData.setSubData(0, boidsData.size, boids);
-    delete[] boids;
 
-    // create the color for each boid
-    if(!colorsArrayExist){
-        colorsArrayExist = true;
-    } else {
+    parameters.streamSubData(0, sizeof(Parameters), &params);
+}
+
+void Boids::generateBoids()
+{
+    // generates a numBoids boids center at 0 with a random velocity, the boids and
+    // their colors are generated in parallel from a single seed
+    generationSeed = rand();
+
+    // the generation scratch memory of the previous boids and mesh is no longer used
+    Arena::generation().reset();
+
+    // the initial state is only staged before the upload
+    generatedBoids = Arena::generation().constructArray<Boid>(numBoids * 2);
+
+    // the colors are kept until the number of boids changes
+    if(numColors != numBoids){
         delete[] colors;
+        colors = new Color[numBoids];
+        numColors = numBoids;
     }
-    colors = new Color[numBoids];
-    for(int i = 0; i < numBoids; i++){
-        // add some randomness in boids colors
-        float roff = ((float)rand()/(float)RAND_MAX - 0.5f) * colorDeviation;
-        float goff = ((float)rand()/(float)RAND_MAX - 0.5f) * colorDeviation;
-        float boff = ((float)rand()/(float)RAND_MAX - 0.5f) * colorDeviation;
-        colors[i].r = mainColor.r + roff;
-        colors[i].g = mainColor.g + goff;
-        colors[i].b = mainColor.b + boff;
+
+    // built once, its tasks only capture this so running it doesn't allocate
+    if(!hasGenerationGraph){
+        generationGraph.add("boids.generate", [this](){ generateBoidStates(); });
+        generationGraph.add("boids.colors", [this](){ generateBoidColors(); });
+        hasGenerationGraph = true;
     }
+
+    generationGraph.run();
+
+    boidsData.streamSubData(0, boidsData.size, generatedBoids);
+    generatedBoids = nullptr;
+
+    // the previous readbacks refer to the old boids
+    hasReadback = false;
+    hasPendingReadback = false;
+}
+
+void Boids::generateBoidStates()
+{
+    uint32_t seed = generationSeed;
+    ThreadPool::global().parallelFor("boids.generate", 0, numBoids, 4096, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            float phi = BoidSimulation::hashRandom(seed, 2*i) * PI * 2.f;
+            float theta = acos(BoidSimulation::hashRandom(seed, 2*i+1) * 2.f - 1.f);
+            vec3d dir(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+
+            generatedBoids[i] = Boid(vec3d(), dir * maxSpeed);
+            generatedBoids[numBoids + i] = generatedBoids[i];
+        }
+    });
 }
 
-void Boids::update(float deltaTime)
+void Boids::generateBoidColors()
 {
+    uint32_t colorSeed = generationSeed ^ 0x5BD1E995u;
+    ThreadPool::global().parallelFor("boids.colors", 0, numBoids, 4096, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            // add some randomness in boids colors
+            float roff = (BoidSimulation::hashRandom(colorSeed, 3*i) - 0.5f) * colorDeviation;
+            float goff = (BoidSimulation::hashRandom(colorSeed, 3*i+1) - 0.5f) * colorDeviation;
+            float boff = (BoidSimulation::hashRandom(colorSeed, 3*i+2) - 0.5f) * colorDeviation;
+            colors[i].r = mainColor.r + roff;
+            colors[i].g = mainColor.g + goff;
+            colors[i].b = mainColor.b + boff;
+        }
+    });
+}
+
+void Boids::update(float deltaTime, int numSubsteps)
+{
+    if(numSubsteps <= 0)
+        return;
+
     boidsData.setBindingPoint(BOIDS_SSB_BP);
     rayDirs.setBindingPoint(RAYS_SSB_BP);
     cubes->setBindingPoint(CUBES_SSB_BP);
+    parameters.setBindingPoint(PARAMETERS_UB_BP);
+
+    // only measured when the previous measure was read
+    if(beginStageTimings())
+        measuredSubsteps = numSubsteps;
 
     useProgram(boidProgram);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "deltaTime"), deltaTime);
-    glUniform3f(glGetUniformLocation(currentProgram.id, "boundingBox"), box.x, box.y, box.z);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "predictionLength"), predictionLength);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "minSpeed"), minSpeed);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "maxSpeed"), maxSpeed);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "maxForce"), maxForce);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "viewAngle"), viewAngle);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "viewRadius"), viewRadius);
-    glUniform1i(glGetUniformLocation(currentProgram.id, "avoidMesh"), avoidMesh);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "cubeSize"), cubeSize);
-    glUniform3i(glGetUniformLocation(currentProgram.id, "cubeGridDims"), cubeGrid.x, cubeGrid.y, cubeGrid.z);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "avoidRadius"), avoidRadius);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "cohesionCoef"), cohesionCoef);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "alignmentCoef"), alignmentCoef);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "separationCoef"), separationCoef);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "obstacleCoef"), obstacleCoef);
-    glUniform3fv(glGetUniformLocation(currentProgram.id, "boidModelTriangles"), 6*4, (float*)boidModelTriangles);
-    glUniform1i(glGetUniformLocation(currentProgram.id, "numBoids"), numBoids);
-    runComputeShader();
+    glUniform1f(deltaTimeLocation, deltaTime);
+
+    size_t stateSize = numBoids * sizeof(Boid);
+
+    // the substeps are dispatched back to back without reading anything back:
+    // the updated boids of each step become the current state on the GPU side
+    for(int i = 0; i < numSubsteps; i++){
+        boidsData.copySubData(boidsData, stateSize, 0, stateSize);
+        runComputeShader();
+    }
+
+    markStage("update");
+    endStageTimings();
 
     glUseProgram(0);
+
+    // the buffer now holds the state before and after the last substep,
+    // both are requested for the interpolation
+    pendingReadback = boidsData.requestSubData(boidsReadback, 0, stateSize * 2);
+    hasPendingReadback = true;
+}
+
+bool Boids::pollStatistics()
+{
+    if(!pollStageTimings(stageDurations))
+        return false;
+
+    updateDuration = stageDurations[0].second;
+    substepDuration = updateDuration / (float)measuredSubsteps;
+    return true;
 }
 
-void Boids::draw()
+void Boids::draw(float alpha)
 {
     if(applyLighting){
         glEnable(GL_LIGHTING);
@@ -125,25 +224,114 @@ void Boids::draw()
         glDisable(GL_COLOR_MATERIAL);
     }
 
-    Boid *boids = (Boid*)boidsData.map(GL_READ_WRITE);
+    // the readback of the last update is drawn on the next frame so that it
+    // doesn't wait for the GPU, unless nothing was read back yet
+    if(!hasReadback){
+        if(!hasPendingReadback)
+            return;
+        lastReadback = pendingReadback;
+        hasReadback = true;
+    }
+
+    boidsReadback.wait(lastReadback);
+    Boid *previous = (Boid*)boidsReadback.pointer(lastReadback);
+    Boid *current = previous + numBoids;
+
+    float beta = 1.f - alpha;
+
     glBegin(GL_TRIANGLES);
     for(int i = 0; i < numBoids; i++) {
-        boids[i] = boids[numBoids + i];
+        glColor3f(colors[i].r, colors[i].g, colors[i].b);
+        Vector *p = previous[i].triangles;
+        Vector *c = current[i].triangles;
+        for(int j = 0; j < 6*4; j += 4){
+            // the fourth vector of each triangle is its normal
+            glNormal3f(p[j+3].x * beta + c[j+3].x * alpha, p[j+3].y * beta + c[j+3].y * alpha, p[j+3].z * beta + c[j+3].z * alpha);
+            for(int k = j; k < j + 3; k++)
+                glVertex3f(p[k].x * beta + c[k].x * alpha, p[k].y * beta + c[k].y * alpha, p[k].z * beta + c[k].z * alpha);
+        }
+    }
+    glEnd();
+
+    if(hasPendingReadback){
+        lastReadback = pendingReadback;
+        hasPendingReadback = false;
+    }
+}
+
+void Boids::configureSimulation(BoidSimulation& simulation)
+{
+    simulation.box.x = box.x;
+    simulation.box.y = box.y;
+    simulation.box.z = box.z;
+    simulation.predictionLength = predictionLength;
+    simulation.minSpeed = minSpeed;
+    simulation.maxSpeed = maxSpeed;
+    simulation.maxForce = maxForce;
+    simulation.viewRadius = viewRadius;
+    simulation.viewAngle = viewAngle;
+    simulation.avoidRadius = avoidRadius;
+    simulation.cohesionCoef = cohesionCoef;
+    simulation.alignmentCoef = alignmentCoef;
+    simulation.separationCoef = separationCoef;
+    simulation.obstacleCoef = obstacleCoef;
+    simulation.avoidMesh = avoidMesh;
+
+    simulation.setup(numBoids, numRays);
+}
+
+void Boids::drawSimulation(std::vector<BoidSimulation::Boid>& previous, std::vector<BoidSimulation::Boid>& state, float alpha)
+{
+    if(applyLighting){
+        glEnable(GL_LIGHTING);
+        glEnable(GL_COLOR_MATERIAL);
+    } else {
+        glDisable(GL_LIGHTING);
+        glDisable(GL_COLOR_MATERIAL);
+    }
+
+    int count = std::min(std::min((int)state.size(), (int)previous.size()), numBoids);
+
+    // same model transformation as the compute shader, applied on the interpolated
+    // state in parallel into the frame arena, with the same layout as the GPU triangles
+    Vector *triangles = Arena::frame().allocateArray<Vector>((size_t)count * 6*4);
+
+    ThreadPool::global().parallelFor("boids.transform", 0, count, 1024, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            vec3d pos = previous[i].pos * (1.f - alpha) + state[i].pos * alpha;
+            vec3d dir = previous[i].vel * (1.f - alpha) + state[i].vel * alpha;
+            dir.normalize();
+
+            float transform[3][3];
+            BoidSimulation::orientation(dir, transform);
+
+            Vector *t = triangles + (size_t)i * 6*4;
+            for(int j = 0; j < 6*4; j += 4){
+                Vector& ma = boidModelTriangles[j + 0];
+                Vector& mb = boidModelTriangles[j + 1];
+                Vector& mc = boidModelTriangles[j + 2];
+                vec3d a = BoidSimulation::transform(transform, vec3d(ma.x, ma.y, ma.z)) + pos;
+                vec3d b = BoidSimulation::transform(transform, vec3d(mb.x, mb.y, mb.z)) + pos;
+                vec3d c = BoidSimulation::transform(transform, vec3d(mc.x, mc.y, mc.z)) + pos;
+                t[j] = Vector(a);
+                t[j+1] = Vector(b);
+                t[j+2] = Vector(c);
+                t[j+3] = Vector(vec3d::cross(b - a, c - a));
+            }
+        }
+    });
 
+    glBegin(GL_TRIANGLES);
+    for(int i = 0; i < count; i++) {
         glColor3f(colors[i].r, colors[i].g, colors[i].b);
+        Vector *t = triangles + (size_t)i * 6*4;
         for(int j = 0; j < 6*4; j += 4){
-            Vector& a = boids[i].triangles[j + 0];
-            Vector& b = boids[i].triangles[j + 1];
-            Vector& c = boids[i].triangles[j + 2];
-            Vector& n = boids[i].triangles[j + 3];
-            glNormal3f(n.x, n.y, n.z);
-            glVertex3f(a.x, a.y, a.z);
-            glVertex3f(b.x, b.y, b.z);
-            glVertex3f(c.x, c.y, c.z);
+            glNormal3f(t[j+3].x, t[j+3].y, t[j+3].z);
+            for(int k = j; k < j + 3; k++)
+                glVertex3f(t[k].x, t[k].y, t[k].z);
         }
     }
     glEnd();
-    boidsData.unmap();
 }
 
 void Boids::setBoidSize(float width, float height)
@@ -193,33 +381,46 @@ void Boids::calculateRayDirs()
     // from : https://stackoverflow.com/questions/9600801/evenly-distributing-n-points-on-a-sphere/44164075#44164075
 
     rayDirs.resize(numRays * sizeof(Vector));
-    Vector *rays = (Vector*)rayDirs.map(GL_WRITE_ONLY);
+    Vector *rays = Arena::generation().allocateArray<Vector>(numRays);
     float count = (float)std::max(numRays - 1, 1);
-    for(int i = 0; i < numRays; i++){
-        float t = (float)i / count;
-        float inclination = acos(1.f - 2.f * t);
-        float azimuth = 2.f * PI * PHI * (float)i;
+    ThreadPool::global().parallelFor("rayDirs", 0, numRays, 1024, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            float t = (float)i / count;
+            float inclination = acos(1.f - 2.f * t);
+            float azimuth = 2.f * PI * PHI * (float)i;
 
-        float x = sin(inclination) * cos(azimuth);
-        float y = sin(inclination) * sin(azimuth);
-        float z = cos(inclination);
+            float x = sin(inclination) * cos(azimuth);
+            float y = sin(inclination) * sin(azimuth);
+            float z = cos(inclination);
 
-        rays[i] = Vector(x, y, z);
-    }
-    rayDirs.unmap();
+            rays[i] = Vector(x, y, z);
+        }
+    });
+    rayDirs.streamSubData(0, numRays * sizeof(Vector), rays);
 }
 
 void Boids::createBuffers()
 {
     boidsData = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, numBoids * 2 * sizeof(Boid));
     rayDirs = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_READ, numRays * sizeof(Vector));
+    parameters = Buffer(GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW, sizeof(Parameters));
+    createReadbackStream();
 
     hasBuffers = true;
 }
 
+void Boids::createReadbackStream()
+{
+    // room for three readbacks of both states so that the one being drawn is never overwritten
+    boidsReadback = StreamBuffer(std::max(numBoids, 1) * sizeof(Boid) * 2 * 3 + 1024, GL_MAP_READ_BIT);
+    hasReadback = false;
+    hasPendingReadback = false;
+}
+
 void Boids::createProgram()
 {
     boidProgram = ComputeProgram("Boid.glsl", calculateOptimalDisptachSpace(numBoids, 1, 1));
+    deltaTimeLocation = boidProgram.uniformLocation("deltaTime");
 
     hasProgram = true;
 }
@@ -232,12 +433,17 @@ void Boids::updateDispatchParams()
 void Boids::resizeBoidBuffer()
 {
     boidsData.resize(numBoids * 2 * sizeof(Boid));
+
+    boidsReadback.deleteBuffer();
+    createReadbackStream();
 }
 
 void Boids::deleteBuffers()
 {
     boidsData.deleteBuffer();
     rayDirs.deleteBuffer();
+    parameters.deleteBuffer();
+    boidsReadback.deleteBuffer();
 
     hasBuffers = false;
 }
@@ -274,5 +480,5 @@ Boids::Vector::Vector(vec3d v) : x(v.x), y(v.y), z(v.z)
 
 Boids::~Boids()
 {
-
+    delete[] colors;
 }
@@ -1,5 +1,12 @@
 #include "Buffer.h"
 
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#define UPLOAD_STREAM_SIZE  (4*1024*1024)
+#define STREAM_ALIGNMENT    64
+
 
 Buffer::Buffer()
 {
@@ -11,20 +18,19 @@ Buffer::Buffer(GLenum _target, GLenum _usage) : target(_target), usage(_usage)
     glGenBuffers(1, &id);
 }
 
-Buffer::Buffer(GLenum _target, GLenum _usage, size_t _size) : size(_size), target(_target), usage(_usage)
+Buffer::Buffer(GLenum _target, GLenum _usage, size_t _size) : Buffer(_target, _usage, _size, NULL)
 {
-    glGenBuffers(1, &id);
-    glBindBuffer(target, id);
-    glBufferData(target, size, NULL, usage);
-    glBindBuffer(target, 0);
+
 }
 
-Buffer::Buffer(GLenum _target, GLenum _usage, size_t _size, void* data) : size(_size), target(_target), usage(_usage)
+Buffer::Buffer(GLenum _target, GLenum _usage, size_t _size, void* data) : size(_size), capacity(_size), target(_target), usage(_usage)
 {
     glGenBuffers(1, &id);
     glBindBuffer(target, id);
-    glBufferData(target, size, data, usage);
+    glBufferData(target, capacity, data, usage);
     glBindBuffer(target, 0);
+
+    allocatedBytes += capacity;
 }
 
 void Buffer::setData(const void* data)
@@ -32,10 +38,10 @@ void Buffer::setData(const void* data)
     setSubData(0, size, data);
 }
 
-void Buffer::setSubData(int offset, size_t _size, const void* data)
+void Buffer::setSubData(int _offset, size_t _size, const void* data)
 {
     glBindBuffer(target, id);
-    glBufferSubData(target, offset, _size, data);
+    glBufferSubData(target, offset + _offset, _size, data);
     glBindBuffer(target, 0);
 }
 
@@ -44,14 +50,17 @@ void Buffer::getData(void* container)
     getSubData(0, size, container);
 }
 
-void Buffer::getSubData(int offset, size_t _size, void* container)
+void Buffer::getSubData(int _offset, size_t _size, void* container)
 {
-    glGetNamedBufferSubData(id, offset, _size, container);
+    glGetNamedBufferSubData(id, offset + _offset, _size, container);
 }
 
 void Buffer::setBindingPoint(int binding)
 {
-    glBindBufferBase(target, binding, id);
+    if(isSubAllocated)
+        glBindBufferRange(target, binding, id, offset, size);
+    else
+        glBindBufferBase(target, binding, id);
 }
 
 void Buffer::resize(size_t _size)
@@ -61,21 +70,59 @@ void Buffer::resize(size_t _size)
 
 void Buffer::resize(size_t _size, void* data)
 {
-    glBindBuffer(target, id);
-    glBufferData(target, _size, data, usage);
-    glBindBuffer(target, 0);
+    // grow geometrically so that successive resizes do not reallocate each time,
+    // the current content is preserved
+    if(_size > capacity)
+        reserve(std::max(_size, capacity * 2));
 
     size = _size;
+
+    if(data != NULL)
+        setSubData(0, size, data);
+}
+
+void Buffer::reserve(size_t _capacity)
+{
+    if(_capacity <= capacity)
+        return;
+
+    if(isSubAllocated){
+        // ranges of an arena have a fixed capacity
+        printf("Buffer range of %zu bytes cannot grow to %zu bytes\n", capacity, _capacity);
+        return;
+    }
+
+    GLuint newID;
+    glGenBuffers(1, &newID);
+    glBindBuffer(target, newID);
+    glBufferData(target, _capacity, NULL, usage);
+    glBindBuffer(target, 0);
+
+    if(size > 0)
+        glCopyNamedBufferSubData(id, newID, 0, 0, size);
+
+    glDeleteBuffers(1, &id);
+
+    allocatedBytes += _capacity - capacity;
+
+    id = newID;
+    capacity = _capacity;
 }
 
 void* Buffer::map(GLenum access)
 {
-    return glMapNamedBuffer(id, access);
+    GLbitfield accessBits = 0;
+    if(access == GL_READ_ONLY || access == GL_READ_WRITE)
+        accessBits |= GL_MAP_READ_BIT;
+    if(access == GL_WRITE_ONLY || access == GL_READ_WRITE)
+        accessBits |= GL_MAP_WRITE_BIT;
+
+    return map(0, size, accessBits);
 }
 
-void* Buffer::map(int offset, size_t _size, GLenum access)
+void* Buffer::map(int _offset, size_t _size, GLenum access)
 {
-    return glMapNamedBufferRange(id, offset, _size, access);
+    return glMapNamedBufferRange(id, offset + _offset, _size, access);
 }
 
 void Buffer::unmap()
@@ -85,29 +132,311 @@ void Buffer::unmap()
 
 void Buffer::copy(Buffer& source)
 {
-    GLint _size;
+    resize(source.size);
+    glCopyNamedBufferSubData(source.id, id, source.offset, offset, source.size);
+}
 
-    glBindBuffer(GL_COPY_READ_BUFFER, source.id);
-    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &_size);
+void Buffer::copySubData(Buffer& destination, int readOffset, int writeOffset, size_t _size)
+{
+    glCopyNamedBufferSubData(id, destination.id, offset + readOffset, destination.offset + writeOffset, _size);
+}
 
-    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
-    if((size_t)_size != size)
-        glBufferData(GL_COPY_WRITE_BUFFER, _size, NULL, usage);
+void Buffer::streamSubData(int _offset, size_t _size, const void* data)
+{
+    // the data is written into the upload ring and copied on the GPU side,
+    // large uploads are split so that they never need the whole ring at once
 
-    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _size);
+    if(uploadStream.size == 0)
+        uploadStream = StreamBuffer(UPLOAD_STREAM_SIZE, GL_MAP_WRITE_BIT);
 
-    glBindBuffer(GL_COPY_READ_BUFFER, 0);
-    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    size_t chunkSize = uploadStream.size / 4;
+    const char* source = (const char*)data;
 
-    size = _size;
+    for(size_t done = 0; done < _size; done += chunkSize){
+        size_t chunk = std::min(chunkSize, _size - done);
+
+        StreamBuffer::Range range = uploadStream.allocate(chunk);
+        memcpy(uploadStream.pointer(range), source + done, chunk);
+        glCopyNamedBufferSubData(uploadStream.id, id, range.offset, offset + _offset + done, chunk);
+        uploadStream.fence(range);
+    }
+}
+
+StreamBuffer::Range Buffer::requestSubData(StreamBuffer& stream, int _offset, size_t _size)
+{
+    // the returned range can be read once ready without stalling the pipeline
+    StreamBuffer::Range range = stream.allocate(_size);
+    glCopyNamedBufferSubData(id, stream.id, offset + _offset, range.offset, _size);
+    stream.fence(range);
+    return range;
 }
 
 void Buffer::deleteBuffer()
 {
+    // ranges are owned by their arena
+    if(isSubAllocated)
+        return;
+
     glDeleteBuffers(1, &id);
+
+    allocatedBytes -= capacity;
+    capacity = 0;
+    size = 0;
+}
+
+size_t Buffer::allocatedBytes = 0;
+
+size_t Buffer::getAllocatedBytes()
+{
+    return allocatedBytes;
+}
+
+StreamBuffer Buffer::uploadStream;
+
+void Buffer::deleteStreams()
+{
+    if(uploadStream.size > 0)
+        uploadStream.deleteBuffer();
 }
 
 Buffer::~Buffer()
 {
 
 }
+
+
+BufferArena::BufferArena()
+{
+
+}
+
+BufferArena::BufferArena(GLenum _target, GLenum _usage) : target(_target), usage(_usage)
+{
+    // ranges must respect the binding offset alignment of storage and uniform buffers
+    GLint storageAlignment = 0, uniformAlignment = 0;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+
+    alignment = std::max((size_t)16, (size_t)std::max(storageAlignment, uniformAlignment));
+}
+
+Buffer BufferArena::allocate(size_t _size)
+{
+    size_t alignedSize = align(std::max(_size, (size_t)1));
+
+    // first block with enough space left, a new block is created otherwise
+    auto it = std::find_if(blocks.begin(), blocks.end(), [alignedSize](Block& b){
+        return b.capacity - b.used >= alignedSize;
+    });
+
+    if(it == blocks.end()){
+        // blocks grow geometrically
+        size_t lastCapacity = blocks.empty() ? 0 : blocks.back().capacity;
+        createBlock(std::max(alignedSize, lastCapacity * 2));
+        it = blocks.end() - 1;
+    }
+
+    Buffer range;
+    range.id = it->id;
+    range.target = target;
+    range.usage = usage;
+    range.offset = it->used;
+    range.size = _size;
+    range.capacity = alignedSize;
+    range.isSubAllocated = true;
+
+    it->used += alignedSize;
+
+    return range;
+}
+
+void BufferArena::reserve(size_t _capacity)
+{
+    // make sure the next allocations up to _capacity bytes fit in a single block
+    _capacity = align(_capacity);
+
+    for(Block& b : blocks){
+        if(b.capacity - b.used >= _capacity)
+            return;
+    }
+
+    if(getUsedBytes() == 0){
+        // nothing lives in the arena, the blocks can be merged into a bigger one
+        size_t total = getCapacity();
+        deleteArena();
+        createBlock(std::max(_capacity, total * 2));
+    } else {
+        createBlock(_capacity);
+    }
+}
+
+void BufferArena::reset()
+{
+    for(Block& b : blocks)
+        b.used = 0;
+}
+
+size_t BufferArena::getUsedBytes()
+{
+    size_t used = 0;
+    for(Block& b : blocks)
+        used += b.used;
+    return used;
+}
+
+size_t BufferArena::getCapacity()
+{
+    size_t total = 0;
+    for(Block& b : blocks)
+        total += b.capacity;
+    return total;
+}
+
+void BufferArena::createBlock(size_t _capacity)
+{
+    Block block;
+    block.capacity = _capacity;
+    block.used = 0;
+
+    glGenBuffers(1, &block.id);
+    glBindBuffer(target, block.id);
+    glBufferData(target, block.capacity, NULL, usage);
+    glBindBuffer(target, 0);
+
+    Buffer::allocatedBytes += block.capacity;
+
+    blocks.push_back(block);
+}
+
+size_t BufferArena::align(size_t value)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void BufferArena::deleteArena()
+{
+    for(Block& b : blocks){
+        glDeleteBuffers(1, &b.id);
+        Buffer::allocatedBytes -= b.capacity;
+    }
+    blocks.clear();
+}
+
+BufferArena::~BufferArena()
+{
+
+}
+
+
+StreamBuffer::StreamBuffer()
+{
+
+}
+
+StreamBuffer::StreamBuffer(size_t _size, GLbitfield access) : size(_size)
+{
+    GLbitfield flags = access | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    mapped = (char*)glMapNamedBufferRange(id, 0, size, flags);
+
+    Buffer::allocatedBytes += size;
+}
+
+StreamBuffer::Range StreamBuffer::allocate(size_t _size)
+{
+    size_t alignedSize = (_size + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+
+    if(head + alignedSize > size)
+        head = 0;
+
+    // wait for the GPU to be done with the ranges that are about to be overwritten
+    release(head, head + alignedSize);
+
+    Range range;
+    range.offset = head;
+    range.size = _size;
+
+    head += alignedSize;
+
+    return range;
+}
+
+void StreamBuffer::fence(Range& range)
+{
+    range.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    inFlight.push_back(range);
+}
+
+bool StreamBuffer::isReady(Range& range)
+{
+    for(Range& r : inFlight){
+        if(r.offset == range.offset && r.fence == range.fence){
+            GLenum status = glClientWaitSync(r.fence, 0, 0);
+            return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+        }
+    }
+    // ranges no longer in flight are complete
+    return true;
+}
+
+void StreamBuffer::wait(Range& range)
+{
+    release(range.offset, range.offset + range.size);
+}
+
+void* StreamBuffer::pointer(Range& range)
+{
+    return mapped + range.offset;
+}
+
+void StreamBuffer::release(size_t start, size_t end)
+{
+    for(auto it = inFlight.begin(); it != inFlight.end();){
+        if(it->offset < end && start < it->offset + it->size){
+            waitSync(it->fence);
+            glDeleteSync(it->fence);
+            it = inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int StreamBuffer::fenceWaits = 0;
+
+void StreamBuffer::waitSync(GLsync sync)
+{
+    GLenum status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(status == GL_ALREADY_SIGNALED)
+        return;
+
+    fenceWaits++;
+
+    while(status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+}
+
+void StreamBuffer::deleteBuffer()
+{
+    for(Range& r : inFlight)
+        glDeleteSync(r.fence);
+    inFlight.clear();
+
+    glUnmapNamedBuffer(id);
+    glDeleteBuffers(1, &id);
+
+    Buffer::allocatedBytes -= size;
+    size = 0;
+    mapped = NULL;
+    head = 0;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+
+}
@@ -146,6 +146,47 @@ void Camera::resetCenter()
     center = vec3d();
 }
 
+Frustum Camera::frustum(float fovy, float aspect, float zNear, float zFar)
+{
+    // same basis as gluLookAt with the y axis up
+    vec3d forward = center - pos;
+    forward.normalize();
+    vec3d right = vec3d::cross(forward, vec3d(0.f, 1.f, 0.f));
+    right.normalize();
+    vec3d up = vec3d::cross(right, forward);
+
+    float tanY = tan(fovy * PI / 360.f);
+    float tanX = tanY * aspect;
+
+    Frustum f;
+    f.normals[0] = forward;
+    f.normals[1] = -forward;
+    f.normals[2] = forward * tanX + right;
+    f.normals[3] = forward * tanX - right;
+    f.normals[4] = forward * tanY + up;
+    f.normals[5] = forward * tanY - up;
+
+    for(int i = 2; i < 6; i++)
+        f.normals[i].normalize();
+
+    // the side planes go through the eye
+    for(int i = 0; i < 6; i++)
+        f.distances[i] = -vec3d::dot(f.normals[i], pos);
+    f.distances[0] -= zNear;
+    f.distances[1] += zFar;
+
+    return f;
+}
+
+bool Frustum::intersectsSphere(vec3d center, float radius) const
+{
+    for(int i = 0; i < 6; i++){
+        if(vec3d::dot(normals[i], center) + distances[i] < -radius)
+            return false;
+    }
+    return true;
+}
+
 Camera::~Camera()
 {
 
@@ -17,11 +17,56 @@ ComputeProcess::ComputeProcess()
 GLuint ComputeProcess::createComputeProgram(std::string sourcefile)
 {
     GLuint csProgramID;
-    GLuint shaderID;
+    GLuint shaderID = compileShader(GL_COMPUTE_SHADER, sourcefile);
 
+    csProgramID = glCreateProgram();
+    glAttachShader(csProgramID, shaderID);
+    glLinkProgram(csProgramID);
+    glDeleteShader(shaderID);
+
+    GLint result = GL_FALSE;
+    char programErrorMessage[1024] = {0};
+
+    glGetProgramiv(csProgramID, GL_LINK_STATUS, &result);
+    glGetProgramInfoLog(csProgramID, sizeof(programErrorMessage), NULL, programErrorMessage);
+    if (result == GL_FALSE){
+      std::cout << "\nPROGRAM ERROR (" << sourcefile << "):\n" << programErrorMessage << "\n";
+      numProgramErrors++;
+    }
+
+    return csProgramID;
+}
+
+GLuint ComputeProcess::createRenderProgram(std::string vertexFile, std::string fragmentFile)
+{
+    GLuint vertexShaderID = compileShader(GL_VERTEX_SHADER, vertexFile);
+    GLuint fragmentShaderID = compileShader(GL_FRAGMENT_SHADER, fragmentFile);
+
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, vertexShaderID);
+    glAttachShader(programID, fragmentShaderID);
+    glLinkProgram(programID);
+    glDeleteShader(vertexShaderID);
+    glDeleteShader(fragmentShaderID);
+
+    GLint result = GL_FALSE;
+    char programErrorMessage[1024] = {0};
+
+    glGetProgramiv(programID, GL_LINK_STATUS, &result);
+    glGetProgramInfoLog(programID, sizeof(programErrorMessage), NULL, programErrorMessage);
+    if (result == GL_FALSE){
+      std::cout << "\nPROGRAM ERROR:\n" << programErrorMessage << "\n";
+      numProgramErrors++;
+    }
+
+    return programID;
+}
+
+GLuint ComputeProcess::compileShader(GLenum type, std::string sourcefile)
+{
     char *source = loadShaderSource(sourcefile);
 
-    shaderID = glCreateShader(GL_COMPUTE_SHADER);
+    GLuint shaderID = glCreateShader(type);
     glShaderSource(shaderID, 1, &source, NULL);
     glCompileShader(shaderID);
 
@@ -34,31 +79,32 @@ GLuint ComputeProcess::createComputeProgram(std::string sourcefile)
     glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
 
     glGetShaderInfoLog(shaderID, InfoLogLength, NULL, shaderErrorMessage);
-    if (result == GL_FALSE)
-      std::cout << "\nSHADER ERROR:\n" << shaderErrorMessage << "\n";
-
-    csProgramID = glCreateProgram();
-    glAttachShader(csProgramID, shaderID);
-    glLinkProgram(csProgramID);
-    glDeleteShader(shaderID);
+    if (result == GL_FALSE){
+      std::cout << "\nSHADER ERROR (" << sourcefile << "):\n" << shaderErrorMessage << "\n";
+      numProgramErrors++;
+    }
 
-    return csProgramID;
+    return shaderID;
 }
 
 char* ComputeProcess::loadShaderSource(std::string filename)
 {
-    std::ifstream file(filename);
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    char* source = new char[content.length()+1];
-    strcpy(source, content.c_str());
+    // read straight into the returned buffer
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    std::streamsize length = file ? (std::streamsize)file.tellg() : 0;
+    file.seekg(0);
+
+    char* source = new char[length+1];
+    file.read(source, length);
+    source[file ? length : file.gcount()] = '\0';
 
     return source;
 }
 
 void ComputeProcess::useProgram(ComputeProgram& cprogram)
 {
-    currentProgram = cprogram;
-    glUseProgram(currentProgram.id);
+    currentProgram = &cprogram;
+    glUseProgram(currentProgram->id);
 }
 
 void ComputeProcess::runComputeShader(int num_workgroup_x, int num_workgroup_y, int num_workgroup_z)
@@ -84,7 +130,7 @@ void ComputeProcess::runComputeShader(ComputeProgram& cprogram)
 
 void ComputeProcess::runComputeShader()
 {
-    runComputeShader(currentProgram);
+    runComputeShader(*currentProgram);
 }
 
 void ComputeProcess::startDurationRecording()
@@ -93,17 +139,111 @@ void ComputeProcess::startDurationRecording()
     glBeginQuery(GL_TIME_ELAPSED, durationQuery);
 }
 
+void ComputeProcess::stopDurationRecording()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
 float ComputeProcess::endDurationRecording()
 {
     unsigned int durationNano;
 
-    glEndQuery(GL_TIME_ELAPSED);
+    stopDurationRecording();
     glGetQueryObjectuiv(durationQuery, GL_QUERY_RESULT, &durationNano);
     glDeleteQueries(1, &durationQuery);
 
     return (float)durationNano/(float)1e6; // convert from ns to ms;
 }
 
+bool ComputeProcess::pollDurationRecording(float& duration)
+{
+    // returns false while the result is not available yet, without waiting for it
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(durationQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(available == GL_FALSE)
+        return false;
+
+    unsigned int durationNano;
+    glGetQueryObjectuiv(durationQuery, GL_QUERY_RESULT, &durationNano);
+    glDeleteQueries(1, &durationQuery);
+
+    duration = (float)durationNano/(float)1e6; // convert from ns to ms;
+    return true;
+}
+
+void ComputeProcess::discardDurationRecording()
+{
+    glDeleteQueries(1, &durationQuery);
+}
+
+bool ComputeProcess::beginStageTimings()
+{
+    // returns false if the previous timings were not read yet, nothing is recorded then
+    if(stageTimingsPending)
+        return false;
+
+    stageNames.clear();
+    stageRecording = true;
+    markStage("");
+
+    return true;
+}
+
+void ComputeProcess::endStageTimings()
+{
+    stageRecording = false;
+}
+
+void ComputeProcess::discardStageTimings()
+{
+    stageTimingsPending = false;
+}
+
+void ComputeProcess::markStage(const char* name)
+{
+    if(!stageRecording)
+        return;
+
+    // the query objects are kept and reused between recordings
+    if(stageNames.size() >= stageQueries.size()){
+        GLuint query;
+        glGenQueries(1, &query);
+        stageQueries.push_back(query);
+    }
+
+    glQueryCounter(stageQueries[stageNames.size()], GL_TIMESTAMP);
+    stageNames.push_back(name);
+
+    stageTimingsPending = true;
+}
+
+bool ComputeProcess::pollStageTimings(std::vector<std::pair<const char*, float>>& durations)
+{
+    if(!stageTimingsPending)
+        return false;
+
+    // the timestamps are in order, the last one being available means all of them are
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(stageQueries[stageNames.size()-1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(available == GL_FALSE)
+        return false;
+
+    durations.clear();
+
+    GLuint64 previous;
+    glGetQueryObjectui64v(stageQueries[0], GL_QUERY_RESULT, &previous);
+    for(size_t i = 1; i < stageNames.size(); i++){
+        GLuint64 timestamp;
+        glGetQueryObjectui64v(stageQueries[i], GL_QUERY_RESULT, &timestamp);
+        durations.push_back(std::make_pair(stageNames[i], (float)(timestamp - previous)/(float)1e6));
+        previous = timestamp;
+    }
+
+    stageTimingsPending = false;
+
+    return true;
+}
+
 ComputeProcess::DispatchParams ComputeProcess::calculateOptimalDisptachSpace(int numInstancesX, int numInstancesY, int numInstancesZ)
 {
     // Calculate the number of workgroups and local invocations for optimized performances :
@@ -178,6 +318,7 @@ ComputeProcess::DispatchParams ComputeProcess::calculateOptimalDisptachSpace(int
 }
 
 int ComputeProcess::workGroupsCapabilities[7];
+int ComputeProcess::numProgramErrors = 0;
 bool ComputeProcess::gotCapabilities = false;
 
 void ComputeProcess::getWorkGroupsCapabilities()
@@ -230,4 +371,39 @@ ComputeProcess::ComputeProgram::ComputeProgram()
 ComputeProcess::ComputeProgram::ComputeProgram(std::string sourcefile, ComputeProcess::DispatchParams params) : dispatchParams(params)
 {
     id = createComputeProgram(sourcefile);
+    resolveUniformLocations();
+}
+
+void ComputeProcess::ComputeProgram::resolveUniformLocations()
+{
+    // query all the active uniforms of the program and store their locations,
+    // uniforms inside blocks have no location and are ignored
+
+    GLint numUniforms = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &numUniforms);
+
+    char name[256];
+    for(GLint i = 0; i < numUniforms; i++){
+        GLint arraySize;
+        GLenum type;
+        glGetActiveUniform(id, i, sizeof(name), NULL, &arraySize, &type, name);
+
+        GLint location = glGetUniformLocation(id, name);
+        if(location < 0)
+            continue;
+
+        // arrays are reported as "name[0]"
+        std::string uniformName(name);
+        size_t bracket = uniformName.find('[');
+        if(bracket != std::string::npos)
+            uniformName.erase(bracket);
+
+        uniformLocations[uniformName] = location;
+    }
+}
+
+GLint ComputeProcess::ComputeProgram::uniformLocation(std::string name)
+{
+    auto it = uniformLocations.find(name);
+    return it != uniformLocations.end() ? it->second : -1;
 }
@@ -24,6 +24,13 @@ void ConfigParser::parse()
 
     data.clear();
 
+    // existing values are never reset, so the overrides are parsed first
+    for(std::string line : overrides){
+        if(simplifyLine(line)){
+            parseLine(line);
+        }
+    }
+
     std::string line;
     while(std::getline(file, line)){
         if(simplifyLine(line)){
@@ -34,6 +41,12 @@ void ConfigParser::parse()
     file.close();
 }
 
+void ConfigParser::override(std::string line)
+{
+    overrides.push_back(line);
+    parse();
+}
+
 void ConfigParser::parseLine(std::string& line)
 {
     // Check if equal sign exists
@@ -0,0 +1,152 @@
+#include "CpuMarchingCubes.h"
+
+#include <algorithm>
+#include <Tables.h>
+
+
+// corners of a cube as offsets along x, y and z, see MarchingCubes.glsl
+static const int cornerOffsets[8][3] = {
+    {0, 0, 0}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0},
+    {0, 0, 1}, {0, 1, 1}, {1, 1, 1}, {1, 0, 1}
+};
+
+static const int edgeNodeA[12] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3};
+static const int edgeNodeB[12] = {1, 2, 3, 0, 5, 6, 7, 4, 4, 5, 6, 7};
+
+
+CpuMarchingCubes::CpuMarchingCubes()
+{
+
+}
+
+void CpuMarchingCubes::begin(const float* _ys, int _ny, const float* _zs, int _nz)
+{
+    ny = _ny;
+    nz = _nz;
+    numLevels = (int)surfaceLevels.size();
+    numSlices = 0;
+    firstVertex = 0;
+
+    ys.assign(_ys, _ys + ny);
+    zs.assign(_zs, _zs + nz);
+
+    positions.clear();
+    indices.resize(numLevels);
+    for(std::vector<uint32_t>& levelIndices : indices)
+        levelIndices.clear();
+
+    // the edges of the level l follow the ones of the level l-1
+    int numEdges = ny * nz * numLevels;
+    previous.resize(ny * nz);
+    previousEdgesY.assign(numEdges, -1);
+    previousEdgesZ.assign(numEdges, -1);
+    nextEdgesY.resize(numEdges);
+    nextEdgesZ.resize(numEdges);
+    edgesX.resize(numEdges);
+}
+
+void CpuMarchingCubes::addSlice(float x, const float* values)
+{
+    if(numSlices > 0){
+        std::fill(nextEdgesY.begin(), nextEdgesY.end(), -1);
+        std::fill(nextEdgesZ.begin(), nextEdgesZ.end(), -1);
+        std::fill(edgesX.begin(), edgesX.end(), -1);
+
+        for(int j = 0; j < ny - 1; j++){
+            for(int k = 0; k < nz - 1; k++)
+                meshCube(j, k, x, values);
+        }
+
+        // the new slice becomes the previous one
+        previousEdgesY.swap(nextEdgesY);
+        previousEdgesZ.swap(nextEdgesZ);
+    }
+
+    std::copy(values, values + ny * nz, previous.begin());
+    previousX = x;
+    numSlices++;
+}
+
+void CpuMarchingCubes::meshCube(int j, int k, float x, const float* values)
+{
+    float corners[8];
+    float lowest = 0.f, highest = 0.f;
+    for(int i = 0; i < 8; i++){
+        const int* c = cornerOffsets[i];
+        const float* slice = c[0] == 0 ? previous.data() : values;
+        corners[i] = slice[(k + c[2]) + nz * (j + c[1])];
+        lowest = i == 0 ? corners[i] : std::min(lowest, corners[i]);
+        highest = i == 0 ? corners[i] : std::max(highest, corners[i]);
+    }
+
+    for(int level = 0; level < numLevels; level++){
+        // only the levels between the corners values cross the cube
+        float surfaceLevel = surfaceLevels[level];
+        if(highest <= surfaceLevel || lowest > surfaceLevel)
+            continue;
+
+        int config = 0;
+        for(int i = 0; i < 8; i++){
+            if(corners[i] > surfaceLevel)
+                config |= 1 << i;
+        }
+
+        const uint8_t* triangleEdges = compactTables.triangleEdges[config];
+        int numEdges = compactTables.numTriangles[config] * 3;
+        std::vector<uint32_t>& levelIndices = indices[level];
+        for(int i = 0; i < numEdges; i++)
+            levelIndices.push_back(edgeVertex(triangleEdges[i], level, j, k, x, corners));
+    }
+}
+
+int CpuMarchingCubes::edgeVertex(int edge, int level, int j, int k, float x, const float corners[8])
+{
+    const int* a = cornerOffsets[edgeNodeA[edge]];
+    const int* b = cornerOffsets[edgeNodeB[edge]];
+
+    // the edge is stored at its lowest corner, on the slice it lies in or across the slices
+    int low[3] = {std::min(a[0], b[0]), j + std::min(a[1], b[1]), k + std::min(a[2], b[2])};
+    int cell = low[2] + nz * low[1] + ny * nz * level;
+
+    int *id;
+    if(a[0] != b[0])
+        id = &edgesX[cell];
+    else if(a[1] != b[1])
+        id = low[0] == 0 ? &previousEdgesY[cell] : &nextEdgesY[cell];
+    else
+        id = low[0] == 0 ? &previousEdgesZ[cell] : &nextEdgesZ[cell];
+
+    if(*id >= 0)
+        return *id;
+
+    float valueA = corners[edgeNodeA[edge]];
+    float valueB = corners[edgeNodeB[edge]];
+    float t = (surfaceLevels[level] - valueA) / (valueB - valueA);
+
+    float pa[3] = {a[0] == 0 ? previousX : x, ys[j + a[1]], zs[k + a[2]]};
+    float pb[3] = {b[0] == 0 ? previousX : x, ys[j + b[1]], zs[k + b[2]]};
+
+    *id = getNumVertices();
+    for(int i = 0; i < 3; i++)
+        positions.push_back(pa[i] + (pb[i] - pa[i]) * t);
+
+    return *id;
+}
+
+int CpuMarchingCubes::getNumVertices()
+{
+    return firstVertex + (int)positions.size() / 3;
+}
+
+void CpuMarchingCubes::clearOutput()
+{
+    firstVertex = getNumVertices();
+    positions.clear();
+    for(std::vector<uint32_t>& levelIndices : indices)
+        levelIndices.clear();
+}
+
+CpuMarchingCubes::~CpuMarchingCubes()
+{
+
+}
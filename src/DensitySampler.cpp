@@ -0,0 +1,156 @@
+#include "DensitySampler.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+DensitySampler::DensitySampler()
+{
+
+}
+
+void DensitySampler::configure(const NoiseSettings& _noise, int numCubesX, int numCubesY, int numCubesZ)
+{
+    noise = _noise;
+    dims[0] = (float)(numCubesX + 1);
+    dims[1] = (float)(numCubesY + 1);
+    dims[2] = (float)(numCubesZ + 1);
+}
+
+float DensitySampler::sample(float x, float y, float z) const
+{
+    float px = x + noise.offset.x;
+    float py = y + noise.offset.y;
+    float pz = z + noise.offset.z;
+
+    float value = 0.f;
+    float frequency = noise.noiseScale / 100.f;
+    float weight = 1.f;
+    for(int i = 0; i < noise.octaves; i++){
+        uint32_t key = (uint32_t)noise.offsetSeed * 0x27D4EB2Du + (uint32_t)i;
+        value += simplex3d(px * frequency, py * frequency, pz * frequency, key) * weight;
+        frequency *= noise.lacunarity;
+        weight *= noise.persistence;
+    }
+
+    // same surface features as the shader, mod() of GLSL is floored
+    float step = py - noise.stepSize * floorf(py / noise.stepSize);
+    float finalVal = (-py + noise.floorOffset) + value * noise.noiseWeight + step * noise.stepWeight;
+
+    if(py < noise.hardFloor)
+        finalVal += noise.floorWeight;
+
+    if(noise.closeEdges){
+        float coords[3] = {x, y, z};
+        float edgeWeight = 0.f;
+        for(int i = 0; i < 3; i++)
+            edgeWeight = std::max(edgeWeight, fabsf(coords[i] * 2.f - dims[i] + 1.f) - dims[i] + 2.f);
+        edgeWeight = std::min(edgeWeight, 1.f);
+
+        finalVal = finalVal * (1.f - edgeWeight) - 1000.f * edgeWeight;
+    }
+
+    return finalVal;
+}
+
+void DensitySampler::normal(float x, float y, float z, float n[3]) const
+{
+    // central differences over one grid unit, like Normals.glsl
+    n[0] = sample(x - 1.f, y, z) - sample(x + 1.f, y, z);
+    n[1] = sample(x, y - 1.f, z) - sample(x, y + 1.f, z);
+    n[2] = sample(x, y, z - 1.f) - sample(x, y, z + 1.f);
+
+    float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if(length < 1e-12f){
+        n[0] = 0.f;
+        n[1] = 1.f;
+        n[2] = 0.f;
+        return;
+    }
+
+    n[0] /= length;
+    n[1] /= length;
+    n[2] /= length;
+}
+
+void DensitySampler::random3(int cx, int cy, int cz, uint32_t key, float r[3])
+{
+    // pcg3d hash of Density.glsl, the unsigned arithmetic wraps like in GLSL
+    uint32_t v[3] = {
+        (uint32_t)cx + key,
+        (uint32_t)cy + key * 0x9E3779B9u,
+        (uint32_t)cz + key * 0x85EBCA6Bu
+    };
+    for(int i = 0; i < 3; i++)
+        v[i] = v[i] * 1664525u + 1013904223u;
+    v[0] += v[1] * v[2]; v[1] += v[2] * v[0]; v[2] += v[0] * v[1];
+    for(int i = 0; i < 3; i++)
+        v[i] ^= v[i] >> 16;
+    v[0] += v[1] * v[2]; v[1] += v[2] * v[0]; v[2] += v[0] * v[1];
+
+    // 24 bits are exact in a float
+    for(int i = 0; i < 3; i++)
+        r[i] = (float)(v[i] >> 8) * (1.f / 16777216.f) - 0.5f;
+}
+
+float DensitySampler::simplex3d(float px, float py, float pz, uint32_t key)
+{
+    // port of the simplex noise of Density.glsl
+    const float F3 = 0.3333333f;
+    const float G3 = 0.1666667f;
+
+    float p[3] = {px, py, pz};
+
+    float skew = (px + py + pz) * F3;
+    float s[3], x[3];
+    for(int i = 0; i < 3; i++)
+        s[i] = floorf(p[i] + skew);
+    float unskew = (s[0] + s[1] + s[2]) * G3;
+    for(int i = 0; i < 3; i++)
+        x[i] = p[i] - s[i] + unskew;
+
+    float e[3], i1[3], i2[3];
+    for(int i = 0; i < 3; i++)
+        e[i] = x[i] - x[(i + 1) % 3] >= 0.f ? 1.f : 0.f;
+    for(int i = 0; i < 3; i++){
+        float ezxy = e[(i + 2) % 3];
+        i1[i] = e[i] * (1.f - ezxy);
+        i2[i] = 1.f - ezxy * (1.f - e[i]);
+    }
+
+    float x1[3], x2[3], x3[3];
+    for(int i = 0; i < 3; i++){
+        x1[i] = x[i] - i1[i] + G3;
+        x2[i] = x[i] - i2[i] + 2.f * G3;
+        x3[i] = x[i] - 1.f + 3.f * G3;
+    }
+
+    float *corners[4] = {x, x1, x2, x3};
+    int si[3] = {(int)s[0], (int)s[1], (int)s[2]};
+    int offsets[4][3] = {
+        {0, 0, 0},
+        {(int)i1[0], (int)i1[1], (int)i1[2]},
+        {(int)i2[0], (int)i2[1], (int)i2[2]},
+        {1, 1, 1}
+    };
+
+    float result = 0.f;
+    for(int c = 0; c < 4; c++){
+        float *d = corners[c];
+        float w = std::max(0.6f - (d[0]*d[0] + d[1]*d[1] + d[2]*d[2]), 0.f);
+
+        float r[3];
+        random3(si[0] + offsets[c][0], si[1] + offsets[c][1], si[2] + offsets[c][2], key, r);
+
+        w *= w;
+        w *= w;
+        result += (r[0]*d[0] + r[1]*d[1] + r[2]*d[2]) * w;
+    }
+
+    return result * 52.f;
+}
+
+DensitySampler::~DensitySampler()
+{
+
+}
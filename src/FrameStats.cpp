@@ -0,0 +1,104 @@
+#include "FrameStats.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+
+FrameStats::FrameStats()
+{
+
+}
+
+void FrameStats::reserve(const char* series, int numSamples)
+{
+    findSeries(series).reserve(numSamples);
+}
+
+void FrameStats::addSample(const char* series, float value)
+{
+    findSeries(series).push_back(value);
+}
+
+std::vector<float>& FrameStats::findSeries(const char* series)
+{
+    // only a new series allocates
+    auto it = samples.find(series);
+    if(it == samples.end())
+        it = samples.emplace(series, std::vector<float>()).first;
+    return it->second;
+}
+
+void FrameStats::setValue(std::string name, double value)
+{
+    values[name] = value;
+}
+
+void FrameStats::setString(std::string name, std::string value)
+{
+    strings[name] = value;
+}
+
+float FrameStats::percentile(std::string series, float p)
+{
+    std::vector<float> sorted = samples[series];
+    if(sorted.empty())
+        return 0.f;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    // nearest rank percentile
+    size_t rank = (size_t)(p / 100.f * (float)(sorted.size() - 1) + 0.5f);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+float FrameStats::mean(std::string series)
+{
+    std::vector<float>& s = samples[series];
+    return s.empty() ? 0.f : total(series) / (float)s.size();
+}
+
+float FrameStats::total(std::string series)
+{
+    double sum = 0.;
+    for(float v : samples[series])
+        sum += v;
+    return (float)sum;
+}
+
+bool FrameStats::writeReport(std::string filename)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if(file == NULL){
+        printf("Could not write the report to %s\n", filename.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\n");
+
+    for(auto it = strings.begin(); it != strings.end(); ++it)
+        fprintf(file, "    \"%s\": \"%s\",\n", it->first.c_str(), it->second.c_str());
+
+    for(auto it = values.begin(); it != values.end(); ++it)
+        fprintf(file, "    \"%s\": %.17g,\n", it->first.c_str(), it->second);
+
+    fprintf(file, "    \"series\": {");
+    for(auto it = samples.begin(); it != samples.end(); ++it){
+        std::string name = it->first;
+        fprintf(file, "%s\n        \"%s\": {\"count\": %zu, \"mean\": %f, \"min\": %f, \"p50\": %f, \"p90\": %f, \"p99\": %f, \"max\": %f}",
+                it == samples.begin() ? "" : ",",
+                name.c_str(), it->second.size(), mean(name),
+                percentile(name, 0.f), percentile(name, 50.f), percentile(name, 90.f),
+                percentile(name, 99.f), percentile(name, 100.f));
+    }
+    fprintf(file, "\n    }\n");
+
+    fprintf(file, "}\n");
+    fclose(file);
+
+    return true;
+}
+
+FrameStats::~FrameStats()
+{
+
+}
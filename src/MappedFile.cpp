@@ -0,0 +1,217 @@
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MAPPEDFILE_MIN_CAPACITY (16 * 1024 * 1024)
+
+
+MappedFile::MappedFile()
+{
+
+}
+
+bool MappedFile::create(const std::string& path)
+{
+    close();
+    writable = true;
+    written = 0;
+    capacity = 0;
+
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE){
+        file = nullptr;
+        return false;
+    }
+#else
+    file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(file < 0)
+        return false;
+#endif
+
+    return true;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+    writable = false;
+
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE){
+        file = nullptr;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size_t length = (size_t)fileSize.QuadPart;
+#else
+    file = ::open(path.c_str(), O_RDONLY);
+    if(file < 0)
+        return false;
+    struct stat status;
+    fstat(file, &status);
+    size_t length = (size_t)status.st_size;
+#endif
+
+    written = capacity = length;
+    if(length > 0 && !map(length)){
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFile::write(const void* data, size_t _size)
+{
+    if(_size == 0)
+        return true;
+
+    if(written + _size > capacity){
+        // the file grows geometrically so that it is not remapped on each write
+        if(!reserve(std::max(std::max(written + _size, capacity * 2), (size_t)MAPPEDFILE_MIN_CAPACITY)))
+            return false;
+    }
+
+    memcpy(mapped + written, data, _size);
+    written += _size;
+    return true;
+}
+
+bool MappedFile::reserve(size_t _capacity)
+{
+    if(!writable || _capacity <= capacity)
+        return writable;
+
+    unmap();
+
+#ifdef _WIN32
+    LARGE_INTEGER length;
+    length.QuadPart = (LONGLONG)_capacity;
+    if(!SetFilePointerEx(file, length, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+        return false;
+#else
+    if(ftruncate(file, (off_t)_capacity) != 0)
+        return false;
+#endif
+
+    capacity = _capacity;
+    return map(capacity);
+}
+
+void MappedFile::flush()
+{
+    if(mapped == nullptr || !writable)
+        return;
+
+#ifdef _WIN32
+    FlushViewOfFile(mapped, written);
+#else
+    msync(mapped, written, MS_ASYNC);
+#endif
+}
+
+bool MappedFile::map(size_t _size)
+{
+#ifdef _WIN32
+    mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+    if(mapping == NULL)
+        return false;
+    mapped = (char*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, _size);
+    if(mapped == NULL){
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+#else
+    void* address = mmap(NULL, _size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+    if(address == MAP_FAILED)
+        return false;
+    mapped = (char*)address;
+#endif
+
+    mappedSize = _size;
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if(mapped == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(mapped, mappedSize);
+#endif
+
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+void MappedFile::close()
+{
+    unmap();
+
+#ifdef _WIN32
+    if(file == nullptr)
+        return;
+    if(writable){
+        LARGE_INTEGER length;
+        length.QuadPart = (LONGLONG)written;
+        SetFilePointerEx(file, length, NULL, FILE_BEGIN);
+        SetEndOfFile(file);
+    }
+    CloseHandle(file);
+    file = nullptr;
+#else
+    if(file < 0)
+        return;
+    // the capacity beyond the written data is dropped
+    if(writable && ftruncate(file, (off_t)written) != 0)
+        printf("Could not truncate a mapped file to %zu bytes\n", written);
+    ::close(file);
+    file = -1;
+#endif
+
+    capacity = 0;
+}
+
+char* MappedFile::data()
+{
+    return mapped;
+}
+
+size_t MappedFile::size()
+{
+    return written;
+}
+
+bool MappedFile::isOpen()
+{
+#ifdef _WIN32
+    return file != nullptr;
+#else
+    return file >= 0;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
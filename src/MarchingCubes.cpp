@@ -1,6 +1,15 @@
 #include "MarchingCubes.h"
 
 #include <iostream>
+#include <cstddef>
+#include <string.h>
+#include <algorithm>
+#include <math.h>
+#include <chrono>
+#include <ThreadPool.h>
+#include <Arena.h>
+#include <MeshOptimizer.h>
+#include <MeshSimplifier.h>
 #include <Tables.h>
 
 
@@ -10,6 +19,10 @@
 #define TRITABLES_SSB_BP    3
 #define NORMALS_SSB_BP      4
 #define TRIANGLES_SSB_BP    5
+#define INDIRECT_SSB_BP     6
+#define COUNTS_SSB_BP       7
+
+#define PARAMETERS_UB_BP    0
 
 
 MarchingCubes::MarchingCubes()
@@ -27,12 +40,6 @@ MarchingCubes::MarchingCubes(int width, int height, int depth, float _cubeSize)
 
 void MarchingCubes::resize()
 {
-    int x = cubeGrid.x, y = cubeGrid.y, z = cubeGrid.z;
-    // We can deduce the maximum number of vertices the grid can have by counting
-    // the number of edges in the grid, which gives a result just below 3*(w+1)*(h+1)*(d+1)
-    maxNumVertices = y*(x+1)*(z+1) + (y+1)*x*(z+1) + (y+1)*(x+1)*z;
-    maxNumTriangles = cubeGrid.count * 5; // each cube can have 5 triangles at most
-
     size.x = cubeGrid.x * cubeSize;
     size.y = cubeGrid.y * cubeSize;
     size.z = cubeGrid.z * cubeSize;
@@ -58,9 +65,12 @@ bool MarchingCubes::resize(int width, int height, int depth, float _cubeSize)
             createPrograms();
         }
         if(hasBuffers){
-            deleteBuffers();
+            releaseBuffers();
         }
         createBuffers();
+
+        // the counts of the previous grid do not tell the size of the next meshes
+        hasLastCounts = false;
     }
 
     // returns true if the overall mesh size is different compared to the previous one
@@ -69,69 +79,275 @@ bool MarchingCubes::resize(int width, int height, int depth, float _cubeSize)
 
 void MarchingCubes::generate()
 {
+    // Discard the statistics of the previous generation if they were never read
+    if(statisticsPending){
+        discardDurationRecording();
+        discardStageTimings();
+        statisticsPending = false;
+    }
+
+    // the counts of a mesh that was never checked are dropped with it
+    countsChecked = true;
+
+    // the scratch memory and the density of the previous generation are no longer used
+    Arena::generation().reset();
+    hasVolume = false;
+    numVolumeBricks = 0;
+
+    // the same parameters may have been generated before
+    cacheHit = useCache && loadCachedMesh();
+    if(cacheHit)
+        return;
+
     // Start recording the generation process duration
     startDurationRecording();
+    stagesRecorded = beginStageTimings();
 
     // Set buffers binding points
     density.setBindingPoint(NOISE_SSB_BP);
     normals.setBindingPoint(NORMALS_SSB_BP);
     cubes.setBindingPoint(CUBES_SSB_BP);
-    vertices.setBindingPoint(VERTICES_SSB_BP);
-    triangles.setBindingPoint(TRIANGLES_SSB_BP);
     tables.setBindingPoint(TRITABLES_SSB_BP);
+    indirect.setBindingPoint(INDIRECT_SSB_BP);
+    counts.setBindingPoint(COUNTS_SSB_BP);
 
-    // Reset the counters to 0
-    GLuint zero = 0;
-    vertices.setSubData(0, sizeof(GLuint), &zero);
-    triangles.setSubData(0, sizeof(GLuint), &zero);
+    // Write the generation parameters once for all the stages
+    uploadParameters();
+    parameters.setBindingPoint(PARAMETERS_UB_BP);
 
     // Generate the density field
     useProgram(densityCompute);
-    glUniform3i(glGetUniformLocation(currentProgram.id, "dims"), densityGrid.x, densityGrid.y, densityGrid.z);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "cubeSize"), cubeSize);
-    glUniform3f(glGetUniformLocation(currentProgram.id, "offset"), noise.offset.x, noise.offset.y, noise.offset.z);
-    glUniform1i(glGetUniformLocation(currentProgram.id, "octaves"), noise.octaves);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "noiseScale"), noise.noiseScale);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "lacunarity"), noise.lacunarity);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "persistence"), noise.persistence);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "noiseWeight"), noise.noiseWeight);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "floorOffset"), noise.floorOffset);
-    glUniform1i(glGetUniformLocation(currentProgram.id, "closeEdges"), noise.closeEdges);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "hardFloor"), noise.hardFloor);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "floorWeight"), noise.floorWeight);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "stepSize"), noise.stepSize);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "stepWeight"), noise.stepWeight);
     runComputeShader();
+    markStage("density");
 
     // avoid having small shapes
     if(minRegionSize > 0)
         removeSmallRegions();
+    markStage("removeSmallRegions");
 
     // Generate the normals for each density point
     useProgram(normalsCompute);
-    glUniform3i(glGetUniformLocation(currentProgram.id, "dims"), densityGrid.x, densityGrid.y, densityGrid.z);
     runComputeShader();
+    markStage("normals");
 
-    // Marching cubes compute shader
-    useProgram(marchingCubesCompute);
-    glUniform3i(glGetUniformLocation(currentProgram.id, "densityGridDims"), densityGrid.x, densityGrid.y, densityGrid.z);
-    glUniform3i(glGetUniformLocation(currentProgram.id, "cubeGridDims"), cubeGrid.x, cubeGrid.y, cubeGrid.z);
-    glUniform1f(glGetUniformLocation(currentProgram.id, "surfaceLevel"), surfaceLevel);
-    glUniform1i(glGetUniformLocation(currentProgram.id, "normalsOffset"), maxNumVertices);
+    // Count the vertices and triangles to generate and size the output buffers
+    GLuint zeros[2] = {0, 0};
+    counts.streamSubData(0, sizeof(zeros), zeros);
+    useProgram(surfaceNets ? surfaceNetsCountCompute : countCompute);
     runComputeShader();
+    resizeOutputBuffers();
+    markStage("count");
 
-    // Triangulation process
-    useProgram(trianglesCompute);
-    runComputeShader();
+    emitMesh(true);
+
+    // the atomic counters leave the triangles in no particular order,
+    // the mesh is checked to fit in the buffers when it is read
+    hasMeshlets = false;
+    if(simplifyMesh || optimizeMesh || useMeshlets){
+        processMesh();
+        markStage("processMesh");
+    }
+
+    // Stop recording generation time
+    stopDurationRecording();
+    endStageTimings();
+
+    if(useCache)
+        storeCachedMesh();
+
+    // Request the number of generated vertices and triangles, they are
+    // only needed for statistics so they are not waited for
+    verticesCountRange = vertices.requestSubData(statisticsStream, 0, sizeof(GLuint));
+    trianglesCountRange = triangles.requestSubData(statisticsStream, 0, sizeof(GLuint));
+    statisticsPending = true;
+}
+
+bool MarchingCubes::hasPendingStatistics()
+{
+    return statisticsPending || cachedStatistics;
+}
+
+void MarchingCubes::resizeOutputBuffers()
+{
+    // The output buffers are sized from the counts of the previous generation instead of the worst
+    // case of the grid, with a quarter of headroom. The counts of this one are read back without
+    // waiting, only the generations without previous counts wait for them.
+    countsRange = counts.requestSubData(statisticsStream, 0, 2 * sizeof(GLuint));
+    countsChecked = false;
+
+    if(!hasLastCounts){
+        countFallbacks++;
+        statisticsStream.wait(countsRange);
+        memcpy(lastCounts, statisticsStream.pointer(countsRange), sizeof(lastCounts));
+        hasLastCounts = true;
+        countsChecked = true;
+    }
+
+    reserveOutputBuffers(lastCounts[0] + lastCounts[0] / 4, lastCounts[1] + lastCounts[1] / 4);
+}
+
+void MarchingCubes::reserveOutputBuffers(GLuint vertexCount, GLuint triangleCount)
+{
+    // the sizes are reset first so that growing does not copy the previous content,
+    // the capacity still grows geometrically and is kept between generations
+    vertices.resize(0);
+    vertices.resize(vertexCount * sizeof(PackedVertex) + sizeof(GLuint));
+    triangles.resize(0);
+    triangles.resize(triangleCount * 3 * sizeof(int) + sizeof(GLuint));
+}
+
+void MarchingCubes::emitMesh(bool recordStages)
+{
+    // the buffers may have been reallocated by the resize
+    vertices.setBindingPoint(VERTICES_SSB_BP);
+    triangles.setBindingPoint(TRIANGLES_SSB_BP);
+
+    // Reset the counters to 0
+    GLuint zero = 0;
+    vertices.streamSubData(0, sizeof(GLuint), &zero);
+    triangles.streamSubData(0, sizeof(GLuint), &zero);
+
+    // The indices start after the triangles counter
+    IndirectArguments arguments = {0, 1, (GLuint)((triangles.offset + sizeof(GLuint)) / sizeof(GLuint)), 0, 0};
+    indirect.streamSubData(0, sizeof(IndirectArguments), &arguments);
+
+    if(surfaceNets){
+        // One vertex per cube, then one quad per edge crossed by the surface
+        useProgram(surfaceNetsCompute);
+        runComputeShader();
+        if(recordStages)
+            markStage("surfaceNets");
+
+        useProgram(surfaceNetsQuadsCompute);
+        runComputeShader();
+        if(recordStages)
+            markStage("quads");
+    } else {
+        // Marching cubes compute shader
+        useProgram(marchingCubesCompute);
+        runComputeShader();
+        if(recordStages)
+            markStage("marchingCubes");
+
+        // Triangulation process
+        useProgram(trianglesCompute);
+        runComputeShader();
+        if(recordStages)
+            markStage("triangles");
+    }
+
+    // The number of indices of the indirect draw, from the final triangles counter
+    useProgram(drawArgumentsCompute);
+    runComputeShader(1, 1, 1);
+    if(recordStages)
+        markStage("drawArguments");
 
     glUseProgram(0);
+}
 
-    // Retrieve the number of generated vertices and triangles
-    vertices.getSubData(0, sizeof(GLuint), &numVertices);
-    triangles.getSubData(0, sizeof(GLuint), &numTriangles);
+bool MarchingCubes::fitOutputBuffers()
+{
+    if(countsChecked)
+        return false;
+    countsChecked = true;
 
-    // Stop recording generation time
-    generationDuration = endDurationRecording();
+    statisticsStream.wait(countsRange);
+    memcpy(lastCounts, statisticsStream.pointer(countsRange), sizeof(lastCounts));
+
+    GLuint vertexCapacity = (GLuint)((vertices.capacity - sizeof(GLuint)) / sizeof(PackedVertex));
+    GLuint triangleCapacity = (GLuint)((triangles.capacity - sizeof(GLuint)) / (3 * sizeof(int)));
+    if(lastCounts[0] <= vertexCapacity && lastCounts[1] <= triangleCapacity)
+        return false;
+
+    // the mesh did not fit, it is emitted again into buffers of its exact size. The other
+    // stages may have bound their own buffers since the generation
+    countFallbacks++;
+    reserveOutputBuffers(lastCounts[0], lastCounts[1]);
+
+    density.setBindingPoint(NOISE_SSB_BP);
+    normals.setBindingPoint(NORMALS_SSB_BP);
+    cubes.setBindingPoint(CUBES_SSB_BP);
+    tables.setBindingPoint(TRITABLES_SSB_BP);
+    indirect.setBindingPoint(INDIRECT_SSB_BP);
+    parameters.setBindingPoint(PARAMETERS_UB_BP);
+    emitMesh(false);
+
+    return true;
+}
+
+bool MarchingCubes::pollStatistics()
+{
+    // the statistics of a mesh loaded from the cache are known right away
+    if(cachedStatistics){
+        cachedStatistics = false;
+        return true;
+    }
+
+    if(!statisticsPending)
+        return false;
+
+    // the counts were requested before the mesh, a mesh that did not fit
+    // is emitted again and its counters are requested again
+    if(!countsChecked){
+        if(!statisticsStream.isReady(countsRange))
+            return false;
+        if(fitOutputBuffers()){
+            verticesCountRange = vertices.requestSubData(statisticsStream, 0, sizeof(GLuint));
+            trianglesCountRange = triangles.requestSubData(statisticsStream, 0, sizeof(GLuint));
+            return false;
+        }
+    }
+
+    if(!statisticsStream.isReady(verticesCountRange) || !statisticsStream.isReady(trianglesCountRange))
+        return false;
+
+    if(stagesRecorded && !pollStageTimings(stageDurations))
+        return false;
+    stagesRecorded = false;
+
+    if(!pollDurationRecording(generationDuration))
+        return false;
+
+    statisticsStream.wait(verticesCountRange);
+    statisticsStream.wait(trianglesCountRange);
+    numVertices = *(GLuint*)statisticsStream.pointer(verticesCountRange);
+    numTriangles = *(GLuint*)statisticsStream.pointer(trianglesCountRange);
+
+    statisticsPending = false;
+
+    return true;
+}
+
+void MarchingCubes::uploadParameters()
+{
+    Parameters params;
+
+    params.densityGridDims[0] = densityGrid.x;
+    params.densityGridDims[1] = densityGrid.y;
+    params.densityGridDims[2] = densityGrid.z;
+    params.cubeSize = cubeSize;
+    params.cubeGridDims[0] = cubeGrid.x;
+    params.cubeGridDims[1] = cubeGrid.y;
+    params.cubeGridDims[2] = cubeGrid.z;
+    params.surfaceLevel = surfaceLevel;
+    params.offset[0] = noise.offset.x;
+    params.offset[1] = noise.offset.y;
+    params.offset[2] = noise.offset.z;
+    params.octaves = noise.octaves;
+    params.lacunarity = noise.lacunarity;
+    params.persistence = noise.persistence;
+    params.noiseScale = noise.noiseScale;
+    params.noiseWeight = noise.noiseWeight;
+    params.floorOffset = noise.floorOffset;
+    params.closeEdges = noise.closeEdges;
+    params.hardFloor = noise.hardFloor;
+    params.floorWeight = noise.floorWeight;
+    params.stepSize = noise.stepSize;
+    params.stepWeight = noise.stepWeight;
+    params.seed = noise.offsetSeed;
+    params.padding = 0;
+
+    parameters.streamSubData(0, sizeof(Parameters), &params);
 }
 
 MarchingCubes::Coord::Coord(int _i, int _j, int _k) : i(_i), j(_j), k(_k)
@@ -146,69 +362,291 @@ int MarchingCubes::pointIndex(Coord c)
 
 void MarchingCubes::removeSmallRegions()
 {
-    // 3D floodfill algorithm to detect regions of points with values above the surface level (i.e. solid regions)
-    // and sets the point density value under the surface level to ignore it if the region size is under minRegionSize
+    // detects the connected regions of points with values above the surface level (i.e. solid regions)
+    // and sets the density value under the surface level in the regions smaller than minRegionSize.
+    // The regions are labeled on the narrow band copy of the density, and only the bricks
+    // which changed are written back to the density buffer
 
     Point *points = (Point*)density.map(0, densityGrid.count * sizeof(Point), GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
 
-    std::vector<bool> visited(densityGrid.count, false);
+    buildVolume(points);
 
-    for(int i = 0; i < densityGrid.x; i++){
-        for(int j = 0; j < densityGrid.y; j++){
-            for(int k = 0; k < densityGrid.z; k++){
+    int* changedBricks = Arena::generation().allocateArray<int>(volume.getNumBricks());
+    int numChanged = volume.removeSmallRegions(minRegionSize, changedBricks);
 
-                Coord c(i, j, k);
-                int index = pointIndex(c);
+    ThreadPool::global().parallelFor("regions.write", 0, numChanged, 1, [&](int begin, int end){
+        for(int c = begin; c < end; c++){
+            int first[3], last[3];
+            volume.getBrickBounds(changedBricks[c], first, last);
+            for(int i = first[0]; i < last[0]; i++)
+                for(int j = first[1]; j < last[1]; j++)
+                    for(int k = first[2]; k < last[2]; k++)
+                        points[pointIndex(Coord(i, j, k))].val = volume.value(i, j, k);
+        }
+    });
 
-                if(!visited[index] && points[index].val > surfaceLevel){
-                    std::vector<int> region;
+    density.unmap();
+}
 
-                    getRegionPoints(c, points, visited, region);
+void MarchingCubes::buildVolume(const Point* points)
+{
+    volume.build(&points[0].val, sizeof(Point) / sizeof(float), densityGrid.x, densityGrid.y, densityGrid.z, surfaceLevel);
+    hasVolume = true;
 
-                    if(region.size() < (unsigned int)minRegionSize){
-                        for(auto it = region.begin(); it != region.end(); ++it)
-                            points[*it].val = surfaceLevel - 1.f;
-                    }
-                }
-            }
-        }
+    numVolumeBricks = volume.getNumBricks();
+    numStoredBricks = volume.getNumStoredBricks();
+    volumeBytes = volume.getBytes();
+    denseVolumeBytes = volume.getDenseBytes();
+}
+
+void MarchingCubes::processMesh()
+{
+    // the mesh is read back, processed on the CPU and written back in place,
+    // the number of indices of the indirect draw only changes when it is simplified
+
+    PackedVertex *packed;
+    uint32_t *indices;
+    GLuint vertexCount, indexCount;
+    if(!readPackedMesh(packed, vertexCount, indices, indexCount))
+        return;
+
+    int numUsed = vertexCount;
+
+    if(simplifyMesh)
+        simplify(packed, vertexCount, indices, indexCount);
+
+    if(optimizeMesh){
+        cacheMissRatioBefore = MeshOptimizer::cacheMissRatio(indices, indexCount, vertexCount, vertexCacheSize);
+        MeshOptimizer::optimizeVertexCache(indices, indexCount, vertexCount, vertexCacheSize);
     }
 
-    density.unmap();
+    if(useMeshlets)
+        buildMeshlets(packed, vertexCount, indices, indexCount);
+
+    // the vertices left by the simplification are also packed at the start
+    if(optimizeMesh || simplifyMesh)
+        numUsed = MeshOptimizer::optimizeVertexFetch(indices, indexCount, packed, sizeof(PackedVertex), vertexCount);
+    if(optimizeMesh)
+        cacheMissRatioAfter = MeshOptimizer::cacheMissRatio(indices, indexCount, numUsed, vertexCacheSize);
+
+    vertices.setSubData(sizeof(GLuint), numUsed * sizeof(PackedVertex), packed);
+    triangles.setSubData(sizeof(GLuint), indexCount * sizeof(GLuint), indices);
+
+    if(simplifyMesh){
+        // the counters are read for the statistics, and the draw uses the new count
+        GLuint vertexCounter = numUsed;
+        GLuint triangleCounter = indexCount / 3;
+        vertices.setSubData(0, sizeof(GLuint), &vertexCounter);
+        triangles.setSubData(0, sizeof(GLuint), &triangleCounter);
+        indirect.setSubData(offsetof(IndirectArguments, count), sizeof(GLuint), &indexCount);
+    }
 }
 
-void MarchingCubes::getRegionPoints(Coord start, Point* points, std::vector<bool>& visited, std::vector<int>& region)
+void MarchingCubes::simplify(const PackedVertex* packed, GLuint vertexCount, uint32_t* indices, GLuint& indexCount)
 {
-    int startIndex = pointIndex(start);
-    visited[startIndex] = true;
-    region.push_back(startIndex);
+    auto start = std::chrono::steady_clock::now();
+
+    // the collapsed vertices are still in the packed array, unused
+    float *positions = decodePositions(packed, vertexCount);
+    int targetIndices = (int)(indexCount * std::min(std::max(simplifyRatio, 0.f), 1.f));
+    float error = 0.f;
 
-    std::queue<Coord> q;
-    q.push(start);
+    trianglesBeforeSimplification = indexCount / 3;
+    indexCount = MeshSimplifier::simplify(indices, indexCount, positions, vertexCount, getBoxMin(), getBoxSize(),
+                                          targetIndices, simplifyError * cubeSize, error);
+    simplificationError = error / cubeSize;
 
-    while(!q.empty()){
-        Coord c = q.front();
-        q.pop();
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    simplificationDuration = elapsed.count();
+}
 
-        appendRegionPoint(Coord(c.i-1, c.j, c.k), points, visited, region, q);
-        appendRegionPoint(Coord(c.i+1, c.j, c.k), points, visited, region, q);
-        appendRegionPoint(Coord(c.i, c.j-1, c.k), points, visited, region, q);
-        appendRegionPoint(Coord(c.i, c.j+1, c.k), points, visited, region, q);
-        appendRegionPoint(Coord(c.i, c.j, c.k-1), points, visited, region, q);
-        appendRegionPoint(Coord(c.i, c.j, c.k+1), points, visited, region, q);
+float* MarchingCubes::decodePositions(const PackedVertex* packed, GLuint vertexCount)
+{
+    vec3d boxMin = getBoxMin(), boxSize = getBoxSize();
+    float *positions = Arena::generation().allocateArray<float>(vertexCount * 3);
+    ThreadPool::global().parallelFor("mesh.decode", 0, vertexCount, 1 << 14, [&](int begin, int end){
+        float normal[3];
+        for(int i = begin; i < end; i++)
+            packed[i].decode(boxMin, boxSize, &positions[i * 3], normal);
+    });
+    return positions;
+}
+
+void MarchingCubes::buildMeshlets(const PackedVertex* packed, GLuint vertexCount, uint32_t* indices, GLuint indexCount)
+{
+    // the cells keep the order of the triangles inside them
+    int cellSize = std::max(meshletSize, 1);
+    int cellsX = (cubeGrid.x + cellSize - 1) / cellSize;
+    int cellsY = (cubeGrid.y + cellSize - 1) / cellSize;
+    int cellsZ = (cubeGrid.z + cellSize - 1) / cellSize;
+    // the bounds are computed on the decoded positions
+    float *positions = decodePositions(packed, vertexCount);
+
+    meshlets.build(indices, indexCount, positions, getBoxMin(), cellSize * cubeSize, cellsX, cellsY, cellsZ);
+
+    numMeshlets = (int)meshlets.meshlets.size();
+    hasMeshlets = true;
+
+    // room for the commands of three frames in flight
+    size_t commandsSize = numMeshlets * sizeof(Meshlets::DrawCommand) * 3 + 1024;
+    if(drawCommands.size < commandsSize){
+        if(drawCommands.size > 0)
+            drawCommands.deleteBuffer();
+        drawCommands = StreamBuffer(commandsSize, GL_MAP_WRITE_BIT);
     }
 }
 
-void MarchingCubes::appendRegionPoint(Coord c, Point* points, std::vector<bool>& visited, std::vector<int>& region, std::queue<Coord>& q)
+uint64_t MarchingCubes::generationKey()
 {
-    if(c.i >= 0 && c.i < densityGrid.x && c.j >= 0 && c.j <= densityGrid.y && c.k >= 0 && c.k < densityGrid.z){
-        int index = pointIndex(c);
-        if(!visited[index] && points[index].val > surfaceLevel){
-            visited[index] = true;
-            region.push_back(index);
-            q.push(c);
+    // hashed value by value, the structures have padding
+    uint32_t version = MeshFileHeader::currentVersion;
+    int integers[13] = {
+        cubeGrid.x, cubeGrid.y, cubeGrid.z,
+        noise.octaves, noise.closeEdges, noise.offsetSeed, minRegionSize,
+        optimizeMesh, optimizeMesh ? vertexCacheSize : 0,
+        useMeshlets, useMeshlets ? meshletSize : 0,
+        simplifyMesh, surfaceNets
+    };
+    float floats[16] = {
+        simplifyMesh ? simplifyRatio : 0.f, simplifyMesh ? simplifyError : 0.f,
+        cubeSize, surfaceLevel,
+        noise.offset.x, noise.offset.y, noise.offset.z,
+        noise.noiseScale, noise.lacunarity, noise.persistence,
+        noise.stepSize, noise.stepWeight,
+        noise.floorOffset, noise.hardFloor, noise.floorWeight,
+        noise.noiseWeight
+    };
+
+    uint64_t key = MeshCache::hash(&version, sizeof(version));
+    key = MeshCache::hash(integers, sizeof(integers), key);
+    key = MeshCache::hash(floats, sizeof(floats), key);
+    return key;
+}
+
+bool MarchingCubes::loadCachedMesh()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if(!cache.load(generationKey()))
+        return false;
+
+    // the cubes are needed by the boids
+    const MeshFileHeader& header = cache.header();
+    if(header.numCubes != (uint32_t)cubeGrid.count){
+        cache.release();
+        return false;
+    }
+
+    GLuint vertexCount = header.numVertices;
+    GLuint indexCount = header.numIndices;
+    GLuint triangleCount = indexCount / 3;
+
+    // the mapped arrays are uploaded as they are, after the counters
+    vertices.resize(0);
+    vertices.resize(vertexCount * sizeof(PackedVertex) + sizeof(GLuint));
+    vertices.setSubData(0, sizeof(GLuint), &vertexCount);
+    vertices.setSubData(sizeof(GLuint), vertexCount * sizeof(PackedVertex), cache.vertices());
+
+    triangles.resize(0);
+    triangles.resize(indexCount * sizeof(GLuint) + sizeof(GLuint));
+    triangles.setSubData(0, sizeof(GLuint), &triangleCount);
+    triangles.setSubData(sizeof(GLuint), indexCount * sizeof(GLuint), cache.indices());
+
+    IndirectArguments arguments = {indexCount, 1, (GLuint)((triangles.offset + sizeof(GLuint)) / sizeof(GLuint)), 0, 0};
+    indirect.streamSubData(0, sizeof(IndirectArguments), &arguments);
+
+    // the boids only read the configuration of the cubes
+    const int cubeInts = 13;
+    const uint8_t *configurations = cache.cubes();
+    GLint *cubeData = Arena::generation().allocateArray<GLint>((size_t)cubeGrid.count * cubeInts);
+    ThreadPool::global().parallelFor("cache.cubes", 0, cubeGrid.count, 1 << 14, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            GLint *cube = &cubeData[(size_t)i * cubeInts];
+            for(int j = 0; j < 12; j++)
+                cube[j] = -1;
+            cube[12] = configurations[i];
         }
+    });
+    cubes.setSubData(0, (size_t)cubeGrid.count * cubeInts * sizeof(GLint), cubeData);
+
+    // the stored indices are already sorted by meshlet, only the bounds are computed again
+    hasMeshlets = false;
+    if(useMeshlets && indexCount > 0){
+        uint32_t *indices = Arena::generation().allocateArray<uint32_t>(indexCount);
+        memcpy(indices, cache.indices(), indexCount * sizeof(uint32_t));
+        buildMeshlets(cache.vertices(), vertexCount, indices, indexCount);
     }
+
+    cache.release();
+
+    numVertices = vertexCount;
+    numTriangles = triangleCount;
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    generationDuration = elapsed.count();
+    stageDurations.clear();
+    stageDurations.push_back(std::make_pair("cacheLoad", generationDuration));
+    cachedStatistics = true;
+
+    return true;
+}
+
+void MarchingCubes::storeCachedMesh()
+{
+    // blocking, only done when the mesh was not in the cache
+    PackedVertex *packed;
+    uint32_t *indices;
+    GLuint vertexCount, indexCount;
+    if(!readPackedMesh(packed, vertexCount, indices, indexCount))
+        return;
+
+    const int cubeInts = 13;
+    size_t numInts = (size_t)cubeGrid.count * cubeInts;
+    GLint *cubeData = Arena::generation().allocateArray<GLint>(numInts);
+    cubes.getSubData(0, numInts * sizeof(GLint), cubeData);
+
+    uint8_t *configurations = Arena::generation().allocateArray<uint8_t>(cubeGrid.count);
+    for(int i = 0; i < cubeGrid.count; i++)
+        configurations[i] = (uint8_t)cubeData[(size_t)i * cubeInts + 12];
+
+    cache.store(generationKey(), packed, vertexCount, indices, indexCount, configurations, cubeGrid.count, getBoxMin(), getBoxSize());
+}
+
+bool MarchingCubes::readPackedMesh(PackedVertex*& packed, GLuint& vertexCount, uint32_t*& indices, GLuint& indexCount)
+{
+    // the mesh must have fit in the buffers
+    fitOutputBuffers();
+
+    // the triangles counter counts triangles, not indices
+    GLuint triangleCount = 0;
+    vertices.getSubData(0, sizeof(GLuint), &vertexCount);
+    triangles.getSubData(0, sizeof(GLuint), &triangleCount);
+    indexCount = triangleCount * 3;
+    if(indexCount == 0)
+        return false;
+
+    Arena& arena = Arena::generation();
+    packed = arena.allocateArray<PackedVertex>(vertexCount);
+    indices = arena.allocateArray<uint32_t>(indexCount);
+
+    vertices.getSubData(sizeof(GLuint), vertexCount * sizeof(PackedVertex), packed);
+    triangles.getSubData(sizeof(GLuint), indexCount * sizeof(GLuint), indices);
+
+    for(GLuint i = 0; i < indexCount; i++){
+        if(indices[i] >= vertexCount)
+            return false;
+    }
+    return true;
+}
+
+vec3d MarchingCubes::getBoxMin()
+{
+    return vec3d(-size.x / 2.f, -size.y / 2.f, -size.z / 2.f);
+}
+
+vec3d MarchingCubes::getBoxSize()
+{
+    return vec3d(size.x, size.y, size.z);
 }
 
 Buffer* MarchingCubes::getCubesBuffer()
@@ -226,27 +664,150 @@ MarchingCubes::Volume MarchingCubes::getCubeGrid()
     return cubeGrid;
 }
 
-void MarchingCubes::draw()
+void MarchingCubes::draw(vec3d eye, const Frustum& frustum)
 {
     glEnable(GL_COLOR_MATERIAL);
     glEnable(GL_LIGHTING);
 
     glColor3f(color.r, color.g, color.b);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vertices.id);
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glVertexPointer(3, GL_FLOAT, 0, (void*)(sizeof(GLuint)));
+    // the vertices are decoded by the vertex shader
+    glUseProgram(renderProgram);
+    vec3d boxMin = getBoxMin(), boxSize = getBoxSize();
+    glUniform3f(boxMinLocation, boxMin.x, boxMin.y, boxMin.z);
+    glUniform3f(boxSizeLocation, boxSize.x, boxSize.y, boxSize.z);
 
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glNormalPointer(GL_FLOAT, 0, (void*)(sizeof(float)*3*maxNumVertices+sizeof(GLuint)));
+    glBindBuffer(GL_ARRAY_BUFFER, vertices.id);
+        glEnableVertexAttribArray(0);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(PackedVertex), (void*)(vertices.offset+sizeof(GLuint)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangles.id);
-        glDrawElements(GL_TRIANGLES, numTriangles*3, GL_UNSIGNED_INT, (void*)(sizeof(GLuint)));
+
+    if(hasMeshlets){
+        // only the meshlets that may be visible are drawn, from commands written into the ring
+        Meshlets::DrawCommand *commands = Arena::frame().allocateArray<Meshlets::DrawCommand>(numMeshlets);
+        GLuint firstIndex = (GLuint)((triangles.offset + sizeof(GLuint)) / sizeof(GLuint));
+        numVisibleMeshlets = meshlets.cull(frustum, eye, firstIndex, commands);
+
+        if(numVisibleMeshlets > 0){
+            size_t commandsSize = numVisibleMeshlets * sizeof(Meshlets::DrawCommand);
+            StreamBuffer::Range range = drawCommands.allocate(commandsSize);
+            memcpy(drawCommands.pointer(range), commands, commandsSize);
+
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommands.id);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)range.offset, numVisibleMeshlets, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+            drawCommands.fence(range);
+        }
+    } else {
+        // The number of indices is written by the triangulation stage
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.id);
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)indirect.offset);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableVertexAttribArray(0);
+    glUseProgram(0);
+}
+
+void MarchingCubes::readMesh(std::vector<float>& positions, std::vector<float>& meshNormals, std::vector<GLuint>& indices)
+{
+    PackedVertex *packed;
+    uint32_t *packedIndices;
+    GLuint vertexCount, indexCount;
+    if(!readPackedMesh(packed, vertexCount, packedIndices, indexCount)){
+        positions.clear();
+        meshNormals.clear();
+        indices.clear();
+        return;
+    }
+
+    positions.resize(vertexCount * 3);
+    meshNormals.resize(vertexCount * 3);
+    indices.assign(packedIndices, packedIndices + indexCount);
+
+    vec3d boxMin = getBoxMin(), boxSize = getBoxSize();
+    for(GLuint i = 0; i < vertexCount; i++)
+        packed[i].decode(boxMin, boxSize, &positions[i * 3], &meshNormals[i * 3]);
+}
+
+void MarchingCubes::readVolume(SparseVolume& copy)
+{
+    // a cached mesh comes without its density, which is generated again
+    if(!hasVolume && cacheHit){
+        density.setBindingPoint(NOISE_SSB_BP);
+        uploadParameters();
+        parameters.setBindingPoint(PARAMETERS_UB_BP);
+        useProgram(densityCompute);
+        runComputeShader();
+        if(minRegionSize > 0)
+            removeSmallRegions();
+    }
+
+    // without the flood fill, the density is read back the first time the volume is needed
+    if(!hasVolume){
+        Point *points = Arena::generation().allocateArray<Point>(densityGrid.count);
+        density.getSubData(0, densityGrid.count * sizeof(Point), points);
+        buildVolume(points);
+    }
+
+    copy = volume;
+}
+
+uint64_t MarchingCubes::meshHash()
+{
+    std::vector<float> positions, meshNormals;
+    std::vector<GLuint> indices;
+    readMesh(positions, meshNormals, indices);
+
+    // vertices and triangles are appended with atomic counters so their order
+    // changes between runs : each triangle is hashed separately from its
+    // quantized positions starting at its smallest vertex (keeping the winding),
+    // and the triangle hashes are summed
+    const float quantization = 1024.f / cubeSize;
+    uint64_t hash = 0;
+
+    for(size_t t = 0; t + 2 < indices.size(); t += 3){
+        int32_t q[3][3];
+        for(int v = 0; v < 3; v++){
+            for(int c = 0; c < 3; c++)
+                q[v][c] = (int32_t)floorf(positions[indices[t+v]*3+c] * quantization + 0.5f);
+        }
+
+        int first = 0;
+        for(int v = 1; v < 3; v++){
+            if(std::lexicographical_compare(q[v], q[v]+3, q[first], q[first]+3))
+                first = v;
+        }
+
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for(int v = 0; v < 3; v++){
+            for(int c = 0; c < 3; c++){
+                uint32_t x = (uint32_t)q[(first+v)%3][c];
+                for(int b = 0; b < 4; b++){
+                    h ^= (x >> (8*b)) & 0xFF;
+                    h *= 1099511628211ULL;
+                }
+            }
+        }
+        hash += h;
+    }
+
+    return hash;
+}
+
+bool MarchingCubes::exportMesh(MeshExporter& exporter, const std::string& path)
+{
+    // the counts are read back asynchronously with the statistics
+    if(hasPendingStatistics() || numTriangles == 0)
+        return false;
+
+    return exporter.request(path, vertices, sizeof(GLuint), numVertices, triangles, sizeof(GLuint), numTriangles * 3, getBoxMin(), getBoxSize());
 }
 
 void MarchingCubes::updateDispatchParams()
@@ -254,7 +815,11 @@ void MarchingCubes::updateDispatchParams()
     densityCompute.dispatchParams = calculateOptimalDisptachSpace(densityGrid.x, densityGrid.y, densityGrid.z);
     normalsCompute.dispatchParams = densityCompute.dispatchParams;
     marchingCubesCompute.dispatchParams = calculateOptimalDisptachSpace(cubeGrid.x, cubeGrid.y, cubeGrid.z);
+    countCompute.dispatchParams = marchingCubesCompute.dispatchParams;
     trianglesCompute.dispatchParams = calculateOptimalDisptachSpace(cubeGrid.count, 1, 1);
+    surfaceNetsCountCompute.dispatchParams = marchingCubesCompute.dispatchParams;
+    surfaceNetsCompute.dispatchParams = marchingCubesCompute.dispatchParams;
+    surfaceNetsQuadsCompute.dispatchParams = marchingCubesCompute.dispatchParams;
 }
 
 void MarchingCubes::createPrograms()
@@ -265,76 +830,118 @@ void MarchingCubes::createPrograms()
 
     densityCompute = ComputeProgram("Density.glsl", densityDispatch);
     normalsCompute = ComputeProgram("Normals.glsl", densityDispatch);
+    countCompute = ComputeProgram("Count.glsl", marchingCubesDispatch);
     marchingCubesCompute = ComputeProgram("MarchingCubes.glsl", marchingCubesDispatch);
     trianglesCompute = ComputeProgram("Triangles.glsl", trianglesDispatch);
+    surfaceNetsCountCompute = ComputeProgram("SurfaceNetsCount.glsl", marchingCubesDispatch);
+    surfaceNetsCompute = ComputeProgram("SurfaceNets.glsl", marchingCubesDispatch);
+    surfaceNetsQuadsCompute = ComputeProgram("SurfaceNetsQuads.glsl", marchingCubesDispatch);
+    drawArgumentsCompute = ComputeProgram("DrawArguments.glsl", DispatchParams(Volume(1, 1, 1), Volume(1, 1, 1)));
+
+    renderProgram = createRenderProgram("Terrain.vert", "Terrain.frag");
+    boxMinLocation = glGetUniformLocation(renderProgram, "boxMin");
+    boxSizeLocation = glGetUniformLocation(renderProgram, "boxSize");
 
     hasPrograms = true;
 }
 
 void MarchingCubes::createBuffers()
 {
+    size_t densitySize = densityGrid.count * 4 * sizeof(float);
+    size_t normalsSize = densityGrid.count * 3 * sizeof(float);
+    size_t cubesSize = cubeGrid.count * 13 * sizeof(int);
+
+    if(!hasArena){
+        gridArena = BufferArena(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY);
+        hasArena = true;
+    }
+
+    // Make sure all the buffers fit in one block, only reallocates if the grid grew
+    gridArena.reserve(gridArena.align(densitySize) + gridArena.align(normalsSize) + gridArena.align(cubesSize));
+
     // Generate the density grid for noise
-    density = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, densityGrid.count * 4 * sizeof(float));
+    density = gridArena.allocate(densitySize);
 
     // Generate the normals buffer
-    normals = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, densityGrid.count * 3 * sizeof(float));
+    normals = gridArena.allocate(normalsSize);
 
     // Generate the cubes buffer
-    cubes = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, cubeGrid.count * 13 * sizeof(int));
+    cubes = gridArena.allocate(cubesSize);
 
-    // Generate the vertices buffer
-    vertices = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, maxNumVertices * 2 * 3 * sizeof(float) + sizeof(GLuint));
-    // Generate the triangles buffer
-    triangles = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, maxNumTriangles * 3 * sizeof(int) + sizeof(GLuint));
+    // The vertices and triangles buffers are sized on each generation, they do not depend on the grid
+    if(vertices.capacity == 0){
+        vertices = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, sizeof(GLuint));
+        triangles = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, sizeof(GLuint));
+    }
 
-    // Load the edge and triangulation table into a buffer
-    int *flatTriTable = flattenTriTable();
-    tables = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_DRAW, (256+256*16)*sizeof(int));
-    tables.setSubData(0, sizeof(edgeTable), edgeTable);
-    tables.setSubData(sizeof(edgeTable), 256*16*sizeof(int), flatTriTable);
-    delete[] flatTriTable;
+    // Load the compact edge and triangulation tables into a buffer, see Tables.h
+    tables = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_DRAW, sizeof(compactTables.cases) + sizeof(compactTables.packedEdges));
+    tables.setSubData(0, sizeof(compactTables.cases), compactTables.cases);
+    tables.setSubData(sizeof(compactTables.cases), sizeof(compactTables.packedEdges), compactTables.packedEdges);
 
-    hasBuffers = true;
-}
+    // Uniform buffer for the generation parameters
+    parameters = Buffer(GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW, sizeof(Parameters));
 
-int* MarchingCubes::flattenTriTable()
-{
-    int *flatTriTable = new int[256*16];
-    int flatTriIndex = 0;
-    for(int i = 0; i < 256; i++){
-        for(int j = 0; j < 16; j++){
-            flatTriTable[flatTriIndex] = triTable[i][j];
-            flatTriIndex++;
-        }
-    }
-    return flatTriTable;
+    // Indirect draw arguments, and the ring to read back the counters
+    indirect = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, sizeof(IndirectArguments));
+    counts = Buffer(GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_COPY, 2 * sizeof(GLuint));
+    statisticsStream = StreamBuffer(4096, GL_MAP_READ_BIT);
+
+    hasBuffers = true;
 }
 
 void MarchingCubes::deletePrograms()
 {
     glDeleteProgram(densityCompute.id);
     glDeleteProgram(normalsCompute.id);
+    glDeleteProgram(countCompute.id);
     glDeleteProgram(marchingCubesCompute.id);
     glDeleteProgram(trianglesCompute.id);
+    glDeleteProgram(surfaceNetsCountCompute.id);
+    glDeleteProgram(surfaceNetsCompute.id);
+    glDeleteProgram(surfaceNetsQuadsCompute.id);
+    glDeleteProgram(drawArgumentsCompute.id);
+    glDeleteProgram(renderProgram);
 
     hasPrograms = false;
 }
 
-void MarchingCubes::deleteBuffers()
+void MarchingCubes::releaseBuffers()
 {
-    cubes.deleteBuffer();
-    density.deleteBuffer();
+    // the grid buffers go back to the arena, which keeps its memory for the next ones
+    gridArena.reset();
+
     tables.deleteBuffer();
-    triangles.deleteBuffer();
-    vertices.deleteBuffer();
-    normals.deleteBuffer();
+    parameters.deleteBuffer();
+    indirect.deleteBuffer();
+    counts.deleteBuffer();
+    statisticsStream.deleteBuffer();
 
     numVertices = 0;
     numTriangles = 0;
 
+    // the meshlets refer to the released index buffer
+    hasMeshlets = false;
+    numMeshlets = 0;
+
     hasBuffers = false;
 }
 
+void MarchingCubes::deleteBuffers()
+{
+    releaseBuffers();
+
+    vertices.deleteBuffer();
+    triangles.deleteBuffer();
+    if(drawCommands.size > 0)
+        drawCommands.deleteBuffer();
+
+    if(hasArena){
+        gridArena.deleteArena();
+        hasArena = false;
+    }
+}
+
 MarchingCubes::~MarchingCubes()
 {
 
@@ -0,0 +1,128 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+
+
+MeshCache::MeshCache()
+{
+
+}
+
+uint64_t MeshCache::hash(const void* data, size_t size, uint64_t previous)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t h = previous;
+    for(size_t i = 0; i < size; i++){
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string MeshCache::path(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool MeshCache::load(uint64_t key)
+{
+    release();
+
+    if(!file.open(path(key))){
+        misses++;
+        return false;
+    }
+
+    // a truncated or older file is a miss, it is overwritten by the next store
+    if(file.size() < sizeof(MeshFileHeader)){
+        release();
+        misses++;
+        return false;
+    }
+    memcpy(&loaded, file.data(), sizeof(MeshFileHeader));
+    if(!loaded.isValid(file.size())){
+        release();
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+void MeshCache::release()
+{
+    file.close();
+}
+
+const MeshFileHeader& MeshCache::header()
+{
+    return loaded;
+}
+
+const PackedVertex* MeshCache::vertices()
+{
+    return (const PackedVertex*)(file.data() + loaded.verticesOffset);
+}
+
+const uint32_t* MeshCache::indices()
+{
+    return (const uint32_t*)(file.data() + loaded.indicesOffset);
+}
+
+const uint8_t* MeshCache::cubes()
+{
+    return loaded.numCubes > 0 ? (const uint8_t*)(file.data() + loaded.cubesOffset) : nullptr;
+}
+
+bool MeshCache::store(uint64_t key, const PackedVertex* _vertices, uint32_t numVertices, const uint32_t* _indices, uint32_t numIndices,
+                      const uint8_t* _cubes, uint32_t numCubes, vec3d boxMin, vec3d boxSize)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    float boxMinArray[3] = {boxMin.x, boxMin.y, boxMin.z};
+    float boxSizeArray[3] = {boxSize.x, boxSize.y, boxSize.z};
+    MeshFileHeader header;
+    header.init(numVertices, numIndices, _cubes != nullptr ? numCubes : 0, boxMinArray, boxSizeArray);
+
+    // written under another name then renamed, a file with the final name is always complete
+    std::string finalPath = path(key);
+    std::string temporaryPath = finalPath + ".tmp";
+
+    MappedFile output;
+    if(!output.create(temporaryPath)){
+        printf("Could not write the mesh cache file %s\n", temporaryPath.c_str());
+        return false;
+    }
+
+    char zeros[16] = {};
+    bool written = output.reserve(header.cubesOffset + header.numCubes);
+    written = written && output.write(&header, sizeof(header));
+    written = written && output.write(zeros, header.verticesOffset - output.size());
+    written = written && output.write(_vertices, (size_t)numVertices * sizeof(PackedVertex));
+    written = written && output.write(zeros, header.indicesOffset - output.size());
+    written = written && output.write(_indices, (size_t)numIndices * sizeof(uint32_t));
+    if(header.numCubes > 0){
+        written = written && output.write(zeros, header.cubesOffset - output.size());
+        written = written && output.write(_cubes, numCubes);
+    }
+    output.close();
+
+    if(!written){
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+    std::filesystem::rename(temporaryPath, finalPath, error);
+    return !error;
+}
+
+MeshCache::~MeshCache()
+{
+
+}
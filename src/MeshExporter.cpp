@@ -0,0 +1,272 @@
+#include "MeshExporter.h"
+
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#define EXPORT_ALIGNMENT 256
+
+
+MeshExporter::MeshExporter() : state(IDLE)
+{
+
+}
+
+MeshExporter::Format MeshExporter::formatOf(const std::string& _path)
+{
+    size_t dot = _path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : _path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension == "ply" ? PLY : GLB;
+}
+
+bool MeshExporter::request(const std::string& _path, Buffer& vertices, size_t verticesOffset, GLuint _vertexCount,
+                           Buffer& indices, size_t indicesOffset, GLuint _indexCount, vec3d _boxMin, vec3d _boxSize)
+{
+    if(isBusy())
+        return false;
+
+    path = _path;
+    format = formatOf(path);
+    vertexCount = _vertexCount;
+    indexCount = _indexCount;
+    boxMin = _boxMin;
+    boxSize = _boxSize;
+
+    size_t verticesBytes = (size_t)vertexCount * sizeof(PackedVertex);
+    size_t indicesBytes = (size_t)indexCount * sizeof(uint32_t);
+    indicesStart = (verticesBytes + EXPORT_ALIGNMENT - 1) / EXPORT_ALIGNMENT * EXPORT_ALIGNMENT;
+    size_t total = std::max(indicesStart + indicesBytes, (size_t)EXPORT_ALIGNMENT);
+
+    // the staging buffer is only reallocated for a larger mesh
+    if(staging.size < total){
+        if(staging.size > 0)
+            staging.deleteBuffer();
+        staging = StreamBuffer(total, GL_MAP_READ_BIT);
+    }
+
+    // both arrays in a single range, so that one fence covers them
+    range = staging.allocate(total);
+    if(verticesBytes > 0)
+        glCopyNamedBufferSubData(vertices.id, staging.id, vertices.offset + verticesOffset, range.offset, verticesBytes);
+    if(indicesBytes > 0)
+        glCopyNamedBufferSubData(indices.id, staging.id, indices.offset + indicesOffset, range.offset + indicesStart, indicesBytes);
+    staging.fence(range);
+    glFlush();
+
+    state.store(COPYING, std::memory_order_release);
+    return true;
+}
+
+bool MeshExporter::poll(Result& _result)
+{
+    int current = state.load(std::memory_order_acquire);
+
+    if(current == COPYING && staging.isReady(range)){
+        // the mapped range is complete and is not touched by the GPU until the next request
+        staging.wait(range);
+        state.store(WRITING, std::memory_order_release);
+        writer = std::thread(&MeshExporter::write, this);
+        return false;
+    }
+
+    if(current != DONE)
+        return false;
+
+    writer.join();
+    _result = result;
+    state.store(IDLE, std::memory_order_release);
+    return true;
+}
+
+bool MeshExporter::isBusy()
+{
+    return state.load(std::memory_order_acquire) != IDLE;
+}
+
+const PackedVertex* MeshExporter::packedVertices()
+{
+    return (const PackedVertex*)staging.pointer(range);
+}
+
+const uint32_t* MeshExporter::packedIndices()
+{
+    return (const uint32_t*)((const char*)staging.pointer(range) + indicesStart);
+}
+
+void MeshExporter::write()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    result = Result();
+    result.path = path;
+
+    file = fopen(path.c_str(), "wb");
+    if(file != NULL){
+        chunk.resize(chunkSize);
+        chunkUsed = 0;
+        written = 0;
+        failed = false;
+
+        if(format == PLY)
+            writePly();
+        else
+            writeGlb();
+
+        flushChunk();
+        failed = fclose(file) != 0 || failed;
+        file = nullptr;
+
+        result.success = !failed;
+        result.bytes = written;
+    }
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    result.duration = elapsed.count();
+    if(result.duration > 0.f)
+        result.throughput = (float)result.bytes / (1024.f * 1024.f) / (result.duration / 1000.f);
+
+    state.store(DONE, std::memory_order_release);
+}
+
+void MeshExporter::writePly()
+{
+    char header[512];
+    int length = snprintf(header, sizeof(header),
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "comment Boids and Marching Cubes terrain\n"
+        "element vertex %u\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property float nx\nproperty float ny\nproperty float nz\n"
+        "element face %u\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n",
+        vertexCount, indexCount / 3);
+    append(header, length);
+
+    const PackedVertex* packed = packedVertices();
+    for(GLuint i = 0; i < vertexCount; i++){
+        float vertex[6];
+        packed[i].decode(boxMin, boxSize, &vertex[0], &vertex[3]);
+        append(vertex, sizeof(vertex));
+    }
+
+    const uint32_t* indices = packedIndices();
+    for(GLuint t = 0; t + 2 < indexCount; t += 3){
+        unsigned char count = 3;
+        append(&count, 1);
+        append(&indices[t], 3 * sizeof(uint32_t));
+    }
+}
+
+void MeshExporter::writeGlb()
+{
+    const PackedVertex* packed = packedVertices();
+
+    // the accessor of the positions needs their bounds
+    float lower[3] = {0.f, 0.f, 0.f}, upper[3] = {0.f, 0.f, 0.f};
+    for(GLuint i = 0; i < vertexCount; i++){
+        float position[3], normal[3];
+        packed[i].decode(boxMin, boxSize, position, normal);
+        for(int j = 0; j < 3; j++){
+            lower[j] = i == 0 ? position[j] : std::min(lower[j], position[j]);
+            upper[j] = i == 0 ? position[j] : std::max(upper[j], position[j]);
+        }
+    }
+
+    // binary chunk : positions, normals then indices, all multiples of 4 bytes
+    size_t positionsBytes = (size_t)vertexCount * 3 * sizeof(float);
+    size_t indicesBytes = (size_t)indexCount * sizeof(uint32_t);
+    size_t binaryBytes = positionsBytes * 2 + indicesBytes;
+
+    char json[2048];
+    int jsonLength = snprintf(json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Boids and Marching Cubes\"},"
+        "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2}]}],"
+        "\"buffers\":[{\"byteLength\":%zu}],"
+        "\"bufferViews\":["
+            "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu,\"target\":34962},"
+            "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34962},"
+            "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}],"
+        "\"accessors\":["
+            "{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+            "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+            "{\"bufferView\":2,\"componentType\":5125,\"count\":%u,\"type\":\"SCALAR\"}]}",
+        binaryBytes,
+        positionsBytes,
+        positionsBytes, positionsBytes,
+        positionsBytes * 2, indicesBytes,
+        vertexCount, lower[0], lower[1], lower[2], upper[0], upper[1], upper[2],
+        vertexCount,
+        indexCount);
+
+    // the JSON chunk is padded with spaces
+    while(jsonLength % 4 != 0)
+        json[jsonLength++] = ' ';
+
+    uint32_t header[3] = {0x46546C67, 2, (uint32_t)(12 + 8 + jsonLength + 8 + binaryBytes)};
+    append(header, sizeof(header));
+
+    uint32_t jsonChunk[2] = {(uint32_t)jsonLength, 0x4E4F534A};
+    append(jsonChunk, sizeof(jsonChunk));
+    append(json, jsonLength);
+
+    uint32_t binaryChunk[2] = {(uint32_t)binaryBytes, 0x004E4942};
+    append(binaryChunk, sizeof(binaryChunk));
+
+    for(int attribute = 0; attribute < 2; attribute++){
+        for(GLuint i = 0; i < vertexCount; i++){
+            float position[3], normal[3];
+            packed[i].decode(boxMin, boxSize, position, normal);
+            append(attribute == 0 ? position : normal, sizeof(position));
+        }
+    }
+
+    append(packedIndices(), indicesBytes);
+}
+
+void MeshExporter::append(const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while(size > 0){
+        size_t length = std::min(size, chunk.size() - chunkUsed);
+        memcpy(chunk.data() + chunkUsed, bytes, length);
+        chunkUsed += length;
+        bytes += length;
+        size -= length;
+
+        if(chunkUsed == chunk.size())
+            flushChunk();
+    }
+}
+
+void MeshExporter::flushChunk()
+{
+    if(chunkUsed == 0)
+        return;
+
+    if(fwrite(chunk.data(), 1, chunkUsed, file) != chunkUsed)
+        failed = true;
+
+    written += chunkUsed;
+    chunkUsed = 0;
+}
+
+void MeshExporter::deleteBuffer()
+{
+    if(writer.joinable())
+        writer.join();
+    state.store(IDLE);
+
+    if(staging.size > 0)
+        staging.deleteBuffer();
+}
+
+MeshExporter::~MeshExporter()
+{
+    if(writer.joinable())
+        writer.join();
+}
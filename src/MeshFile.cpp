@@ -0,0 +1,41 @@
+#include "MeshFile.h"
+
+#include <string.h>
+#include <PackedVertex.h>
+
+
+void MeshFileHeader::init(uint32_t _numVertices, uint32_t _numIndices, uint32_t _numCubes, const float _boxMin[3], const float _boxSize[3])
+{
+    memcpy(magic, "BMCM", 4);
+    version = currentVersion;
+    numVertices = _numVertices;
+    numIndices = _numIndices;
+    numCubes = _numCubes;
+
+    for(int i = 0; i < 3; i++){
+        boxMin[i] = _boxMin[i];
+        boxSize[i] = _boxSize[i];
+    }
+
+    verticesOffset = align(sizeof(MeshFileHeader));
+    indicesOffset = align(verticesOffset + (uint64_t)numVertices * sizeof(PackedVertex));
+    cubesOffset = align(indicesOffset + (uint64_t)numIndices * sizeof(uint32_t));
+    levelsOffset = align(cubesOffset + numCubes);
+    numLevels = 0;
+}
+
+bool MeshFileHeader::isValid(size_t fileSize) const
+{
+    if(fileSize < sizeof(MeshFileHeader) || memcmp(magic, "BMCM", 4) != 0 || version != currentVersion)
+        return false;
+
+    return verticesOffset + (uint64_t)numVertices * sizeof(PackedVertex) <= indicesOffset
+        && indicesOffset + (uint64_t)numIndices * sizeof(uint32_t) <= fileSize
+        && (numCubes == 0 || cubesOffset + numCubes <= fileSize)
+        && (numLevels == 0 || levelsOffset + (uint64_t)numLevels * sizeof(MeshFileLevel) <= fileSize);
+}
+
+uint64_t MeshFileHeader::align(uint64_t offset)
+{
+    return (offset + 15) / 16 * 16;
+}
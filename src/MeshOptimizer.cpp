@@ -0,0 +1,163 @@
+#include "MeshOptimizer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <Arena.h>
+
+
+float MeshOptimizer::cacheMissRatio(const uint32_t* indices, int numIndices, int numVertices, int cacheSize)
+{
+    int numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return 0.f;
+
+    // with a FIFO cache a vertex is still cached if less than cacheSize misses happened since it was loaded
+    int *loadTime = Arena::generation().allocateArray<int>(numVertices);
+    for(int i = 0; i < numVertices; i++)
+        loadTime[i] = -cacheSize - 1;
+
+    int misses = 0;
+    for(int i = 0; i < numTriangles * 3; i++){
+        uint32_t v = indices[i];
+        if(misses - loadTime[v] > cacheSize){
+            loadTime[v] = misses;
+            misses++;
+        }
+    }
+
+    return (float)misses / (float)numTriangles;
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, int numIndices, int numVertices, int cacheSize)
+{
+    Arena& arena = Arena::generation();
+
+    int numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+
+    // triangles around each vertex
+    int *liveTriangles = arena.allocateArray<int>(numVertices);
+    int *adjacencyOffset = arena.allocateArray<int>(numVertices + 1);
+    int *adjacency = arena.allocateArray<int>(numTriangles * 3);
+
+    memset(liveTriangles, 0, numVertices * sizeof(int));
+    for(int i = 0; i < numTriangles * 3; i++)
+        liveTriangles[indices[i]]++;
+
+    adjacencyOffset[0] = 0;
+    for(int v = 0; v < numVertices; v++)
+        adjacencyOffset[v+1] = adjacencyOffset[v] + liveTriangles[v];
+
+    int *fill = arena.allocateArray<int>(numVertices);
+    memcpy(fill, adjacencyOffset, numVertices * sizeof(int));
+    for(int t = 0; t < numTriangles; t++){
+        for(int k = 0; k < 3; k++)
+            adjacency[fill[indices[t*3+k]]++] = t;
+    }
+
+    int *cacheTime = arena.allocateArray<int>(numVertices);
+    memset(cacheTime, 0, numVertices * sizeof(int));
+
+    bool *emitted = arena.allocateArray<bool>(numTriangles);
+    memset(emitted, 0, numTriangles * sizeof(bool));
+
+    // vertices of the emitted triangles, to restart from when a fan ends
+    int *deadEnds = arena.allocateArray<int>(numTriangles * 3);
+    int numDeadEnds = 0;
+
+    int maxValence = 0;
+    for(int v = 0; v < numVertices; v++)
+        maxValence = std::max(maxValence, liveTriangles[v]);
+    int *candidates = arena.allocateArray<int>(maxValence * 3);
+
+    uint32_t *output = arena.allocateArray<uint32_t>(numTriangles * 3);
+    int numOutput = 0;
+
+    int time = cacheSize + 1;
+    int cursor = 0;
+    int fanning = 0;
+
+    while(fanning >= 0){
+        // emit all the remaining triangles around the fanning vertex
+        int numCandidates = 0;
+        for(int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning+1]; a++){
+            int t = adjacency[a];
+            if(emitted[t])
+                continue;
+            emitted[t] = true;
+
+            for(int k = 0; k < 3; k++){
+                int v = indices[t*3+k];
+                output[numOutput++] = v;
+                deadEnds[numDeadEnds++] = v;
+                candidates[numCandidates++] = v;
+                liveTriangles[v]--;
+                if(time - cacheTime[v] > cacheSize){
+                    cacheTime[v] = time;
+                    time++;
+                }
+            }
+        }
+
+        // next fanning vertex : the one among the candidates that will still be
+        // in the cache after its remaining triangles are emitted, and was loaded first
+        int best = -1;
+        int bestPriority = -1;
+        for(int c = 0; c < numCandidates; c++){
+            int v = candidates[c];
+            if(liveTriangles[v] <= 0)
+                continue;
+            int priority = 0;
+            if(time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if(priority > bestPriority){
+                best = v;
+                bestPriority = priority;
+            }
+        }
+
+        // otherwise a recently used vertex, then any vertex with triangles left
+        while(best < 0 && numDeadEnds > 0){
+            int v = deadEnds[--numDeadEnds];
+            if(liveTriangles[v] > 0)
+                best = v;
+        }
+        while(best < 0 && cursor < numVertices){
+            if(liveTriangles[cursor] > 0)
+                best = cursor;
+            cursor++;
+        }
+
+        fanning = best;
+    }
+
+    memcpy(indices, output, numTriangles * 3 * sizeof(uint32_t));
+}
+
+int MeshOptimizer::optimizeVertexFetch(uint32_t* indices, int numIndices, void* vertices, int vertexSize, int numVertices)
+{
+    Arena& arena = Arena::generation();
+
+    int *remap = arena.allocateArray<int>(numVertices);
+    for(int v = 0; v < numVertices; v++)
+        remap[v] = -1;
+
+    int numUsed = 0;
+    for(int i = 0; i < numIndices; i++){
+        uint32_t v = indices[i];
+        if(remap[v] < 0)
+            remap[v] = numUsed++;
+        indices[i] = remap[v];
+    }
+
+    char *source = (char*)vertices;
+    char *moved = (char*)arena.allocate((size_t)numUsed * vertexSize, 16);
+    for(int v = 0; v < numVertices; v++){
+        if(remap[v] >= 0)
+            memcpy(moved + (size_t)remap[v] * vertexSize, source + (size_t)v * vertexSize, vertexSize);
+    }
+    memcpy(source, moved, (size_t)numUsed * vertexSize);
+
+    return numUsed;
+}
@@ -0,0 +1,342 @@
+#include "MeshSimplifier.h"
+
+#include <math.h>
+#include <string.h>
+#include <float.h>
+#include <stdio.h>
+#include <algorithm>
+#include <Arena.h>
+#include <ThreadPool.h>
+
+
+void MeshSimplifier::Quadric::clear()
+{
+    memset(this, 0, sizeof(Quadric));
+}
+
+void MeshSimplifier::Quadric::addPlane(const double plane[4])
+{
+    a00 += plane[0] * plane[0];
+    a01 += plane[0] * plane[1];
+    a02 += plane[0] * plane[2];
+    a03 += plane[0] * plane[3];
+    a11 += plane[1] * plane[1];
+    a12 += plane[1] * plane[2];
+    a13 += plane[1] * plane[3];
+    a22 += plane[2] * plane[2];
+    a23 += plane[2] * plane[3];
+    a33 += plane[3] * plane[3];
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& q)
+{
+    a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+    a11 += q.a11; a12 += q.a12; a13 += q.a13;
+    a22 += q.a22; a23 += q.a23;
+    a33 += q.a33;
+}
+
+double MeshSimplifier::Quadric::error(const float p[3]) const
+{
+    double x = p[0], y = p[1], z = p[2];
+    double e = a00*x*x + a11*y*y + a22*z*z
+             + 2.0 * (a01*x*y + a02*x*z + a12*y*z)
+             + 2.0 * (a03*x + a13*y + a23*z)
+             + a33;
+    return fabs(e);
+}
+
+void MeshSimplifier::computeNormal(const float* a, const float* b, const float* c, float normal[3])
+{
+    // not normalized, its length is twice the area of the triangle
+    float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    normal[0] = u[1] * v[2] - u[2] * v[1];
+    normal[1] = u[2] * v[0] - u[0] * v[2];
+    normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+bool MeshSimplifier::contains(const uint32_t* triangle, uint32_t v)
+{
+    return triangle[0] == v || triangle[1] == v || triangle[2] == v;
+}
+
+int MeshSimplifier::simplify(uint32_t* indices, int numIndices, const float* positions, int numVertices,
+                             vec3d boxMin, vec3d boxSize, int targetIndices, float maxError, float& error)
+{
+    Arena& arena = Arena::generation();
+    ThreadPool& pool = ThreadPool::global();
+
+    error = 0.f;
+    int numTriangles = numIndices / 3;
+    if(numTriangles == 0 || numIndices <= targetIndices)
+        return numIndices;
+
+    // triangles around each vertex
+    int *adjacencyOffset = arena.allocateArray<int>(numVertices + 1);
+    int *adjacency = arena.allocateArray<int>(numIndices);
+    int *fill = arena.allocateArray<int>(numVertices);
+    auto buildAdjacency = [&](){
+        memset(adjacencyOffset, 0, (numVertices + 1) * sizeof(int));
+        for(int i = 0; i < numTriangles * 3; i++)
+            adjacencyOffset[indices[i] + 1]++;
+        for(int v = 0; v < numVertices; v++)
+            adjacencyOffset[v+1] += adjacencyOffset[v];
+        memcpy(fill, adjacencyOffset, numVertices * sizeof(int));
+        for(int t = 0; t < numTriangles; t++){
+            for(int k = 0; k < 3; k++)
+                adjacency[fill[indices[t*3+k]]++] = t;
+        }
+    };
+    buildAdjacency();
+
+    // faces of the box each vertex lies on, the quantized positions on a face are exact,
+    // and the vertices of the edges which don't have two triangles are locked
+    uint8_t *flags = arena.allocateArray<uint8_t>(numVertices);
+    float boxEpsilon[3] = {boxSize.x * 1e-4f, boxSize.y * 1e-4f, boxSize.z * 1e-4f};
+    float boxLow[3] = {boxMin.x, boxMin.y, boxMin.z};
+    float boxHigh[3] = {boxMin.x + boxSize.x, boxMin.y + boxSize.y, boxMin.z + boxSize.z};
+    pool.parallelFor("simplify.flags", 0, numVertices, 1 << 12, [&](int begin, int end){
+        for(int v = begin; v < end; v++){
+            const float *p = &positions[v * 3];
+            uint8_t vertexFlags = 0;
+            for(int k = 0; k < 3; k++){
+                if(p[k] - boxLow[k] < boxEpsilon[k])
+                    vertexFlags |= 1 << (k * 2);
+                if(boxHigh[k] - p[k] < boxEpsilon[k])
+                    vertexFlags |= 2 << (k * 2);
+            }
+
+            // inside the surface each neighbour is in two of the triangles around the vertex
+            const int maxNeighbours = 64;
+            uint32_t neighbours[maxNeighbours];
+            int numNeighbours = 0;
+            for(int i = adjacencyOffset[v]; i < adjacencyOffset[v+1]; i++){
+                const uint32_t *tri = &indices[adjacency[i] * 3];
+                for(int k = 0; k < 3; k++){
+                    if(tri[k] == (uint32_t)v)
+                        continue;
+                    if(numNeighbours == maxNeighbours)
+                        vertexFlags |= LOCKED;
+                    else
+                        neighbours[numNeighbours++] = tri[k];
+                }
+            }
+            for(int i = 0; i < numNeighbours; i++){
+                if(std::count(neighbours, neighbours + numNeighbours, neighbours[i]) != 2)
+                    vertexFlags |= LOCKED;
+            }
+            flags[v] = vertexFlags;
+        }
+    });
+
+    // plane of each triangle, then the quadric of each vertex
+    double *planes = arena.allocateArray<double>(numTriangles * 4);
+    pool.parallelFor("simplify.planes", 0, numTriangles, 1 << 14, [&](int begin, int end){
+        for(int t = begin; t < end; t++){
+            const float *a = &positions[indices[t*3] * 3];
+            const float *b = &positions[indices[t*3+1] * 3];
+            const float *c = &positions[indices[t*3+2] * 3];
+            double u[3] = {(double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2]};
+            double v[3] = {(double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2]};
+            double n[3] = {u[1]*v[2] - u[2]*v[1], u[2]*v[0] - u[0]*v[2], u[0]*v[1] - u[1]*v[0]};
+            double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            if(length > 0.0){
+                n[0] /= length; n[1] /= length; n[2] /= length;
+            }
+            double *plane = &planes[t * 4];
+            plane[0] = n[0];
+            plane[1] = n[1];
+            plane[2] = n[2];
+            plane[3] = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+        }
+    });
+
+    Quadric *quadrics = arena.allocateArray<Quadric>(numVertices);
+    pool.parallelFor("simplify.quadrics", 0, numVertices, 1 << 12, [&](int begin, int end){
+        for(int v = begin; v < end; v++){
+            quadrics[v].clear();
+            for(int i = adjacencyOffset[v]; i < adjacencyOffset[v+1]; i++)
+                quadrics[v].addPlane(&planes[adjacency[i] * 4]);
+        }
+    });
+
+    // the link condition : the only vertices adjacent to both ends are the opposite
+    // vertices of their shared triangles, otherwise the collapse pinches the surface
+    auto keepsManifold = [&](uint32_t from, uint32_t to){
+        const int maxNeighbours = 64;
+        uint32_t neighbours[maxNeighbours], common[maxNeighbours];
+        int numNeighbours = 0, numCommon = 0, shared = 0;
+
+        for(int i = adjacencyOffset[from]; i < adjacencyOffset[from+1]; i++){
+            const uint32_t *tri = &indices[adjacency[i] * 3];
+            shared += contains(tri, to);
+            for(int k = 0; k < 3; k++){
+                if(tri[k] == from || tri[k] == to)
+                    continue;
+                if(numNeighbours == maxNeighbours)
+                    return false;
+                neighbours[numNeighbours++] = tri[k];
+            }
+        }
+
+        for(int i = adjacencyOffset[to]; i < adjacencyOffset[to+1]; i++){
+            const uint32_t *tri = &indices[adjacency[i] * 3];
+            for(int k = 0; k < 3; k++){
+                uint32_t w = tri[k];
+                if(w == from || w == to)
+                    continue;
+                if(std::find(neighbours, neighbours + numNeighbours, w) == neighbours + numNeighbours)
+                    continue;
+                if(std::find(common, common + numCommon, w) == common + numCommon){
+                    common[numCommon++] = w;
+                    if(numCommon > shared)
+                        return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // the triangles which remain around the collapsed vertex must not fold over
+    auto keepsOrientation = [&](uint32_t from, uint32_t to){
+        for(int i = adjacencyOffset[from]; i < adjacencyOffset[from+1]; i++){
+            const uint32_t *tri = &indices[adjacency[i] * 3];
+            if(contains(tri, to))
+                continue;
+            const float *p[3], *moved[3];
+            for(int k = 0; k < 3; k++){
+                p[k] = &positions[tri[k] * 3];
+                moved[k] = tri[k] == from ? &positions[to * 3] : p[k];
+            }
+            float before[3], after[3];
+            computeNormal(p[0], p[1], p[2], before);
+            computeNormal(moved[0], moved[1], moved[2], after);
+            float lengths = (before[0]*before[0] + before[1]*before[1] + before[2]*before[2])
+                          * (after[0]*after[0] + after[1]*after[1] + after[2]*after[2]);
+            float dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+            // the degenerate triangles have no orientation to keep
+            if(lengths > 0.f && (dot < 0.f || dot * dot < 0.0625f * lengths))
+                return false;
+        }
+        return true;
+    };
+
+    Collapse *best = arena.allocateArray<Collapse>(numVertices);
+    Collapse *collapses = arena.allocateArray<Collapse>(numVertices);
+    uint32_t *remap = arena.allocateArray<uint32_t>(numVertices);
+    for(int v = 0; v < numVertices; v++)
+        remap[v] = v;
+    bool *dirty = arena.allocateArray<bool>(numVertices);
+    size_t dirtyBytes = (size_t)numVertices * sizeof(bool);
+    memset(dirty, 1, dirtyBytes);
+
+    double maxCost = (double)maxError * (double)maxError;
+    double largestCost = 0.0;
+
+    // each pass collapses the cheapest edges which don't touch each other
+    while(numTriangles * 3 > targetIndices){
+        // the cheapest valid collapse of each vertex onto one of its neighbours, the checks stay
+        // valid during the pass since the neighbourhood of a collapse is not touched again.
+        // It only changes for the vertices next to the collapses of the previous pass
+        pool.parallelFor("simplify.costs", 0, numVertices, 1 << 12, [&](int begin, int end){
+            for(int v = begin; v < end; v++){
+                bool changed = false;
+                for(int i = adjacencyOffset[v]; i < adjacencyOffset[v+1] && !changed; i++){
+                    const uint32_t *tri = &indices[adjacency[i] * 3];
+                    changed = dirty[tri[0]] || dirty[tri[1]] || dirty[tri[2]];
+                }
+                if(!changed && !dirty[v])
+                    continue;
+
+                Collapse& c = best[v];
+                c.from = v;
+                c.to = v;
+                c.cost = FLT_MAX;
+                if(flags[v] & LOCKED)
+                    continue;
+
+                // the neighbours are checked from the cheapest one, each one follows the
+                // vertex in one of the triangles
+                const int maxNeighbours = 64;
+                Collapse candidates[maxNeighbours];
+                int numCandidates = 0;
+                for(int i = adjacencyOffset[v]; i < adjacencyOffset[v+1] && numCandidates < maxNeighbours; i++){
+                    const uint32_t *tri = &indices[adjacency[i] * 3];
+                    uint32_t to = tri[0] == (uint32_t)v ? tri[1] : (tri[1] == (uint32_t)v ? tri[2] : tri[0]);
+                    if(flags[v] & BOX_FACES & ~flags[to])
+                        continue;
+
+                    Quadric q = quadrics[v];
+                    q.add(quadrics[to]);
+                    double cost = q.error(&positions[to * 3]);
+                    if(cost <= maxCost)
+                        candidates[numCandidates++] = {(uint32_t)v, to, (float)cost};
+                }
+                std::sort(candidates, candidates + numCandidates, [](const Collapse& a, const Collapse& b){
+                    return a.cost < b.cost;
+                });
+
+                for(int i = 0; i < numCandidates; i++){
+                    if(keepsOrientation(v, candidates[i].to) && keepsManifold(v, candidates[i].to)){
+                        c = candidates[i];
+                        break;
+                    }
+                }
+            }
+        });
+
+        int numCandidates = 0;
+        for(int v = 0; v < numVertices; v++){
+            if(best[v].cost != FLT_MAX)
+                collapses[numCandidates++] = best[v];
+        }
+        std::sort(collapses, collapses + numCandidates, [](const Collapse& a, const Collapse& b){
+            return a.cost < b.cost;
+        });
+
+        memset(dirty, 0, dirtyBytes);
+        int removable = numTriangles - targetIndices / 3;
+        int removed = 0;
+
+        for(int i = 0; i < numCandidates && removed < removable; i++){
+            uint32_t from = collapses[i].from, to = collapses[i].to;
+            if(dirty[from] || dirty[to])
+                continue;
+
+            remap[from] = to;
+            quadrics[to].add(quadrics[from]);
+            largestCost = std::max(largestCost, (double)collapses[i].cost);
+
+            // the neighbourhood changed, it waits for the next pass
+            for(int j = adjacencyOffset[from]; j < adjacencyOffset[from+1]; j++){
+                const uint32_t *tri = &indices[adjacency[j] * 3];
+                removed += contains(tri, to);
+                for(int k = 0; k < 3; k++)
+                    dirty[tri[k]] = true;
+            }
+        }
+
+        // the last passes collapse too few edges to be worth their cost
+        if(removed <= numTriangles / 256)
+            break;
+
+        // the triangles which lost an edge are removed
+        int numKept = 0;
+        for(int t = 0; t < numTriangles; t++){
+            uint32_t a = remap[indices[t*3]], b = remap[indices[t*3+1]], c = remap[indices[t*3+2]];
+            if(a == b || b == c || c == a)
+                continue;
+            indices[numKept*3] = a;
+            indices[numKept*3+1] = b;
+            indices[numKept*3+2] = c;
+            numKept++;
+        }
+        numTriangles = numKept;
+
+        buildAdjacency();
+    }
+
+    error = (float)sqrt(largestCost);
+    return numTriangles * 3;
+}
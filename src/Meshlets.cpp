@@ -0,0 +1,153 @@
+#include "Meshlets.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <Arena.h>
+#include <ThreadPool.h>
+
+
+void Meshlets::build(uint32_t* indices, int numIndices, const float* positions, vec3d gridMin, float cellSize, int cellsX, int cellsY, int cellsZ)
+{
+    Arena& arena = Arena::generation();
+
+    int numTriangles = numIndices / 3;
+    int numCells = cellsX * cellsY * cellsZ;
+
+    // cell of the centroid of each triangle
+    int *triangleCell = arena.allocateArray<int>(numTriangles);
+    ThreadPool::global().parallelFor("meshlets.cells", 0, numTriangles, 1 << 14, [&](int begin, int end){
+        for(int t = begin; t < end; t++){
+            float c[3] = {0.f, 0.f, 0.f};
+            for(int k = 0; k < 3; k++){
+                const float* p = &positions[indices[t*3+k] * 3];
+                c[0] += p[0]; c[1] += p[1]; c[2] += p[2];
+            }
+            int x = std::min(std::max((int)((c[0] / 3.f - gridMin.x) / cellSize), 0), cellsX - 1);
+            int y = std::min(std::max((int)((c[1] / 3.f - gridMin.y) / cellSize), 0), cellsY - 1);
+            int z = std::min(std::max((int)((c[2] / 3.f - gridMin.z) / cellSize), 0), cellsZ - 1);
+            triangleCell[t] = x + cellsX * (y + cellsY * z);
+        }
+    });
+
+    // stable counting sort of the triangles by cell
+    int *cellStart = arena.allocateArray<int>(numCells + 1);
+    memset(cellStart, 0, (numCells + 1) * sizeof(int));
+    for(int t = 0; t < numTriangles; t++)
+        cellStart[triangleCell[t] + 1]++;
+    for(int c = 0; c < numCells; c++)
+        cellStart[c+1] += cellStart[c];
+
+    int *fill = arena.allocateArray<int>(numCells);
+    memcpy(fill, cellStart, numCells * sizeof(int));
+    uint32_t *sorted = arena.allocateArray<uint32_t>(numTriangles * 3);
+    for(int t = 0; t < numTriangles; t++){
+        int slot = fill[triangleCell[t]]++;
+        memcpy(&sorted[slot * 3], &indices[t * 3], 3 * sizeof(uint32_t));
+    }
+    memcpy(indices, sorted, numTriangles * 3 * sizeof(uint32_t));
+
+    meshlets.clear();
+    for(int c = 0; c < numCells; c++){
+        if(cellStart[c+1] == cellStart[c])
+            continue;
+        Meshlet m;
+        m.firstIndex = cellStart[c] * 3;
+        m.count = (cellStart[c+1] - cellStart[c]) * 3;
+        meshlets.push_back(m);
+    }
+
+    ThreadPool::global().parallelFor("meshlets.bounds", 0, (int)meshlets.size(), 16, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            Meshlet& m = meshlets[i];
+            const uint32_t* first = indices + m.firstIndex;
+
+            // sphere around the bounding box of the vertices
+            float lower[3] = {INFINITY, INFINITY, INFINITY};
+            float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+            for(uint32_t j = 0; j < m.count; j++){
+                const float* p = &positions[first[j] * 3];
+                for(int k = 0; k < 3; k++){
+                    lower[k] = std::min(lower[k], p[k]);
+                    upper[k] = std::max(upper[k], p[k]);
+                }
+            }
+            vec3d center((lower[0] + upper[0]) / 2.f, (lower[1] + upper[1]) / 2.f, (lower[2] + upper[2]) / 2.f);
+
+            float radius = 0.f;
+            vec3d axis(0.f, 0.f, 0.f);
+            for(uint32_t j = 0; j < m.count; j += 3){
+                vec3d v[3];
+                for(int k = 0; k < 3; k++){
+                    const float* p = &positions[first[j+k] * 3];
+                    v[k] = vec3d(p[0], p[1], p[2]);
+                    radius = std::max(radius, vec3d::distance(v[k], center));
+                }
+                // front faces are counter clockwise
+                vec3d n = vec3d::cross(v[1] - v[0], v[2] - v[0]);
+                if(n.length() > 0.f)
+                    n.normalize();
+                axis += n;
+            }
+
+            // the cone is the widest angle between the axis and a normal
+            float minDot = -1.f;
+            if(axis.length() > 0.f){
+                axis.normalize();
+                minDot = 1.f;
+                for(uint32_t j = 0; j < m.count; j += 3){
+                    const float* a = &positions[first[j] * 3];
+                    const float* b = &positions[first[j+1] * 3];
+                    const float* c = &positions[first[j+2] * 3];
+                    vec3d n = vec3d::cross(vec3d(b[0]-a[0], b[1]-a[1], b[2]-a[2]), vec3d(c[0]-a[0], c[1]-a[1], c[2]-a[2]));
+                    if(n.length() > 0.f){
+                        n.normalize();
+                        minDot = std::min(minDot, vec3d::dot(n, axis));
+                    }
+                }
+            }
+
+            m.center[0] = center.x;
+            m.center[1] = center.y;
+            m.center[2] = center.z;
+            m.radius = radius;
+            m.coneAxis[0] = axis.x;
+            m.coneAxis[1] = axis.y;
+            m.coneAxis[2] = axis.z;
+            // normals spread over more than a half space never all face away
+            m.coneCutoff = minDot > 0.f ? sqrtf(1.f - minDot * minDot) : 1.f;
+        }
+    });
+}
+
+int Meshlets::cull(const Frustum& frustum, vec3d eye, uint32_t firstIndex, DrawCommand* commands)
+{
+    int numCommands = 0;
+
+    for(Meshlet& m : meshlets){
+        vec3d center(m.center[0], m.center[1], m.center[2]);
+        if(!frustum.intersectsSphere(center, m.radius))
+            continue;
+
+        // all the triangles face away when the eye is outside the
+        // cone of normals widened by the bounding sphere
+        vec3d toCenter = center - eye;
+        vec3d axis(m.coneAxis[0], m.coneAxis[1], m.coneAxis[2]);
+        if(vec3d::dot(toCenter, axis) > m.coneCutoff * toCenter.length() + m.radius)
+            continue;
+
+        DrawCommand& command = commands[numCommands++];
+        command.count = m.count;
+        command.instanceCount = 1;
+        command.firstIndex = firstIndex + m.firstIndex;
+        command.baseVertex = 0;
+        command.baseInstance = 0;
+    }
+
+    return numCommands;
+}
+
+void Meshlets::clear()
+{
+    meshlets.clear();
+}
@@ -1,14 +1,13 @@
 #include "NoiseSettings.h"
 
-#include <stdlib.h>
-
 
 void NoiseSettings::seed(int newOffsetSeed)
 {
+    // the seed is hashed with the lattice points of the noise, the field is no
+    // longer moved far from the origin where the floats lose their precision
     offsetSeed = newOffsetSeed;
-    srand(offsetSeed);
 
-    offset.x = (float)rand() - (float)RAND_MAX/2.f;
-    offset.y = (float)rand() - (float)RAND_MAX/2.f;
-    offset.z = (float)rand() - (float)RAND_MAX/2.f;
+    offset.x = 0.f;
+    offset.y = 0.f;
+    offset.z = 0.f;
 }
@@ -0,0 +1,62 @@
+#include "PackedVertex.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+void PackedVertex::encode(vec3d boxMin, vec3d boxSize, const float position[3], const float normal[3])
+{
+    // same rounding as packVertex in MarchingCubes.glsl
+    float box[2][3] = {{boxMin.x, boxMin.y, boxMin.z}, {boxSize.x, boxSize.y, boxSize.z}};
+    uint32_t q[3];
+    for(int i = 0; i < 3; i++){
+        float t = std::min(std::max((position[i] - box[0][i]) / box[1][i], 0.f), 1.f);
+        q[i] = (uint32_t)(t * 65535.f + 0.5f);
+    }
+
+    float n[3] = {normal[0], normal[1], normal[2]};
+    float sum = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if(sum < 1e-6f){
+        n[0] = 0.f;
+        n[1] = 1.f;
+        n[2] = 0.f;
+        sum = 1.f;
+    }
+
+    float u = n[0] / sum, v = n[1] / sum;
+    if(n[2] < 0.f){
+        float fu = (1.f - fabsf(v)) * (u >= 0.f ? 1.f : -1.f);
+        float fv = (1.f - fabsf(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = fu;
+        v = fv;
+    }
+
+    uint32_t ou = (uint32_t)(std::min(std::max(u * 0.5f + 0.5f, 0.f), 1.f) * 255.f + 0.5f);
+    uint32_t ov = (uint32_t)(std::min(std::max(v * 0.5f + 0.5f, 0.f), 1.f) * 255.f + 0.5f);
+
+    xy = q[0] | (q[1] << 16);
+    zNormal = q[2] | (ou << 16) | (ov << 24);
+}
+
+void PackedVertex::decode(vec3d boxMin, vec3d boxSize, float position[3], float normal[3]) const
+{
+    position[0] = boxMin.x + (float)(xy & 0xFFFF) / 65535.f * boxSize.x;
+    position[1] = boxMin.y + (float)(xy >> 16) / 65535.f * boxSize.y;
+    position[2] = boxMin.z + (float)(zNormal & 0xFFFF) / 65535.f * boxSize.z;
+
+    // the lower hemisphere is folded over the diagonals of the octahedron
+    float u = (float)((zNormal >> 16) & 0xFF) / 255.f * 2.f - 1.f;
+    float v = (float)(zNormal >> 24) / 255.f * 2.f - 1.f;
+    float w = 1.f - fabsf(u) - fabsf(v);
+    if(w < 0.f){
+        float fu = (1.f - fabsf(v)) * (u >= 0.f ? 1.f : -1.f);
+        float fv = (1.f - fabsf(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = fu;
+        v = fv;
+    }
+
+    float length = sqrtf(u*u + v*v + w*w);
+    normal[0] = u / length;
+    normal[1] = v / length;
+    normal[2] = w / length;
+}
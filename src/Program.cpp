@@ -1,12 +1,30 @@
 #include "Program.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 
 Program::Program(GLFWwindow *_window, ConfigParser& _config) : window(_window), config(_config)
 {
+    // without window, the program renders offscreen
+    headless = window == NULL;
+    if(headless){
+        winWidth = config.exist("headlessWidth") ? config.getInt("headlessWidth") : 600;
+        winHeight = config.exist("headlessHeight") ? config.getInt("headlessHeight") : 400;
+        headlessTimeStep = config.exist("headlessTimeStep") ? config.getFloat("headlessTimeStep") : 1.f/60.f;
+        headlessGenerations = config.exist("headlessGenerations") ? config.getInt("headlessGenerations") : 1;
+    }
+
     configureProgram();
 
+    // worker threads shared by all the CPU stages
+    int numThreads = config.exist("numThreads") ? config.getInt("numThreads") : 0;
+    bool pinThreads = config.exist("pinThreads") && config.getBool("pinThreads");
+    ThreadPool::global().start(numThreads, pinThreads);
+
+    if(headless && config.exist("profileTasks") && config.getBool("profileTasks"))
+        ThreadPool::global().setProfileHook(recordTask, this);
+
     initEnables();
     initLight();
     initMaterial();
@@ -17,37 +35,63 @@ Program::Program(GLFWwindow *_window, ConfigParser& _config) : window(_window),
     setupCamera();
 }
 
-void Program::configureMesh()
+void Program::configureNoise(ConfigParser& config, NoiseSettings& noise)
 {
-    // Noise configuration
-
     if(config.exist("offsetSeed")){
-        mesh.noise.seed(config.getInt("offsetSeed"));
+        noise.seed(config.getInt("offsetSeed"));
     } else {
-        mesh.noise.seed(rand());
+        noise.seed(rand());
     }
 
-    mesh.noise.noiseScale = config.getFloat("noiseScale");
-    mesh.noise.lacunarity = config.getFloat("lacunarity");
-    mesh.noise.persistence = config.getFloat("persistence");
-    mesh.noise.octaves = config.getInt("octaves");
+    noise.noiseScale = config.getFloat("noiseScale");
+    noise.lacunarity = config.getFloat("lacunarity");
+    noise.persistence = config.getFloat("persistence");
+    noise.octaves = config.getInt("octaves");
+
+    noise.closeEdges = config.getBool("closeEdges");
 
-    mesh.noise.closeEdges = config.getBool("closeEdges");
+    noise.stepSize = config.getFloat("stepSize");
+    noise.stepWeight = config.getFloat("stepWeight");
 
-    mesh.noise.stepSize = config.getFloat("stepSize");
-    mesh.noise.stepWeight = config.getFloat("stepWeight");
+    noise.floorOffset = config.getFloat("floorOffset");
+    noise.hardFloor = config.getFloat("hardFloor");
+    noise.floorWeight = config.getFloat("floorWeight");
 
-    mesh.noise.floorOffset = config.getFloat("floorOffset");
-    mesh.noise.hardFloor = config.getFloat("hardFloor");
-    mesh.noise.floorWeight = config.getFloat("floorWeight");
+    noise.noiseWeight = config.getFloat("noiseWeight");
+}
+
+void Program::configureMesh()
+{
+    // Noise configuration
 
-    mesh.noise.noiseWeight = config.getFloat("noiseWeight");
+    configureNoise(config, mesh.noise);
 
     // Mesh configuration
 
     mesh.surfaceLevel = config.getFloat("surfaceLevel");
     mesh.minRegionSize = config.getInt("minRegionSize");
 
+    if(config.exist("surfaceNets"))
+        mesh.surfaceNets = config.getBool("surfaceNets");
+    if(config.exist("simplifyMesh"))
+        mesh.simplifyMesh = config.getBool("simplifyMesh");
+    if(config.exist("simplifyRatio"))
+        mesh.simplifyRatio = config.getFloat("simplifyRatio");
+    if(config.exist("simplifyError"))
+        mesh.simplifyError = config.getFloat("simplifyError");
+    if(config.exist("optimizeMesh"))
+        mesh.optimizeMesh = config.getBool("optimizeMesh");
+    if(config.exist("vertexCacheSize"))
+        mesh.vertexCacheSize = config.getInt("vertexCacheSize");
+    if(config.exist("meshlets"))
+        mesh.useMeshlets = config.getBool("meshlets");
+    if(config.exist("meshletSize"))
+        mesh.meshletSize = config.getInt("meshletSize");
+    if(config.exist("meshCache"))
+        mesh.useCache = config.getBool("meshCache");
+    if(config.exist("meshCacheDirectory"))
+        mesh.cache.directory = config.getString("meshCacheDirectory");
+
     mesh.color.r = config.getFloat("meshColorR");
     mesh.color.g = config.getFloat("meshColorG");
     mesh.color.b = config.getFloat("meshColorB");
@@ -59,6 +103,30 @@ void Program::configureMesh()
 
     meshWasResized = mesh.resize(numCubesX, numCubesY, numCubesZ, cubeSize);
 
+    // Level of detail configuration
+
+    if(config.exist("lodTerrain"))
+        lodTerrain = config.getBool("lodTerrain");
+
+    if(lodTerrain){
+        if(config.exist("lodChunkSize"))
+            lod.chunkSize = config.getInt("lodChunkSize");
+        if(config.exist("lodLevels"))
+            lod.numLevels = config.getInt("lodLevels");
+        if(config.exist("lodDistance"))
+            lod.lodDistance = config.getFloat("lodDistance");
+        if(config.exist("lodChunksPerFrame"))
+            lod.chunksPerFrame = config.getInt("lodChunksPerFrame");
+
+        lod.surfaceLevel = mesh.surfaceLevel;
+        lod.color.r = mesh.color.r;
+        lod.color.g = mesh.color.g;
+        lod.color.b = mesh.color.b;
+
+        lod.createPrograms();
+        lod.resize(numCubesX, numCubesY, numCubesZ, cubeSize);
+    }
+
     resizeFeatures();
 }
 
@@ -98,7 +166,13 @@ void Program::configureBoids()
     boids.cubeSize = mesh.getCubeSize();
     boids.cubeGrid = mesh.getCubeGrid();
 
-    boids.avoidMesh = meshEnabled;
+    // the cubes of the level of detail terrain are not on the GPU
+    boids.avoidMesh = meshEnabled && !lodTerrain;
+
+    if(config.exist("boidsTimeStep"))
+        boidsTimeStep = config.getFloat("boidsTimeStep");
+    if(config.exist("maxSubsteps"))
+        maxSubsteps = config.getInt("maxSubsteps");
 
     numBoidsChanged = boids.setup(numBoids, width, height, numRayDirs);
 }
@@ -128,6 +202,9 @@ void Program::configureProgram()
         if(config.exist("enableMeshOnStart"))
             meshEnabled = config.getBool("enableMeshOnStart");
 
+        if(config.exist("cpuSimulation"))
+            cpuSimulation = config.getBool("cpuSimulation");
+
         isStarting = false;
     }
 }
@@ -155,37 +232,321 @@ void Program::setup()
         generateMesh();
 
     boids.generateBoids();
+    startSimulation(true);
+
+    frameStart = std::chrono::steady_clock::now();
+}
+
+void Program::startSimulation(bool regenerateBoids)
+{
+    if(!cpuSimulation)
+        return;
+
+    BoidSimulation& simulation = simulationThread.simulation;
+    boids.configureSimulation(simulation);
+
+    if(boids.avoidMesh && meshHasGeneration){
+        SparseVolume volume;
+        mesh.readVolume(volume);
+        simulation.setObstacles(volume, mesh.getCubeSize());
+    }
+
+    if(regenerateBoids)
+        simulation.generateBoids(rand());
+
+    if(config.exist("simulationRate"))
+        simulationThread.tickRate = config.getFloat("simulationRate");
+
+    // the camera belongs to the simulation thread while it runs
+    simulationThread.camera = cam;
+    simulationThread.start();
+}
+
+void Program::stopSimulation()
+{
+    if(!simulationThread.isRunning())
+        return;
 
-    glfwSetTime(0.0);
+    simulationThread.stop();
+    cam = simulationThread.camera;
+}
+
+float Program::elapsedTime()
+{
+    // seconds since the start of the frame
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - frameStart;
+    return elapsed.count();
 }
 
 void Program::update()
 {
+    // the scratch memory of the previous frame is no longer used
+    Arena::frame().reset();
+
     resetProjectionSettings();
 
-    cam.update();
+    if(cpuSimulation){
+        if(simulationThread.acquireSnapshot() && headless)
+            stats.addSample("simulationStep", simulationThread.snapshot().stepDuration);
+        cam.pos = simulationThread.snapshot().cameraPos;
+        cam.center = simulationThread.snapshot().cameraCenter;
+    } else {
+        cam.update();
+    }
     gluLookAt(cam.pos.x, cam.pos.y, cam.pos.z, cam.center.x, cam.center.y, cam.center.z, 0.f, 1.f, 0.f);
 
     glLightfv(GL_LIGHT0, GL_POSITION, light_position);
 
-    if(!pauseBoids)
-        boids.update(frameTime);
-    boids.draw();
+    if(mesh.pollStatistics())
+        printMeshStatistics();
 
-    if(meshEnabled)
-        mesh.draw();
+    MeshExporter::Result exported;
+    if(exporter.poll(exported))
+        printExportStatistics(exported);
+
+    if(cpuSimulation){
+        SimulationThread::Snapshot& snapshot = simulationThread.snapshot();
+        boids.drawSimulation(snapshot.previousBoids, snapshot.boids, simulationThread.interpolation());
+    } else {
+        updateBoids();
+    }
+
+    if(meshEnabled){
+        float aspect = (float)winWidth / (float)winHeight;
+        Frustum frustum = cam.frustum(fieldOfView, aspect, nearPlane, farPlane);
+        if(lodTerrain){
+            lod.update(cam.pos);
+            lod.draw(frustum);
+            if(headless){
+                stats.addSample("lodMeshing", lod.meshingDuration);
+                stats.addSample("lodTriangles", lod.numTriangles);
+            }
+        } else {
+            mesh.draw(cam.pos, frustum);
+            if(headless && mesh.useMeshlets)
+                stats.addSample("visibleMeshlets", mesh.numVisibleMeshlets);
+        }
+    }
 
     if(axes.enabled)
         axes.draw();
     if(box.enabled)
         box.draw();
 
-    glfwSwapBuffers(window);
+    if(headless){
+        // wait for the frame to be rendered so that the frame time includes the GPU work
+        glFinish();
+    } else {
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    frameTime = elapsedTime();
+    frameStart = std::chrono::steady_clock::now();
+
+    if(headless){
+        stats.addSample("frame", frameTime * 1000.f);
+        if(boids.pollStatistics()){
+            stats.addSample("boidsUpdate", boids.updateDuration);
+            stats.addSample("boidsSubstep", boids.substepDuration);
+        }
+
+        // fixed time step for comparable runs
+        frameTime = headlessTimeStep;
+    }
+}
+
+void Program::updateBoids()
+{
+    if(!pauseBoids){
+        boidsAccumulator += frameTime;
+        int numSubsteps = (int)(boidsAccumulator / boidsTimeStep);
+
+        // after a long frame the simulation slows down rather than
+        // spending ever more time catching up
+        if(numSubsteps > maxSubsteps){
+            numSubsteps = maxSubsteps;
+            boidsAccumulator = numSubsteps * boidsTimeStep;
+        }
+        boidsAccumulator -= numSubsteps * boidsTimeStep;
+
+        boids.update(boidsTimeStep, numSubsteps);
+        numSubstepsRun += numSubsteps;
+
+        if(headless)
+            stats.addSample("substeps", numSubsteps);
+    }
+
+    boids.draw(boidsAccumulator / boidsTimeStep);
+}
+
+bool Program::runHeadless()
+{
+    // a stage that did not compile generates an empty mesh, which would look like a valid run
+    if(ComputeProcess::numProgramErrors > 0){
+        printf("%d shaders or programs failed to compile or link\n", ComputeProcess::numProgramErrors);
+        return false;
+    }
+
+    int numFrames = config.exist("headlessFrames") ? config.getInt("headlessFrames") : 600;
+    int numGenerations = headlessGenerations;
+    std::string reportFile = config.exist("reportFile") ? config.getString("reportFile") : "report.json";
+
+    stats.reserve("frame", numFrames * numGenerations);
+    stats.reserve("boidsUpdate", numFrames * numGenerations);
+    stats.reserve("boidsSubstep", numFrames * numGenerations);
+    stats.reserve("substeps", numFrames * numGenerations);
+    stats.reserve("simulationStep", numFrames * numGenerations);
+    stats.reserve("visibleMeshlets", numFrames * numGenerations);
+    stats.reserve("lodMeshing", numFrames * numGenerations);
+    stats.reserve("lodTriangles", numFrames * numGenerations);
+    stats.reserve("generation", numGenerations + 1);
+    stats.reserve("frameAllocations", numFrames * numGenerations);
+    stats.reserve("generationAllocations", numGenerations);
+
+    // the first frames fill the arenas, the rings and the statistics,
+    // the following ones are expected not to allocate
+    int warmupFrames = std::min(std::max(numFrames / 10, 1), 60);
+    size_t steadyFrameAllocations = 0, steadyGenerationAllocations = 0;
+
+    for(int i = 0; i < numGenerations; i++){
+        // the first generation was done by the setup
+        if(i > 0){
+            stopSimulation();
+
+            size_t allocations = AllocationCounter::count();
+            if(meshEnabled)
+                generateMesh();
+            boids.generateBoids();
+            allocations = AllocationCounter::count() - allocations;
+
+            stats.addSample("generationAllocations", (float)allocations);
+            // the first regeneration may still grow the arenas
+            if(i > 1)
+                steadyGenerationAllocations += allocations;
+
+            startSimulation(true);
+        }
+
+        for(int j = 0; j < numFrames; j++){
+            size_t allocations = AllocationCounter::count();
+            update();
+            allocations = AllocationCounter::count() - allocations;
+
+            stats.addSample("frameAllocations", (float)allocations);
+            if(i > 0 || j >= warmupFrames)
+                steadyFrameAllocations += allocations;
+        }
+
+        // make sure the statistics of this generation are recorded
+        glFinish();
+        while(mesh.hasPendingStatistics()){
+            if(mesh.pollStatistics())
+                printMeshStatistics();
+        }
+    }
+
+    // the export runs in the background, the frames go on until it is written
+    if(config.exist("exportFile") && meshEnabled && !lodTerrain){
+        exportMesh();
+        while(exporter.isBusy()){
+            MeshExporter::Result exported;
+            if(exporter.poll(exported)){
+                printExportStatistics(exported);
+                stats.setValue("exportBytes", (double)exported.bytes);
+                stats.setValue("exportDuration", exported.duration);
+                stats.setValue("exportThroughput", exported.throughput);
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    stats.setString("renderer", (const char*)glGetString(GL_RENDERER));
+    stats.setString("mesher", lodTerrain ? "lod" : (mesh.surfaceNets ? "surfaceNets" : "marchingCubes"));
+    stats.setValue("frames", numFrames * numGenerations);
+    stats.setValue("generations", numGenerations);
+    stats.setValue("numCubesX", mesh.getCubeGrid().x);
+    stats.setValue("numCubesY", mesh.getCubeGrid().y);
+    stats.setValue("numCubesZ", mesh.getCubeGrid().z);
+    stats.setValue("numBoids", boids.numBoids);
+    stats.setValue("threads", ThreadPool::global().getNumThreads());
+    if(lodTerrain){
+        stats.setValue("vertices", lod.numVertices);
+        stats.setValue("triangles", lod.numTriangles);
+        stats.setValue("lodChunks", lod.numChunks);
+    } else {
+        stats.setValue("vertices", mesh.numVertices);
+        stats.setValue("triangles", mesh.numTriangles);
+    }
+    if(mesh.useMeshlets)
+        stats.setValue("meshlets", mesh.numMeshlets);
+    if(mesh.useCache){
+        stats.setValue("cacheHits", mesh.cache.hits);
+        stats.setValue("cacheMisses", mesh.cache.misses);
+    }
+    stats.setValue("gpuBufferBytes", (double)Buffer::getAllocatedBytes());
+    stats.setValue("fenceWaits", StreamBuffer::fenceWaits);
+    if(meshEnabled && !lodTerrain)
+        stats.setValue("countFallbacks", mesh.countFallbacks);
+    stats.setValue("steadyFrameAllocations", (double)steadyFrameAllocations);
+    stats.setValue("steadyGenerationAllocations", (double)steadyGenerationAllocations);
+    stats.setValue("frameArenaBytes", (double)Arena::frame().getCapacity());
+    stats.setValue("generationArenaBytes", (double)Arena::generation().getCapacity());
+
+    // checked against golden values by the benchmarks
+    if(meshEnabled && !lodTerrain){
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)mesh.meshHash());
+        stats.setString("meshHash", hash);
+    }
+
+    // boids updated per second, by wall time and by GPU time of the substeps
+    float totalSeconds = stats.total("frame") / 1000.f;
+    if(totalSeconds > 0.f)
+        stats.setValue("boidThroughput", (double)boids.numBoids * numSubstepsRun / totalSeconds);
+    float meanSubstepSeconds = stats.mean("boidsSubstep") / 1000.f;
+    if(meanSubstepSeconds > 0.f)
+        stats.setValue("boidGpuThroughput", (double)boids.numBoids / meanSubstepSeconds);
+    stats.setValue("substepsRun", (double)numSubstepsRun);
+
+    {
+        std::lock_guard<std::mutex> lock(taskSamplesMutex);
+        char series[64];
+        for(auto& sample : taskSamples){
+            snprintf(series, sizeof(series), "task.%s", sample.first);
+            stats.addSample(series, sample.second);
+        }
+
+        // how evenly the tasks were spread over the threads
+        for(size_t i = 0; i < taskBusy.size(); i++){
+            if(i == 0)
+                snprintf(series, sizeof(series), "taskBusy.caller");
+            else
+                snprintf(series, sizeof(series), "taskBusy.worker%d", (int)i - 1);
+            stats.setValue(series, taskBusy[i]);
+        }
+    }
+
+    if(!stats.writeReport(reportFile)){
+        printf("Could not write the report to %s\n", reportFile.c_str());
+        return false;
+    }
 
-    glfwPollEvents();
+    printf("Report written to %s\n", reportFile.c_str());
+    return true;
+}
 
-    frameTime = glfwGetTime();
-    glfwSetTime(0.0);
+void Program::recordTask(const char* name, int worker, double start, double end, void* user)
+{
+    Program* program = (Program*)user;
+    std::lock_guard<std::mutex> lock(program->taskSamplesMutex);
+    program->taskSamples.push_back(std::make_pair(name, (float)(end - start)));
+
+    size_t thread = (size_t)(worker + 1);
+    if(program->taskBusy.size() <= thread)
+        program->taskBusy.resize(thread + 1, 0.0);
+    program->taskBusy[thread] += end - start;
 }
 
 void Program::generateMesh()
@@ -203,15 +564,119 @@ void Program::generateMesh()
     if(config.exist("offsetZ"))
         mesh.noise.offset.z = config.getFloat("offsetZ");
 
-    mesh.generate();
+    if(lodTerrain){
+        lod.generate(mesh.noise, cam.pos);
+        printLodStatistics();
+    } else {
+        mesh.generate();
+    }
 
     meshWasResized = false;
     meshHasGeneration = true;
+}
 
-    printf("\rGenerated new mesh: seed: %d - vertices: %d, triangles: %d - %fms\n",
-    mesh.noise.offsetSeed,
+void Program::printMeshStatistics()
+{
+    // the statistics of a generation are read back asynchronously
+    printf("\rGenerated new %s mesh: seed: %d - vertices: %d, triangles: %d - %fms%s - GPU buffers: %.1fMB\n",
+    mesh.surfaceNets ? "surface nets" : "marching cubes", mesh.noise.offsetSeed,
     mesh.numVertices, mesh.numTriangles,
-    mesh.generationDuration);
+    mesh.generationDuration, mesh.cacheHit ? " (from cache)" : "",
+    (float)Buffer::getAllocatedBytes()/(float)(1024*1024));
+
+    // a cached mesh was simplified when it was generated
+    bool simplified = mesh.simplifyMesh && !mesh.cacheHit;
+    if(simplified){
+        printf("Simplification: %d -> %d triangles (%.1fx) - max error: %.3f cubes - %.1fms\n",
+        mesh.trianglesBeforeSimplification, mesh.numTriangles,
+        (float)mesh.trianglesBeforeSimplification / (float)std::max(mesh.numTriangles, 1),
+        mesh.simplificationError, mesh.simplificationDuration);
+    }
+
+    if(mesh.numVolumeBricks > 0){
+        printf("Sparse volume: %d of %d bricks stored - %.1fMB instead of %.1fMB\n",
+        mesh.numStoredBricks, mesh.numVolumeBricks,
+        (float)mesh.volumeBytes/(float)(1024*1024), (float)mesh.denseVolumeBytes/(float)(1024*1024));
+    }
+
+    if(mesh.optimizeMesh)
+        printf("Vertex cache miss ratio: %.3f -> %.3f\n", mesh.cacheMissRatioBefore, mesh.cacheMissRatioAfter);
+
+    if(headless){
+        stats.addSample("generation", mesh.generationDuration);
+        if(simplified){
+            stats.reserve("simplifyDuration", headlessGenerations + 1);
+            stats.reserve("simplifyError", headlessGenerations + 1);
+            stats.reserve("simplifyReduction", headlessGenerations + 1);
+            stats.addSample("simplifyDuration", mesh.simplificationDuration);
+            stats.addSample("simplifyError", mesh.simplificationError);
+            stats.addSample("simplifyReduction", (float)mesh.trianglesBeforeSimplification / (float)std::max(mesh.numTriangles, 1));
+        }
+        if(mesh.numVolumeBricks > 0){
+            stats.reserve("volumeBytes", headlessGenerations + 1);
+            stats.reserve("volumeStoredBricks", headlessGenerations + 1);
+            stats.addSample("volumeBytes", (float)mesh.volumeBytes);
+            stats.addSample("volumeStoredBricks", (float)mesh.numStoredBricks);
+        }
+        if(mesh.optimizeMesh){
+            stats.reserve("acmrBefore", headlessGenerations + 1);
+            stats.reserve("acmrAfter", headlessGenerations + 1);
+            stats.addSample("acmrBefore", mesh.cacheMissRatioBefore);
+            stats.addSample("acmrAfter", mesh.cacheMissRatioAfter);
+        }
+        char series[64];
+        for(auto& stage : mesh.stageDurations){
+            snprintf(series, sizeof(series), "generation.%s", stage.first);
+            // a series is created and sized on the first generation only
+            stats.reserve(series, headlessGenerations + 1);
+            stats.addSample(series, stage.second);
+
+            // GPU cost of one density point, the noise of all its octaves included
+            if(strcmp(stage.first, "density") == 0){
+                auto grid = mesh.getCubeGrid();
+                float points = (float)(grid.x + 1) * (float)(grid.y + 1) * (float)(grid.z + 1);
+                stats.reserve("densityNsPerPoint", headlessGenerations + 1);
+                stats.addSample("densityNsPerPoint", stage.second * 1e6f / points);
+            }
+        }
+    }
+}
+
+void Program::exportMesh()
+{
+    std::string path = config.exist("exportFile") ? config.getString("exportFile") : "terrain.glb";
+
+    if(lodTerrain || !meshEnabled || !mesh.exportMesh(exporter, path))
+        printf("The mesh cannot be exported now\n");
+    else
+        printf("Exporting the mesh to %s...\n", path.c_str());
+}
+
+void Program::printExportStatistics(MeshExporter::Result& result)
+{
+    if(!result.success){
+        printf("Could not export the mesh to %s\n", result.path.c_str());
+        return;
+    }
+
+    printf("Exported the mesh to %s: %.1fMB - %fms - %.1fMB/s\n",
+    result.path.c_str(),
+    (float)result.bytes/(float)(1024*1024),
+    result.duration, result.throughput);
+}
+
+void Program::printLodStatistics()
+{
+    // the chunks are meshed on the CPU, their statistics are known right away
+    printf("\rGenerated new LOD terrain: seed: %d - chunks: %d, vertices: %d, triangles: %d - %fms - GPU buffers: %.1fMB\n",
+    mesh.noise.offsetSeed,
+    lod.numChunks, lod.numVertices, lod.numTriangles,
+    lod.meshingDuration,
+    (float)Buffer::getAllocatedBytes()/(float)(1024*1024));
+
+    if(headless){
+        stats.addSample("generation", lod.meshingDuration);
+    }
 }
 
 void Program::Box::draw()
@@ -267,7 +732,8 @@ void Program::Axes::draw()
 
 void Program::resetProjectionSettings()
 {
-    glfwGetWindowSize(window, &winWidth, &winHeight );
+    if(!headless)
+        glfwGetWindowSize(window, &winWidth, &winHeight );
     winHeight = winHeight > 0 ? winHeight : 1;
 
     glViewport( 0, 0, winWidth, winHeight );
@@ -277,7 +743,7 @@ void Program::resetProjectionSettings()
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(65.0f, (GLfloat)winWidth/(GLfloat)winHeight, 0.1f, 100.0f);
+    gluPerspective(fieldOfView, (GLfloat)winWidth/(GLfloat)winHeight, nearPlane, farPlane);
 
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -322,6 +788,16 @@ void Program::initMaterial()
 
 void Program::onKeyPressed(int key, int scancode, int action, int mods)
 {
+    // pause and camera keys are handled by the simulation thread
+    if(simulationThread.isRunning() && (key == GLFW_KEY_P || key == GLFW_KEY_C)){
+        SimulationThread::InputEvent event;
+        event.type = SimulationThread::InputEvent::KEY;
+        event.code = key;
+        event.action = action;
+        simulationThread.pushEvent(event);
+        return;
+    }
+
     if(action == GLFW_PRESS){
         switch(key){
 
@@ -334,10 +810,13 @@ void Program::onKeyPressed(int key, int scancode, int action, int mods)
             break;
 
         case GLFW_KEY_SPACE:
+            stopSimulation();
             if(meshEnabled)
                 generateMesh();
             boids.generateBoids();
-            boids.avoidMesh = meshEnabled;
+            boids.avoidMesh = meshEnabled && !lodTerrain;
+            boids.uploadParameters();
+            startSimulation(true);
             break;
 
         case GLFW_KEY_C:
@@ -345,30 +824,45 @@ void Program::onKeyPressed(int key, int scancode, int action, int mods)
             break;
 
         case GLFW_KEY_R:
+        {
+            stopSimulation();
             config.parse();
             configureProgram();
             configureMesh();
             configureCamera();
             configureBoids();
-            if(meshWasResized || numBoidsChanged)
+            bool regenerate = meshWasResized || numBoidsChanged;
+            if(regenerate)
                 boids.generateBoids();
             if(meshWasResized && meshEnabled)
                 generateMesh();
+            startSimulation(regenerate);
             break;
+        }
 
         case GLFW_KEY_D:
+        {
+            stopSimulation();
             meshEnabled = !meshEnabled;
-            if(meshEnabled && (!meshHasGeneration || meshWasResized)){
+            bool regenerate = meshEnabled && (!meshHasGeneration || meshWasResized);
+            if(regenerate){
                 generateMesh();
                 boids.generateBoids();
             }
-            boids.avoidMesh = meshEnabled;
+            boids.avoidMesh = meshEnabled && !lodTerrain;
+            boids.uploadParameters();
+            startSimulation(regenerate);
             break;
+        }
 
         case GLFW_KEY_P:
             pauseBoids = !pauseBoids;
             break;
 
+        case GLFW_KEY_E:
+            exportMesh();
+            break;
+
         default:
             break;
         }
@@ -377,6 +871,15 @@ void Program::onKeyPressed(int key, int scancode, int action, int mods)
 
 void Program::onCursorPosition(double x, double y)
 {
+    if(simulationThread.isRunning()){
+        SimulationThread::InputEvent event;
+        event.type = SimulationThread::InputEvent::CURSOR;
+        event.x = (float)x;
+        event.y = (float)y;
+        simulationThread.pushEvent(event);
+        return;
+    }
+
     cam.updateMouseDetlas((float)x, (float)y, frameTime);
     cam.rotate();
     cam.translate();
@@ -384,6 +887,15 @@ void Program::onCursorPosition(double x, double y)
 
 void Program::onMouseButton(int button, int action, int mods)
 {
+    if(simulationThread.isRunning()){
+        SimulationThread::InputEvent event;
+        event.type = SimulationThread::InputEvent::MOUSE_BUTTON;
+        event.code = button;
+        event.action = action;
+        simulationThread.pushEvent(event);
+        return;
+    }
+
     if(button == GLFW_MOUSE_BUTTON_LEFT){
 
         if(action == GLFW_PRESS)
@@ -403,13 +915,29 @@ void Program::onMouseButton(int button, int action, int mods)
 
 void Program::onScrollRoll(double xoff, double yoff)
 {
+    if(simulationThread.isRunning()){
+        SimulationThread::InputEvent event;
+        event.type = SimulationThread::InputEvent::SCROLL;
+        event.x = (float)xoff;
+        event.y = (float)yoff;
+        simulationThread.pushEvent(event);
+        return;
+    }
+
     cam.updateDistance((float)yoff);
 }
 
 Program::~Program()
 {
+    stopSimulation();
+    ThreadPool::global().stop();
+    ThreadPool::global().setProfileHook(nullptr, nullptr);
     mesh.deleteBuffers();
     mesh.deletePrograms();
+    lod.deleteBuffers();
+    lod.deletePrograms();
+    exporter.deleteBuffer();
     boids.deleteBuffers();
     boids.deleteProgram();
+    Buffer::deleteStreams();
 }
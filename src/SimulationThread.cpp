@@ -0,0 +1,164 @@
+#include "SimulationThread.h"
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GL/glfw3.h>
+
+#include <algorithm>
+
+
+
+SimulationThread::SimulationThread() : running(false)
+{
+
+}
+
+void SimulationThread::start()
+{
+    if(isRunning())
+        return;
+
+    snapshots.reset();
+    events.clear();
+
+    // the first state is available before the thread starts so that
+    // the render thread never draws an empty snapshot
+    camera.update();
+    publish();
+    snapshots.update();
+
+    running.store(true, std::memory_order_release);
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+    if(!isRunning())
+        return;
+
+    running.store(false, std::memory_order_release);
+    thread.join();
+}
+
+bool SimulationThread::isRunning()
+{
+    return thread.joinable();
+}
+
+bool SimulationThread::pushEvent(const InputEvent& event)
+{
+    return events.push(event);
+}
+
+bool SimulationThread::acquireSnapshot()
+{
+    return snapshots.update();
+}
+
+SimulationThread::Snapshot& SimulationThread::snapshot()
+{
+    return snapshots.front();
+}
+
+float SimulationThread::interpolation()
+{
+    // the states are drawn one tick late so that the interpolation never extrapolates
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - snapshots.front().time;
+    return std::min(std::max(elapsed.count() * tickRate, 0.f), 1.f);
+}
+
+void SimulationThread::run()
+{
+    typedef std::chrono::steady_clock clock;
+
+    float deltaTime = 1.f / tickRate;
+    clock::duration tickDuration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(deltaTime));
+    clock::time_point nextTick = clock::now();
+
+    while(running.load(std::memory_order_acquire)){
+        processEvents(deltaTime);
+
+        if(!paused){
+            clock::time_point stepStart = clock::now();
+            simulation.step(deltaTime);
+            std::chrono::duration<float, std::milli> elapsed = clock::now() - stepStart;
+            stepDuration = elapsed.count();
+        } else {
+            simulation.previousBoids = simulation.boids;
+        }
+
+        camera.update();
+
+        tick++;
+        publish();
+
+        // after a long hitch, restart from now instead of running the missed ticks in a burst
+        nextTick += tickDuration;
+        clock::time_point now = clock::now();
+        if(nextTick + tickDuration * 4 < now)
+            nextTick = now;
+
+        std::this_thread::sleep_until(nextTick);
+    }
+}
+
+void SimulationThread::processEvents(float deltaTime)
+{
+    InputEvent event;
+    while(events.pop(event)){
+        switch(event.type){
+
+        case InputEvent::KEY:
+            if(event.action != GLFW_PRESS)
+                break;
+            if(event.code == GLFW_KEY_P)
+                paused = !paused;
+            else if(event.code == GLFW_KEY_C)
+                camera.resetCenter();
+            break;
+
+        case InputEvent::CURSOR:
+            camera.updateMouseDetlas(event.x, event.y, deltaTime);
+            camera.rotate();
+            camera.translate();
+            break;
+
+        case InputEvent::MOUSE_BUTTON:
+            if(event.code == GLFW_MOUSE_BUTTON_LEFT){
+                if(event.action == GLFW_PRESS)
+                    camera.enableRotation();
+                else
+                    camera.disableRotation();
+            } else if(event.code == GLFW_MOUSE_BUTTON_MIDDLE){
+                if(event.action == GLFW_PRESS)
+                    camera.enableTranslation();
+                else
+                    camera.disableTranslation();
+            }
+            break;
+
+        case InputEvent::SCROLL:
+            camera.updateDistance(event.y);
+            break;
+        }
+    }
+}
+
+void SimulationThread::publish()
+{
+    // the slots keep their capacity, so copying the boids doesn't allocate once warmed up
+    Snapshot& back = snapshots.back();
+    back.previousBoids = simulation.previousBoids;
+    back.boids = simulation.boids;
+    back.time = std::chrono::steady_clock::now();
+    back.cameraPos = camera.pos;
+    back.cameraCenter = camera.center;
+    back.tick = tick;
+    back.stepDuration = stepDuration;
+    snapshots.publish();
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
@@ -0,0 +1,366 @@
+#include "SparseVolume.h"
+
+#include <algorithm>
+#include <atomic>
+#include <Arena.h>
+#include <ThreadPool.h>
+
+#define BRICK_POINTS (SparseVolume::BRICK_SIZE * SparseVolume::BRICK_SIZE * SparseVolume::BRICK_SIZE)
+
+
+SparseVolume::SparseVolume()
+{
+
+}
+
+int SparseVolume::brickIndex(int bi, int bj, int bk) const
+{
+    return bk + brickDims[2] * bj + brickDims[2] * brickDims[1] * bi;
+}
+
+int SparseVolume::localIndex(int i, int j, int k)
+{
+    return (k & (BRICK_SIZE-1)) + BRICK_SIZE * (j & (BRICK_SIZE-1)) + BRICK_SIZE * BRICK_SIZE * (i & (BRICK_SIZE-1));
+}
+
+void SparseVolume::getBrickBounds(int brick, int begin[3], int end[3]) const
+{
+    int coords[3] = {
+        brick / (brickDims[2] * brickDims[1]),
+        (brick / brickDims[2]) % brickDims[1],
+        brick % brickDims[2]
+    };
+    for(int a = 0; a < 3; a++){
+        begin[a] = coords[a] * BRICK_SIZE;
+        end[a] = std::min(begin[a] + BRICK_SIZE, dims[a]);
+    }
+}
+
+void SparseVolume::build(const float* source, int stride, int x, int y, int z, float _surfaceLevel)
+{
+    dims[0] = x;
+    dims[1] = y;
+    dims[2] = z;
+    for(int a = 0; a < 3; a++)
+        brickDims[a] = (dims[a] + BRICK_SIZE - 1) / BRICK_SIZE;
+    surfaceLevel = _surfaceLevel;
+
+    int numBricks = brickDims[0] * brickDims[1] * brickDims[2];
+    bricks.resize(numBricks);
+
+    auto sourceValue = [&](int i, int j, int k){
+        return source[((size_t)k + (size_t)z * j + (size_t)z * y * i) * stride];
+    };
+
+    ThreadPool& pool = ThreadPool::global();
+
+    // a brick is uniform when the points one step around it are on the same side too
+    pool.parallelFor("volume.classify", 0, numBricks, 16, [&](int begin, int end){
+        for(int b = begin; b < end; b++){
+            int first[3], last[3];
+            getBrickBounds(b, first, last);
+
+            bool anySolid = false, anyEmpty = false;
+            for(int i = std::max(first[0]-1, 0); i < std::min(last[0]+1, x) && !(anySolid && anyEmpty); i++){
+                for(int j = std::max(first[1]-1, 0); j < std::min(last[1]+1, y); j++){
+                    for(int k = std::max(first[2]-1, 0); k < std::min(last[2]+1, z); k++){
+                        if(sourceValue(i, j, k) > surfaceLevel)
+                            anySolid = true;
+                        else
+                            anyEmpty = true;
+                    }
+                }
+            }
+
+            bricks[b] = anySolid && anyEmpty ? 0 : (anySolid ? SOLID : EMPTY);
+        }
+    });
+
+    // the values of the stored bricks follow each other in the order of the bricks
+    int numStored = 0;
+    for(int b = 0; b < numBricks; b++){
+        if(bricks[b] >= 0)
+            bricks[b] = numStored++;
+    }
+    values.resize((size_t)numStored * BRICK_POINTS);
+
+    pool.parallelFor("volume.copy", 0, numBricks, 16, [&](int begin, int end){
+        for(int b = begin; b < end; b++){
+            if(bricks[b] < 0)
+                continue;
+
+            // the points of the border bricks outside the grid are empty
+            float* brickValues = &values[(size_t)bricks[b] * BRICK_POINTS];
+            std::fill(brickValues, brickValues + BRICK_POINTS, surfaceLevel - 1.f);
+
+            int first[3], last[3];
+            getBrickBounds(b, first, last);
+            for(int i = first[0]; i < last[0]; i++)
+                for(int j = first[1]; j < last[1]; j++)
+                    for(int k = first[2]; k < last[2]; k++)
+                        brickValues[localIndex(i, j, k)] = sourceValue(i, j, k);
+        }
+    });
+}
+
+float SparseVolume::value(int i, int j, int k) const
+{
+    int state = bricks[brickIndex(i / BRICK_SIZE, j / BRICK_SIZE, k / BRICK_SIZE)];
+    if(state == SOLID)
+        return surfaceLevel + 1.f;
+    if(state == EMPTY)
+        return surfaceLevel - 1.f;
+    return values[(size_t)state * BRICK_POINTS + localIndex(i, j, k)];
+}
+
+bool SparseVolume::isSolid(int i, int j, int k) const
+{
+    return value(i, j, k) > surfaceLevel;
+}
+
+bool SparseVolume::isSolidCube(int i, int j, int k) const
+{
+    // the corners of a cube starting in a uniform brick are all on the side of the brick
+    int state = bricks[brickIndex(i / BRICK_SIZE, j / BRICK_SIZE, k / BRICK_SIZE)];
+    if(state < 0)
+        return state == SOLID;
+
+    for(int corner = 0; corner < 8; corner++){
+        if(isSolid(i + (corner & 1), j + ((corner >> 1) & 1), k + (corner >> 2)))
+            return true;
+    }
+    return false;
+}
+
+// union-find on the regions nodes, the root of a region is its smallest node
+static int findRegionRoot(std::atomic<int>* parent, int index)
+{
+    int p = parent[index].load(std::memory_order_relaxed);
+    while(p != index){
+        // path halving, concurrent finds only ever replace a parent by one of its ancestors
+        int grandParent = parent[p].load(std::memory_order_relaxed);
+        parent[index].store(grandParent, std::memory_order_relaxed);
+        index = grandParent;
+        p = parent[index].load(std::memory_order_relaxed);
+    }
+    return index;
+}
+
+static void uniteRegions(std::atomic<int>* parent, int a, int b)
+{
+    a = findRegionRoot(parent, a);
+    b = findRegionRoot(parent, b);
+    if(a < b)
+        parent[b].store(a, std::memory_order_relaxed);
+    else if(b < a)
+        parent[a].store(b, std::memory_order_relaxed);
+}
+
+int SparseVolume::removeSmallRegions(int minRegionSize, int* changedBricks)
+{
+    // a solid uniform brick is a single node of the union-find, weighing its number of points,
+    // and each point of a stored brick is a node. Slabs of bricks along x are labeled in
+    // parallel, then merged along their boundaries
+
+    ThreadPool& pool = ThreadPool::global();
+    Arena& arena = Arena::generation();
+
+    int numBricks = getNumBricks();
+    int* firstNode = arena.allocateArray<int>(numBricks);
+    int numNodes = 0;
+    for(int b = 0; b < numBricks; b++){
+        firstNode[b] = numNodes;
+        numNodes += bricks[b] == SOLID ? 1 : (bricks[b] >= 0 ? BRICK_POINTS : 0);
+    }
+
+    // the labels live in the generation arena, every node is written before being read
+    std::atomic<int>* parent = arena.allocateArray<std::atomic<int>>(numNodes);
+    std::atomic<int>* regionSize = arena.allocateArray<std::atomic<int>>(numNodes);
+
+    auto node = [&](int i, int j, int k){
+        int b = brickIndex(i / BRICK_SIZE, j / BRICK_SIZE, k / BRICK_SIZE);
+        return bricks[b] == SOLID ? firstNode[b] : firstNode[b] + localIndex(i, j, k);
+    };
+
+    // links the solid point (i, j, k) to its previous neighbour along the axis when it is solid too
+    auto link = [&](int n, int i, int j, int k, int axis){
+        int p[3] = {i, j, k};
+        p[axis]--;
+        if(isSolid(p[0], p[1], p[2]))
+            uniteRegions(parent, n, node(p[0], p[1], p[2]));
+    };
+
+    int slabWidth = std::max(brickDims[0] / (pool.getNumThreads() * 4), 1);
+
+    // the unions inside a slab only touch nodes of that slab
+    pool.parallelFor("regions.label", ThreadPool::Range3(brickDims[0], 1, 1), ThreadPool::Range3(slabWidth, 1, 1), [&](const ThreadPool::Range3& r){
+        int slabBegin = r.begin[0] * BRICK_SIZE;
+        for(int bi = r.begin[0]; bi < r.end[0]; bi++){
+            for(int bj = 0; bj < brickDims[1]; bj++){
+                for(int bk = 0; bk < brickDims[2]; bk++){
+                    int b = brickIndex(bi, bj, bk);
+                    int first[3], last[3];
+                    getBrickBounds(b, first, last);
+
+                    if(bricks[b] == EMPTY)
+                        continue;
+
+                    if(bricks[b] == SOLID){
+                        // only the first face of the brick along each axis has neighbours in other bricks
+                        int n = firstNode[b];
+                        parent[n].store(n, std::memory_order_relaxed);
+                        for(int axis = 0; axis < 3; axis++){
+                            if(first[axis] == 0 || (axis == 0 && first[0] == slabBegin))
+                                continue;
+                            int p[3] = {first[0], first[1], first[2]};
+                            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                            for(p[u] = first[u]; p[u] < last[u]; p[u]++)
+                                for(p[v] = first[v]; p[v] < last[v]; p[v]++)
+                                    link(n, p[0], p[1], p[2], axis);
+                        }
+                        continue;
+                    }
+
+                    // the nodes of the points outside the grid belong to no region
+                    for(int l = 0; l < BRICK_POINTS; l++)
+                        parent[firstNode[b] + l].store(-1, std::memory_order_relaxed);
+
+                    for(int i = first[0]; i < last[0]; i++){
+                        for(int j = first[1]; j < last[1]; j++){
+                            for(int k = first[2]; k < last[2]; k++){
+                                if(!isSolid(i, j, k))
+                                    continue;
+
+                                int n = firstNode[b] + localIndex(i, j, k);
+                                parent[n].store(n, std::memory_order_relaxed);
+
+                                if(k > 0)
+                                    link(n, i, j, k, 2);
+                                if(j > 0)
+                                    link(n, i, j, k, 1);
+                                if(i > slabBegin)
+                                    link(n, i, j, k, 0);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    for(int i = slabWidth * BRICK_SIZE; i < dims[0]; i += slabWidth * BRICK_SIZE){
+        for(int j = 0; j < dims[1]; j++){
+            for(int k = 0; k < dims[2]; k++){
+                if(isSolid(i, j, k))
+                    link(node(i, j, k), i, j, k, 0);
+            }
+        }
+    }
+
+    ThreadPool::Range3 grid(numNodes, 1, 1);
+    ThreadPool::Range3 grain(1 << 16, 1, 1);
+
+    pool.parallelFor("regions.clear", grid, grain, [&](const ThreadPool::Range3& r){
+        for(int n = r.begin[0]; n < r.end[0]; n++)
+            regionSize[n].store(0, std::memory_order_relaxed);
+    });
+
+    pool.parallelFor("regions.count", 0, numBricks, 16, [&](int begin, int end){
+        for(int b = begin; b < end; b++){
+            int first[3], last[3];
+            getBrickBounds(b, first, last);
+
+            int numNodesOfBrick = bricks[b] == SOLID ? 1 : (bricks[b] >= 0 ? BRICK_POINTS : 0);
+            int weight = bricks[b] == SOLID ? (last[0]-first[0]) * (last[1]-first[1]) * (last[2]-first[2]) : 1;
+
+            for(int n = firstNode[b]; n < firstNode[b] + numNodesOfBrick; n++){
+                if(parent[n].load(std::memory_order_relaxed) < 0)
+                    continue;
+                int root = findRegionRoot(parent, n);
+                parent[n].store(root, std::memory_order_relaxed);
+                regionSize[root].fetch_add(weight, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    unsigned char* changed = arena.allocateArray<unsigned char>(numBricks);
+
+    pool.parallelFor("regions.remove", 0, numBricks, 16, [&](int begin, int end){
+        for(int b = begin; b < end; b++){
+            changed[b] = 0;
+
+            if(bricks[b] == SOLID){
+                int root = parent[firstNode[b]].load(std::memory_order_relaxed);
+                if(regionSize[root].load(std::memory_order_relaxed) < minRegionSize){
+                    bricks[b] = EMPTY;
+                    changed[b] = 1;
+                }
+                continue;
+            }
+
+            if(bricks[b] < 0)
+                continue;
+
+            float* brickValues = &values[(size_t)bricks[b] * BRICK_POINTS];
+            for(int l = 0; l < BRICK_POINTS; l++){
+                int root = parent[firstNode[b] + l].load(std::memory_order_relaxed);
+                if(root >= 0 && regionSize[root].load(std::memory_order_relaxed) < minRegionSize){
+                    brickValues[l] = surfaceLevel - 1.f;
+                    changed[b] = 1;
+                }
+            }
+        }
+    });
+
+    int numChanged = 0;
+    for(int b = 0; b < numBricks; b++){
+        if(changed[b])
+            changedBricks[numChanged++] = b;
+    }
+    return numChanged;
+}
+
+void SparseVolume::getDims(int _dims[3]) const
+{
+    for(int a = 0; a < 3; a++)
+        _dims[a] = dims[a];
+}
+
+bool SparseVolume::empty() const
+{
+    return bricks.empty();
+}
+
+void SparseVolume::swap(SparseVolume& other)
+{
+    std::swap(dims, other.dims);
+    std::swap(brickDims, other.brickDims);
+    std::swap(surfaceLevel, other.surfaceLevel);
+    bricks.swap(other.bricks);
+    values.swap(other.values);
+}
+
+int SparseVolume::getNumBricks() const
+{
+    return (int)bricks.size();
+}
+
+int SparseVolume::getNumStoredBricks() const
+{
+    return (int)(values.size() / BRICK_POINTS);
+}
+
+size_t SparseVolume::getBytes() const
+{
+    return bricks.size() * sizeof(int) + values.size() * sizeof(float);
+}
+
+size_t SparseVolume::getDenseBytes() const
+{
+    return (size_t)dims[0] * dims[1] * dims[2] * sizeof(float);
+}
+
+SparseVolume::~SparseVolume()
+{
+
+}
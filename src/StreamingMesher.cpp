@@ -0,0 +1,168 @@
+#include "StreamingMesher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <ThreadPool.h>
+#include <MeshFile.h>
+
+
+StreamingMesher::StreamingMesher()
+{
+
+}
+
+bool StreamingMesher::generate(const std::string& path, const NoiseSettings& noise, int width, int height, int depth, float cubeSize)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // the indices are only known once their vertices are written, they are streamed
+    // to a file per level and appended after the vertices at the end
+    int numLevels = (int)surfaceLevels.size();
+    indicesFiles.resize(numLevels);
+    if(!output.create(path)){
+        printf("Could not create %s\n", path.c_str());
+        return false;
+    }
+    for(int l = 0; l < numLevels; l++){
+        std::string indicesPath = path + ".indices" + std::to_string(l);
+        if(!indicesFiles[l].create(indicesPath)){
+            printf("Could not create %s\n", indicesPath.c_str());
+            return false;
+        }
+    }
+
+    // the header is written once the counts are known
+    MeshFileHeader header = {};
+    char padding[sizeof(MeshFileHeader) + 16] = {};
+    output.write(padding, (size_t)MeshFileHeader::align(sizeof(MeshFileHeader)));
+
+    int grid[3] = {width, height, depth};
+    int points[3] = {width + 1, height + 1, depth + 1};
+    int sliceSize = points[1] * points[2];
+
+    sampler.configure(noise, width, height, depth);
+
+    std::vector<float> ys(points[1]), zs(points[2]);
+    for(int j = 0; j < points[1]; j++)
+        ys[j] = (float)j;
+    for(int k = 0; k < points[2]; k++)
+        zs[k] = (float)k;
+
+    mesher.surfaceLevels = surfaceLevels;
+    mesher.begin(ys.data(), points[1], zs.data(), points[2]);
+
+    slab.resize((size_t)slabSlices * sliceSize);
+
+    vec3d boxSize(width * cubeSize, height * cubeSize, depth * cubeSize);
+    vec3d boxMin(-boxSize.x / 2.f, -boxSize.y / 2.f, -boxSize.z / 2.f);
+
+    for(int x0 = 0; x0 < points[0]; x0 += slabSlices){
+        int numSlices = std::min(slabSlices, points[0] - x0);
+
+        // the density of the slab, one row of z at a time
+        ThreadPool::global().parallelFor("stream.density", 0, numSlices * points[1], 16, [&](int begin, int end){
+            for(int row = begin; row < end; row++){
+                int i = row / points[1], j = row % points[1];
+                float* values = &slab[(size_t)i * sliceSize + (size_t)j * points[2]];
+                for(int k = 0; k < points[2]; k++)
+                    values[k] = sampler.sample((float)(x0 + i), (float)j, (float)k);
+            }
+        });
+
+        for(int i = 0; i < numSlices; i++)
+            mesher.addSlice((float)(x0 + i), &slab[(size_t)i * sliceSize]);
+
+        bool written = writeVertices(boxMin, boxSize, grid, cubeSize);
+        for(int l = 0; l < numLevels; l++)
+            written = written && indicesFiles[l].write(mesher.indices[l].data(), mesher.indices[l].size() * sizeof(uint32_t));
+        if(!written){
+            printf("Could not write %s\n", path.c_str());
+            return false;
+        }
+
+        mesher.clearOutput();
+
+        // the written pages can leave the memory
+        output.flush();
+        for(MappedFile& indicesFile : indicesFiles)
+            indicesFile.flush();
+    }
+
+    numVertices = mesher.getNumVertices();
+
+    // the indices are copied after the vertices by blocks of the mapped files, one level after the other
+    char zeros[16] = {};
+    output.write(zeros, (size_t)(MeshFileHeader::align(output.size()) - output.size()));
+
+    std::vector<MeshFileLevel> levels(numLevels);
+    levelTriangles.resize(numLevels);
+    uint32_t numIndices = 0;
+
+    const size_t block = 64 * 1024 * 1024;
+    for(int l = 0; l < numLevels; l++){
+        MappedFile& indicesFile = indicesFiles[l];
+        for(size_t offset = 0; offset < indicesFile.size(); offset += block){
+            size_t length = std::min(block, indicesFile.size() - offset);
+            output.write(indicesFile.data() + offset, length);
+            output.flush();
+        }
+
+        levels[l].surfaceLevel = surfaceLevels[l];
+        levels[l].firstIndex = numIndices;
+        levels[l].numIndices = (uint32_t)(indicesFile.size() / sizeof(uint32_t));
+        levelTriangles[l] = levels[l].numIndices / 3;
+        numIndices += levels[l].numIndices;
+
+        indicesFile.close();
+        remove((path + ".indices" + std::to_string(l)).c_str());
+    }
+    numTriangles = numIndices / 3;
+
+    float boxMinArray[3] = {boxMin.x, boxMin.y, boxMin.z};
+    float boxSizeArray[3] = {boxSize.x, boxSize.y, boxSize.z};
+    header.init((uint32_t)numVertices, numIndices, 0, boxMinArray, boxSizeArray);
+    header.numLevels = (uint32_t)numLevels;
+
+    output.write(zeros, (size_t)(header.levelsOffset - output.size()));
+    output.write(levels.data(), levels.size() * sizeof(MeshFileLevel));
+
+    memcpy(output.data(), &header, sizeof(header));
+    output.close();
+
+    // the slab, the previous slice and the edges of each level
+    workingBytes = slab.capacity() * sizeof(float) + (size_t)sliceSize * (5 * numLevels * sizeof(int) + sizeof(float));
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    duration = elapsed.count();
+
+    return true;
+}
+
+bool StreamingMesher::writeVertices(vec3d boxMin, vec3d boxSize, const int grid[3], float cubeSize)
+{
+    int count = (int)mesher.positions.size() / 3;
+    packed.resize(count);
+
+    ThreadPool::global().parallelFor("stream.vertices", 0, count, 1 << 12, [&](int begin, int end){
+        for(int i = begin; i < end; i++){
+            float* p = &mesher.positions[i * 3];
+            float normal[3];
+            sampler.normal(p[0], p[1], p[2], normal);
+
+            float position[3];
+            for(int j = 0; j < 3; j++)
+                position[j] = (p[j] - grid[j] / 2.f) * cubeSize;
+
+            packed[i].encode(boxMin, boxSize, position, normal);
+        }
+    });
+
+    return output.write(packed.data(), packed.size() * sizeof(PackedVertex));
+}
+
+StreamingMesher::~StreamingMesher()
+{
+
+}
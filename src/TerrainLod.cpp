@@ -0,0 +1,373 @@
+#include "TerrainLod.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <ThreadPool.h>
+
+
+TerrainLod::TerrainLod()
+{
+
+}
+
+void TerrainLod::resize(int width, int height, int depth, float _cubeSize)
+{
+    cubeSize = _cubeSize;
+
+    // the coarsest cubes must fit in a chunk
+    while(numLevels > 1 && (1 << (numLevels - 1)) > chunkSize)
+        numLevels--;
+
+    int grid[3] = {width, height, depth};
+    bool gridChange = false;
+    for(int i = 0; i < 3; i++){
+        gridChange = gridChange || grid[i] != cubeGrid[i] || (grid[i] + chunkSize - 1) / chunkSize != chunkGrid[i];
+        cubeGrid[i] = grid[i];
+        chunkGrid[i] = (grid[i] + chunkSize - 1) / chunkSize;
+    }
+
+    if(!gridChange)
+        return;
+
+    deleteBuffers();
+
+    chunks.clear();
+    chunks.resize(chunkGrid[0] * chunkGrid[1] * chunkGrid[2]);
+    numChunks = (int)chunks.size();
+    selected.reserve(chunks.size());
+
+    int n = 0;
+    for(int x = 0; x < chunkGrid[0]; x++){
+        for(int y = 0; y < chunkGrid[1]; y++){
+            for(int z = 0; z < chunkGrid[2]; z++){
+                Chunk& chunk = chunks[n++];
+                int coords[3] = {x, y, z};
+                for(int i = 0; i < 3; i++){
+                    chunk.origin[i] = coords[i] * chunkSize;
+                    chunk.cubes[i] = std::min(chunkSize, cubeGrid[i] - chunk.origin[i]);
+                }
+            }
+        }
+    }
+}
+
+void TerrainLod::generate(const NoiseSettings& noise, vec3d eye)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    sampler.configure(noise, cubeGrid[0], cubeGrid[1], cubeGrid[2]);
+    hasGeneration = true;
+
+    // every chunk is remeshed, even if its level did not change
+    for(Chunk& chunk : chunks)
+        chunk.level = -1;
+
+    updateLevels(eye);
+
+    selected.clear();
+    for(int i = 0; i < numChunks; i++)
+        selected.push_back(i);
+
+    meshChunks();
+    numPendingChunks = 0;
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    meshingDuration = elapsed.count();
+}
+
+void TerrainLod::update(vec3d eye)
+{
+    // the density field is only known once generated
+    if(!hasGeneration)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    updateLevels(eye);
+
+    selected.clear();
+    for(int i = 0; i < numChunks; i++){
+        if(chunks[i].level != chunks[i].wantedLevel)
+            selected.push_back(i);
+    }
+
+    numPendingChunks = (int)selected.size();
+    if(selected.empty()){
+        meshingDuration = 0.f;
+        return;
+    }
+
+    // the nearest chunks are the most visible ones
+    std::sort(selected.begin(), selected.end(), [this](int a, int b){
+        return chunks[a].distance < chunks[b].distance;
+    });
+    if((int)selected.size() > chunksPerFrame)
+        selected.resize(chunksPerFrame);
+
+    meshChunks();
+    numPendingChunks -= (int)selected.size();
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    meshingDuration = elapsed.count();
+}
+
+void TerrainLod::updateLevels(vec3d eye)
+{
+    vec3d boxMin = getBoxMin();
+    float p[3] = {eye.x, eye.y, eye.z};
+    float lower[3] = {boxMin.x, boxMin.y, boxMin.z};
+
+    for(Chunk& chunk : chunks){
+        // distance to the nearest point of the chunk
+        float squared = 0.f;
+        for(int i = 0; i < 3; i++){
+            float low = lower[i] + chunk.origin[i] * cubeSize;
+            float high = low + chunk.cubes[i] * cubeSize;
+            float d = std::max(std::max(low - p[i], p[i] - high), 0.f);
+            squared += d * d;
+        }
+        chunk.distance = sqrtf(squared);
+
+        int level = (int)floorf(log2f(std::max(chunk.distance / lodDistance, 1.f)));
+        chunk.wantedLevel = std::min(std::max(level, 0), numLevels - 1);
+    }
+}
+
+void TerrainLod::meshChunks()
+{
+    // the chunks are meshed in parallel, only the upload needs the GL context
+    ThreadPool::global().parallelFor("lod.mesh", 0, (int)selected.size(), 1, [this](int begin, int end){
+        for(int i = begin; i < end; i++)
+            meshChunk(chunks[selected[i]]);
+    });
+
+    for(int index : selected)
+        uploadChunk(chunks[index]);
+
+    numVertices = 0;
+    numTriangles = 0;
+    for(Chunk& chunk : chunks){
+        numVertices += (int)chunk.packed.size();
+        numTriangles += chunk.numIndices / 3;
+    }
+}
+
+void TerrainLod::meshChunk(Chunk& chunk)
+{
+    chunk.level = chunk.wantedLevel;
+    int step = 1 << chunk.level;
+
+    // points of the chunk in grid coordinates, the last ones are clamped to the end of
+    // the chunk so that neighbour chunks share the points of their common face
+    int numPoints[3];
+    std::vector<float>* axes = chunk.axes;
+    for(int i = 0; i < 3; i++){
+        numPoints[i] = (chunk.cubes[i] + step - 1) / step + 1;
+        axes[i].resize(numPoints[i]);
+        for(int j = 0; j < numPoints[i]; j++)
+            axes[i][j] = (float)(chunk.origin[i] + std::min(j * step, chunk.cubes[i]));
+    }
+
+    CpuMarchingCubes& mesher = chunk.mesher;
+    mesher.surfaceLevels.assign(1, surfaceLevel);
+    mesher.begin(axes[1].data(), numPoints[1], axes[2].data(), numPoints[2]);
+
+    chunk.values.resize(numPoints[1] * numPoints[2]);
+    for(int i = 0; i < numPoints[0]; i++){
+        for(int j = 0; j < numPoints[1]; j++){
+            for(int k = 0; k < numPoints[2]; k++)
+                chunk.values[k + numPoints[2] * j] = sampler.sample(axes[0][i], axes[1][j], axes[2][k]);
+        }
+        mesher.addSlice(axes[0][i], chunk.values.data());
+    }
+
+    addSkirts(chunk, step);
+
+    // the normals come from the field itself, so they match across the chunks
+    vec3d boxMin = getBoxMin(), boxSize = getBoxSize();
+    int count = mesher.getNumVertices();
+    chunk.packed.resize(count);
+    for(int i = 0; i < count; i++){
+        float* p = &mesher.positions[i * 3];
+        float normal[3];
+        sampler.normal(p[0], p[1], p[2], normal);
+
+        float position[3];
+        for(int j = 0; j < 3; j++)
+            position[j] = (p[j] - cubeGrid[j] / 2.f) * cubeSize;
+
+        chunk.packed[i].encode(boxMin, boxSize, position, normal);
+    }
+}
+
+void TerrainLod::addSkirts(Chunk& chunk, int step)
+{
+    CpuMarchingCubes& mesher = chunk.mesher;
+    std::vector<float>& positions = mesher.positions;
+    std::vector<uint32_t>& indices = mesher.indices[0];
+
+    // faces of the chunk shared with another chunk, the faces of the grid need no skirt
+    float planes[6];
+    bool inner[6];
+    for(int i = 0; i < 3; i++){
+        planes[i * 2] = (float)chunk.origin[i];
+        planes[i * 2 + 1] = (float)(chunk.origin[i] + chunk.cubes[i]);
+        inner[i * 2] = chunk.origin[i] > 0;
+        inner[i * 2 + 1] = chunk.origin[i] + chunk.cubes[i] < cubeGrid[i];
+    }
+
+    chunk.skirtVertices.assign(mesher.getNumVertices(), -1);
+
+    // the vertices on a face are interpolated between points of that face, so they lie
+    // exactly on its plane, and so do the edges of the surface cut by the face
+    int numIndices = (int)indices.size();
+    for(int t = 0; t < numIndices; t += 3){
+        for(int e = 0; e < 3; e++){
+            uint32_t a = indices[t + e];
+            uint32_t b = indices[t + (e + 1) % 3];
+
+            bool onFace = false;
+            for(int f = 0; f < 6 && !onFace; f++){
+                int axis = f / 2;
+                onFace = inner[f] && positions[a * 3 + axis] == planes[f] && positions[b * 3 + axis] == planes[f];
+            }
+            if(!onFace)
+                continue;
+
+            // the skirt goes down under the surface by one cube of the level
+            uint32_t lowered[2];
+            uint32_t ends[2] = {a, b};
+            for(int i = 0; i < 2; i++){
+                int& skirt = chunk.skirtVertices[ends[i]];
+                if(skirt < 0){
+                    float p[3] = {positions[ends[i] * 3], positions[ends[i] * 3 + 1], positions[ends[i] * 3 + 2]};
+                    float normal[3];
+                    sampler.normal(p[0], p[1], p[2], normal);
+
+                    skirt = mesher.getNumVertices();
+                    for(int j = 0; j < 3; j++)
+                        positions.push_back(std::min(std::max(p[j] - normal[j] * step, 0.f), (float)cubeGrid[j]));
+                }
+                lowered[i] = (uint32_t)skirt;
+            }
+
+            // both sides, the skirts are seen from either chunk
+            uint32_t quad[12] = {
+                a, lowered[1], b,   a, lowered[0], lowered[1],
+                a, b, lowered[1],   a, lowered[1], lowered[0]
+            };
+            indices.insert(indices.end(), quad, quad + 12);
+        }
+    }
+}
+
+void TerrainLod::uploadChunk(Chunk& chunk)
+{
+    if(!chunk.hasBuffers){
+        chunk.vertices = Buffer(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+        chunk.indices = Buffer(GL_ELEMENT_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+        chunk.hasBuffers = true;
+    }
+
+    std::vector<uint32_t>& indices = chunk.mesher.indices[0];
+    chunk.numIndices = (int)indices.size();
+    if(chunk.numIndices == 0)
+        return;
+
+    // the sizes are reset first so that growing does not copy the previous content
+    chunk.vertices.resize(0);
+    chunk.vertices.resize(chunk.packed.size() * sizeof(PackedVertex), chunk.packed.data());
+    chunk.indices.resize(0);
+    chunk.indices.resize(indices.size() * sizeof(uint32_t), indices.data());
+}
+
+void TerrainLod::draw(const Frustum& frustum)
+{
+    glEnable(GL_COLOR_MATERIAL);
+    glEnable(GL_LIGHTING);
+
+    glColor3f(color.r, color.g, color.b);
+
+    glUseProgram(renderProgram);
+    vec3d boxMin = getBoxMin(), boxSize = getBoxSize();
+    glUniform3f(boxMinLocation, boxMin.x, boxMin.y, boxMin.z);
+    glUniform3f(boxSizeLocation, boxSize.x, boxSize.y, boxSize.z);
+
+    glEnableVertexAttribArray(0);
+
+    for(Chunk& chunk : chunks){
+        if(chunk.numIndices == 0)
+            continue;
+
+        float half[3], center[3];
+        float lower[3] = {boxMin.x, boxMin.y, boxMin.z};
+        for(int i = 0; i < 3; i++){
+            half[i] = chunk.cubes[i] * cubeSize / 2.f;
+            center[i] = lower[i] + chunk.origin[i] * cubeSize + half[i];
+        }
+        float radius = sqrtf(half[0]*half[0] + half[1]*half[1] + half[2]*half[2]);
+        if(!frustum.intersectsSphere(vec3d(center[0], center[1], center[2]), radius))
+            continue;
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.vertices.id);
+            glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(PackedVertex), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.indices.id);
+            glDrawElements(GL_TRIANGLES, chunk.numIndices, GL_UNSIGNED_INT, (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    glDisableVertexAttribArray(0);
+    glUseProgram(0);
+}
+
+vec3d TerrainLod::getBoxMin()
+{
+    return vec3d(-cubeGrid[0] * cubeSize / 2.f, -cubeGrid[1] * cubeSize / 2.f, -cubeGrid[2] * cubeSize / 2.f);
+}
+
+vec3d TerrainLod::getBoxSize()
+{
+    return vec3d(cubeGrid[0] * cubeSize, cubeGrid[1] * cubeSize, cubeGrid[2] * cubeSize);
+}
+
+void TerrainLod::createPrograms()
+{
+    if(hasPrograms)
+        return;
+
+    renderProgram = createRenderProgram("Terrain.vert", "Terrain.frag");
+    boxMinLocation = glGetUniformLocation(renderProgram, "boxMin");
+    boxSizeLocation = glGetUniformLocation(renderProgram, "boxSize");
+
+    hasPrograms = true;
+}
+
+void TerrainLod::deletePrograms()
+{
+    if(!hasPrograms)
+        return;
+
+    glDeleteProgram(renderProgram);
+    hasPrograms = false;
+}
+
+void TerrainLod::deleteBuffers()
+{
+    for(Chunk& chunk : chunks){
+        if(!chunk.hasBuffers)
+            continue;
+        chunk.vertices.deleteBuffer();
+        chunk.indices.deleteBuffer();
+        chunk.hasBuffers = false;
+        chunk.numIndices = 0;
+        chunk.level = -1;
+    }
+}
+
+TerrainLod::~TerrainLod()
+{
+
+}
@@ -0,0 +1,349 @@
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+// pool and index of the worker running on this thread, there can be several pools
+static thread_local ThreadPool* currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+
+ThreadPool::ThreadPool() : running(false), queuedTasks(0), nextQueue(0)
+{
+    startTime = std::chrono::steady_clock::now();
+}
+
+void ThreadPool::start(int numThreads, bool pinThreads)
+{
+    stop();
+
+    if(numThreads <= 0)
+        numThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    running.store(true);
+
+    // the calling thread is the last one
+    for(int i = 0; i < numThreads - 1; i++)
+        workers.push_back(new Worker());
+
+    for(int i = 0; i < numThreads - 1; i++){
+        workers[i]->thread = std::thread(&ThreadPool::runWorker, this, i);
+
+#ifdef __linux__
+        if(pinThreads){
+            int numCores = std::max((int)std::thread::hardware_concurrency(), 1);
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % numCores, &cpus);
+            pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpu_set_t), &cpus);
+        }
+#endif
+    }
+}
+
+void ThreadPool::stop()
+{
+    if(workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running.store(false);
+    }
+    sleepCondition.notify_all();
+
+    for(Worker* worker : workers){
+        worker->thread.join();
+        delete worker;
+    }
+    workers.clear();
+}
+
+int ThreadPool::getNumThreads()
+{
+    return (int)workers.size() + 1;
+}
+
+void ThreadPool::setProfileHook(ProfileHook hook, void* user)
+{
+    profileHook = hook;
+    profileUser = user;
+}
+
+void ThreadPool::submit(TaskFunction function, void* data, const char* name)
+{
+    Task task = {function, data, name};
+
+    if(workers.empty()){
+        execute(task);
+        return;
+    }
+
+    // workers push on their own queue, other threads spread their tasks
+    int index = workerIndex();
+    if(index < 0)
+        index = nextQueue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.pushBack(task);
+    }
+
+    queuedTasks.fetch_add(1, std::memory_order_release);
+
+    {
+        // the lock makes sure a worker going to sleep sees the new task
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    sleepCondition.notify_one();
+}
+
+void ThreadPool::wait(std::atomic<int>& counter)
+{
+    while(counter.load(std::memory_order_acquire) > 0){
+        Task task;
+        if(takeTask(task))
+            execute(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool ThreadPool::takeTask(Task& task)
+{
+    if(queuedTasks.load(std::memory_order_acquire) == 0)
+        return false;
+
+    int numWorkers = (int)workers.size();
+    int index = workerIndex();
+
+    // own tasks first, most recent first
+    if(index >= 0){
+        Worker* worker = workers[index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if(!worker->tasks.empty()){
+            task = worker->tasks.popBack();
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // then steal the oldest task of another queue
+    int start = index >= 0 ? index + 1 : (int)(nextQueue.load(std::memory_order_relaxed) % numWorkers);
+    for(int i = 0; i < numWorkers; i++){
+        Worker* victim = workers[(start + i) % numWorkers];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if(!victim->tasks.empty()){
+            task = victim->tasks.popFront();
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(Task& task)
+{
+    if(profileHook == nullptr){
+        task.function(task.data);
+        return;
+    }
+
+    typedef std::chrono::duration<double, std::milli> milliseconds;
+    double start = milliseconds(std::chrono::steady_clock::now() - startTime).count();
+    task.function(task.data);
+    double end = milliseconds(std::chrono::steady_clock::now() - startTime).count();
+
+    profileHook(task.name, workerIndex(), start, end, profileUser);
+}
+
+void ThreadPool::runWorker(int index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    while(true){
+        Task task;
+        if(takeTask(task)){
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]{
+            return !running.load() || queuedTasks.load(std::memory_order_acquire) > 0;
+        });
+
+        if(!running.load())
+            break;
+    }
+
+    currentPool = nullptr;
+    currentWorker = -1;
+}
+
+int ThreadPool::workerIndex()
+{
+    return currentPool == this ? currentWorker : -1;
+}
+
+void ThreadPool::runLoopTask(void* data)
+{
+    Loop& loop = *(Loop*)data;
+
+    // blocks are claimed one by one, so faster threads take more of them
+    while(true){
+        int block = loop.next.fetch_add(1, std::memory_order_relaxed);
+        if(block >= loop.count)
+            break;
+
+        int coords[3] = {
+            block % loop.numBlocks[0],
+            (block / loop.numBlocks[0]) % loop.numBlocks[1],
+            block / (loop.numBlocks[0] * loop.numBlocks[1])
+        };
+
+        Range3 sub;
+        for(int i = 0; i < 3; i++){
+            int size = std::max(loop.grain.end[i] - loop.grain.begin[i], 1);
+            sub.begin[i] = loop.range.begin[i] + coords[i] * size;
+            sub.end[i] = std::min(sub.begin[i] + size, loop.range.end[i]);
+        }
+
+        loop.invoke(loop.body, sub);
+    }
+
+    loop.pending.fetch_sub(1, std::memory_order_release);
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+ThreadPool::TaskQueue::TaskQueue() : tasks(256)
+{
+
+}
+
+bool ThreadPool::TaskQueue::empty()
+{
+    return head == tail;
+}
+
+void ThreadPool::TaskQueue::pushBack(const Task& task)
+{
+    if(tail - head == tasks.size()){
+        std::vector<Task> larger(tasks.size() * 2);
+        for(size_t i = head; i < tail; i++)
+            larger[i - head] = tasks[i % tasks.size()];
+        tail -= head;
+        head = 0;
+        tasks.swap(larger);
+    }
+
+    tasks[tail % tasks.size()] = task;
+    tail++;
+}
+
+ThreadPool::Task ThreadPool::TaskQueue::popBack()
+{
+    tail--;
+    return tasks[tail % tasks.size()];
+}
+
+ThreadPool::Task ThreadPool::TaskQueue::popFront()
+{
+    Task task = tasks[head % tasks.size()];
+    head++;
+    return task;
+}
+
+ThreadPool::Range3::Range3()
+{
+
+}
+
+ThreadPool::Range3::Range3(int x, int y, int z)
+{
+    end[0] = x;
+    end[1] = y;
+    end[2] = z;
+}
+
+ThreadPool::Range3::Range3(int x0, int y0, int z0, int x1, int y1, int z1)
+{
+    begin[0] = x0;
+    begin[1] = y0;
+    begin[2] = z0;
+    end[0] = x1;
+    end[1] = y1;
+    end[2] = z1;
+}
+
+
+TaskGraph::TaskGraph(ThreadPool& _pool) : pool(_pool), pendingNodes(0)
+{
+
+}
+
+int TaskGraph::add(const char* name, std::function<void()> work)
+{
+    nodes.emplace_back();
+    Node& node = nodes.back();
+    node.graph = this;
+    node.name = name;
+    node.work = work;
+    return (int)nodes.size() - 1;
+}
+
+void TaskGraph::precede(int before, int after)
+{
+    nodes[before].successors.push_back(after);
+    nodes[after].numPredecessors++;
+}
+
+void TaskGraph::run()
+{
+    pendingNodes.store((int)nodes.size());
+    for(Node& node : nodes)
+        node.remaining.store(node.numPredecessors);
+
+    for(Node& node : nodes){
+        if(node.numPredecessors == 0)
+            pool.submit(runNode, &node, node.name);
+    }
+
+    pool.wait(pendingNodes);
+}
+
+void TaskGraph::runNode(void* data)
+{
+    Node& node = *(Node*)data;
+    TaskGraph& graph = *node.graph;
+
+    node.work();
+
+    for(int index : node.successors){
+        Node& successor = graph.nodes[index];
+        if(successor.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            graph.pool.submit(runNode, &successor, successor.name);
+    }
+
+    graph.pendingNodes.fetch_sub(1, std::memory_order_release);
+}
+
+TaskGraph::~TaskGraph()
+{
+
+}